@@ -9,7 +9,13 @@
 
 #include "esp/iomux.h"
 #include "esp/gpio.h"
+#include "esp/interrupts.h"
+#include "esp/dport_regs.h"
+#include <common_macros.h>
 #include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
 
 #define _SPI0_SCK_GPIO  6
 #define _SPI0_MISO_GPIO 7
@@ -27,9 +33,43 @@
 #define _SPI1_FUNC IOMUX_FUNC(2)
 
 #define _SPI_BUF_SIZE 64
+#define _SPI_HALF_SIZE (_SPI_BUF_SIZE / 2)
 #define __min(a,b) ((a > b) ? (b):(a))
 
 static bool _minimal_pins[2] = {false, false};
+static bool _inited[2] = {false, false};
+
+/* Bus locks for the device layer, recursive for the owning task */
+typedef struct
+{
+    SemaphoreHandle_t lock;
+    TaskHandle_t owner;
+    uint8_t depth;
+} _spi_bus_lock_t;
+
+static _spi_bus_lock_t _locks[2];
+
+/* State of an asynchronous transfer. The W registers are used as two halves
+ * (W0..W7 and W8..W15, selected by the HIGHPART bits): one shifts while the
+ * other is drained and refilled by the transaction done interrupt. */
+typedef struct
+{
+    const uint8_t *out;
+    uint8_t *in;
+    size_t len;             // total bytes
+    size_t loaded;          // bytes stored into the W registers
+    size_t received;        // bytes read back
+    spi_endianness_t e;
+    spi_word_size_t word_size;
+    uint8_t half;           // half shifting now
+    uint8_t cur_len;        // bytes in the shifting half
+    uint8_t next_len;       // bytes prefilled in the other half, 0 if none
+    spi_transfer_cb_t cb;
+    void *arg;
+    volatile bool busy;
+} _spi_async_t;
+
+static _spi_async_t _async;
 
 bool spi_init(uint8_t bus, spi_mode_t mode, uint32_t freq_divider, bool msb, spi_endianness_t endianness, bool minimal_pins)
 {
@@ -58,6 +98,7 @@ bool spi_init(uint8_t bus, spi_mode_t mode, uint32_t freq_divider, bool msb, spi
     }
 
     _minimal_pins[bus] = minimal_pins;
+    _inited[bus] = true;
     SPI(bus).USER0 = SPI_USER0_MOSI | SPI_USER0_CLOCK_IN_EDGE | SPI_USER0_DUPLEX |
         (minimal_pins ? 0 : (SPI_USER0_CS_HOLD | SPI_USER0_CS_SETUP));
 
@@ -159,12 +200,12 @@ inline static void _start(uint8_t bus)
     SPI(bus).CMD |= SPI_CMD_USR;
 }
 
-inline static void _store_data(uint8_t bus, const void *data, size_t len)
+inline static void IRAM _store_data(uint8_t bus, uint8_t base, const void *data, size_t len)
 {
     uint8_t words = len / 4;
     uint8_t tail = len % 4;
 
-    memcpy((void *)SPI(bus).W, data, len - tail);
+    memcpy((void *)&SPI(bus).W[base], data, len - tail);
 
     if (!tail) return;
 
@@ -172,7 +213,22 @@ inline static void _store_data(uint8_t bus, const void *data, size_t len)
     uint8_t *offs = (uint8_t *)data + len - tail;
     for (uint8_t i = 0; i < tail; i++)
         last = last | (offs[i] << (i * 8));
-    SPI(bus).W[words] = last;
+    SPI(bus).W[base + words] = last;
+}
+
+inline static void IRAM _load_data(uint8_t bus, uint8_t base, void *data, size_t len)
+{
+    uint8_t words = len / 4;
+    uint8_t tail = len % 4;
+
+    memcpy(data, (void *)&SPI(bus).W[base], len - tail);
+
+    if (!tail) return;
+
+    uint32_t last = SPI(bus).W[base + words];
+    uint8_t *offs = (uint8_t *)data + len - tail;
+    for (uint8_t i = 0; i < tail; i++)
+        offs[i] = last >> (i * 8);
 }
 
 inline static uint32_t _swap_bytes(uint32_t value)
@@ -185,12 +241,12 @@ inline static uint32_t _swap_words(uint32_t value)
     return (value << 16) | (value >> 16);
 }
 
-static void _spi_buf_prepare(uint8_t bus, size_t len, spi_endianness_t e, spi_word_size_t word_size)
+static void IRAM _spi_buf_prepare(uint8_t bus, uint8_t base, size_t len, spi_endianness_t e, spi_word_size_t word_size)
 {
     if (e == SPI_LITTLE_ENDIAN || word_size == SPI_32BIT) return;
 
     size_t count = word_size == SPI_16BIT ? (len + 1) / 2 : (len + 3) / 4;
-    uint32_t *data = (uint32_t *)SPI(bus).W;
+    uint32_t *data = (uint32_t *)&SPI(bus).W[base];
     for (size_t i = 0; i < count; i ++)
     {
         data[i] = word_size == SPI_16BIT
@@ -205,14 +261,14 @@ static void _spi_buf_transfer(uint8_t bus, const void *out_data, void *in_data,
     _wait(bus);
     size_t bytes = len * (uint8_t)word_size;
     _set_size(bus, bytes);
-    _store_data(bus, out_data, bytes);
-    _spi_buf_prepare(bus, len, e, word_size);
+    _store_data(bus, 0, out_data, bytes);
+    _spi_buf_prepare(bus, 0, len, e, word_size);
     _start(bus);
     _wait(bus);
     if (in_data)
     {
-        _spi_buf_prepare(bus, len, e, word_size);
-        memcpy(in_data, (void *)SPI(bus).W, bytes);
+        _spi_buf_prepare(bus, 0, len, e, word_size);
+        _load_data(bus, 0, in_data, bytes);
     }
 }
 
@@ -237,7 +293,7 @@ uint32_t spi_transfer_32(uint8_t bus, uint32_t data)
     return res;
 }
 
-static void _rearm_extras_bit(uint8_t bus, bool arm)
+static void IRAM _rearm_extras_bit(uint8_t bus, bool arm)
 {
     if (!_minimal_pins[bus]) return;
     static uint8_t status[2];
@@ -297,6 +353,113 @@ size_t spi_transfer(uint8_t bus, const void *out_data, void *in_data, size_t len
     return len;
 }
 
+inline static void _select_half(uint8_t bus, uint8_t half)
+{
+    if (half)
+        SPI(bus).USER0 |= (SPI_USER0_MOSI_HIGHPART | SPI_USER0_MISO_HIGHPART);
+    else
+        SPI(bus).USER0 &= ~(SPI_USER0_MOSI_HIGHPART | SPI_USER0_MISO_HIGHPART);
+}
+
+/* Store the next chunk of the async transfer into a half of W registers,
+ * returns its size in bytes */
+static uint8_t IRAM _async_fill(uint8_t bus, uint8_t half)
+{
+    uint8_t bytes = __min(_async.len - _async.loaded, _SPI_HALF_SIZE);
+    if (!bytes) return 0;
+
+    uint8_t base = half * (_SPI_HALF_SIZE / 4);
+    _store_data(bus, base, _async.out + _async.loaded, bytes);
+    _spi_buf_prepare(bus, base, bytes / _async.word_size, _async.e, _async.word_size);
+    _async.loaded += bytes;
+    return bytes;
+}
+
+static void IRAM _async_start(uint8_t bus, uint8_t half, uint8_t bytes)
+{
+    _select_half(bus, half);
+    _set_size(bus, bytes);
+    _start(bus);
+}
+
+static void IRAM _spi_isr(void)
+{
+    if (!(DPORT.SPI_INT_STATUS & DPORT_SPI_INT_STATUS_SPI1)) return;
+    SPI(1).SLAVE0 &= ~SPI_SLAVE0_TRANS_DONE;
+    if (!_async.busy) return;
+
+    uint8_t done = _async.half;
+    uint8_t done_len = _async.cur_len;
+
+    // Keep the bus busy first, the other half is already filled
+    if (_async.next_len)
+    {
+        // Command, address and dummy bits go with the first chunk only
+        _rearm_extras_bit(1, false);
+        _async.half ^= 1;
+        _async.cur_len = _async.next_len;
+        _async_start(1, _async.half, _async.cur_len);
+    }
+    else
+        _async.cur_len = 0;
+
+    if (_async.in)
+    {
+        uint8_t base = done * (_SPI_HALF_SIZE / 4);
+        _spi_buf_prepare(1, base, done_len / _async.word_size, _async.e, _async.word_size);
+        _load_data(1, base, _async.in + _async.received, done_len);
+    }
+    _async.received += done_len;
+
+    if (_async.cur_len)
+    {
+        _async.next_len = _async_fill(1, done);
+        return;
+    }
+
+    SPI(1).SLAVE0 &= ~SPI_SLAVE0_TRANS_DONE_EN;
+    _select_half(1, 0);
+    _rearm_extras_bit(1, true);
+    _async.busy = false;
+    if (_async.cb)
+        _async.cb(1, _async.arg);
+}
+
+bool spi_transfer_async(uint8_t bus, const void *out_data, void *in_data, size_t len,
+    spi_word_size_t word_size, spi_transfer_cb_t cb, void *arg)
+{
+    if (bus != 1 || !out_data || !len || _async.busy) return false;
+
+    _async.out = out_data;
+    _async.in = in_data;
+    _async.len = len * (uint8_t)word_size;
+    _async.loaded = 0;
+    _async.received = 0;
+    _async.e = spi_get_endianness(bus);
+    _async.word_size = word_size;
+    _async.cb = cb;
+    _async.arg = arg;
+
+    _wait(bus);
+    SPI(bus).SLAVE0 = (SPI(bus).SLAVE0 & ~SPI_SLAVE0_TRANS_DONE) | SPI_SLAVE0_TRANS_DONE_EN;
+    _xt_isr_attach(INUM_SPI, _spi_isr);
+    _xt_isr_unmask(BIT(INUM_SPI));
+
+    // Fill both halves before starting, the interrupt takes over from here
+    _async.half = 0;
+    _async.cur_len = _async_fill(bus, 0);
+    _async.next_len = _async_fill(bus, 1);
+    _async.busy = true;
+    _async_start(bus, 0, _async.cur_len);
+
+    return true;
+}
+
+bool spi_transfer_busy(uint8_t bus)
+{
+    return bus == 1 && _async.busy;
+}
+
 static void _repeat_send(uint8_t bus, uint32_t *dword, int32_t *repeats,
     spi_word_size_t size)
 {
@@ -332,3 +495,115 @@ void spi_repeat_send_32(uint8_t bus, uint32_t data, int32_t repeats)
 {
     _repeat_send(bus, &data, &repeats, SPI_32BIT);
 }
+
+// Locking is skipped before the scheduler runs, e.g. for drivers set up in
+// user_init
+static inline bool _can_lock(void)
+{
+    return xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED;
+}
+
+void spi_bus_lock(uint8_t bus)
+{
+    _spi_bus_lock_t *l = &_locks[bus];
+
+    if (!_can_lock() || !l->lock)
+        return;
+    if (l->owner == xTaskGetCurrentTaskHandle())
+    {
+        l->depth++;
+        return;
+    }
+    xSemaphoreTake(l->lock, portMAX_DELAY);
+    l->owner = xTaskGetCurrentTaskHandle();
+    l->depth = 1;
+}
+
+void spi_bus_unlock(uint8_t bus)
+{
+    _spi_bus_lock_t *l = &_locks[bus];
+
+    if (!_can_lock() || !l->lock || l->owner != xTaskGetCurrentTaskHandle())
+        return;
+    if (--l->depth == 0)
+    {
+        l->owner = NULL;
+        xSemaphoreGive(l->lock);
+    }
+}
+
+bool spi_device_init(const spi_device_t *dev)
+{
+    if (dev->bus > 1) return false;
+
+    _spi_bus_lock_t *l = &_locks[dev->bus];
+    if (!l->lock)
+    {
+        // Another task may create it meanwhile, keep the first one
+        SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+        if (!lock) return false;
+        taskENTER_CRITICAL();
+        if (!l->lock)
+        {
+            l->lock = lock;
+            lock = NULL;
+        }
+        taskEXIT_CRITICAL();
+        if (lock)
+            vSemaphoreDelete(lock);
+    }
+
+    if (dev->cs_pin != SPI_CS_NONE)
+    {
+        gpio_enable(dev->cs_pin, GPIO_OUTPUT);
+        gpio_write(dev->cs_pin, true);
+    }
+    return true;
+}
+
+static bool _same_settings(const spi_settings_t *a, const spi_settings_t *b)
+{
+    return a->mode == b->mode
+        && a->freq_divider == b->freq_divider
+        && a->msb == b->msb
+        && a->endianness == b->endianness
+        && a->minimal_pins == b->minimal_pins;
+}
+
+void spi_device_acquire(const spi_device_t *dev)
+{
+    spi_bus_lock(dev->bus);
+
+    // Consecutive transactions to the same device leave the bus as it is
+    spi_settings_t current;
+    spi_get_settings(dev->bus, &current);
+    if (!_inited[dev->bus] || !_same_settings(&current, &dev->settings))
+        spi_set_settings(dev->bus, &dev->settings);
+}
+
+void spi_device_release(const spi_device_t *dev)
+{
+    spi_bus_unlock(dev->bus);
+}
+
+void spi_device_select(const spi_device_t *dev)
+{
+    spi_device_acquire(dev);
+    if (dev->cs_pin != SPI_CS_NONE)
+        gpio_write(dev->cs_pin, false);
+}
+
+void spi_device_deselect(const spi_device_t *dev)
+{
+    if (dev->cs_pin != SPI_CS_NONE)
+        gpio_write(dev->cs_pin, true);
+    spi_device_release(dev);
+}
+
+size_t spi_device_transfer(const spi_device_t *dev, const void *out_data, void *in_data, size_t len, spi_word_size_t word_size)
+{
+    spi_device_select(dev);
+    size_t res = spi_transfer(dev->bus, out_data, in_data, len, word_size);
+    spi_device_deselect(dev);
+    return res;
+}
@@ -0,0 +1,472 @@
+/* Interrupt driven UART buffering for esp/uart.h.
+ *
+ * Part of esp-open-rtos
+ * BSD Licensed as described in the file LICENSE
+ */
+#include <esp/uart.h>
+#include <esp/interrupts.h>
+#include <common_macros.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+/* TXFIFO_EMPTY fires when fewer bytes than this are left in the TX FIFO */
+#define UART_TX_EMPTY_THRESHOLD 16
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    volatile size_t head;       /* next byte written by tasks */
+    volatile size_t tail;       /* next byte sent by the ISR */
+    uart_tx_policy_t policy;
+    SemaphoreHandle_t space;    /* given by the ISR to a writer waiting for space */
+    volatile bool waiting;
+    uint32_t dropped;
+} uart_tx_ring_t;
+
+static uart_tx_ring_t *tx_ring[2];
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    volatile size_t head;       /* next byte stored by the ISR */
+    volatile size_t tail;       /* next byte read by tasks */
+    SemaphoreHandle_t data;     /* given by the ISR to a reader waiting for data */
+    volatile bool waiting;
+    uart_rx_stats_t stats;
+} uart_rx_ring_t;
+
+static uart_rx_ring_t *rx_ring[2];
+
+#define UART_RX_ERROR_INTS (UART_INT_STATUS_RXFIFO_OVERFLOW | \
+        UART_INT_STATUS_FRAMING_ERR | UART_INT_STATUS_PARITY_ERR)
+#define UART_RX_DATA_INTS (UART_INT_STATUS_RXFIFO_FULL | \
+        UART_INT_STATUS_RXFIFO_TIMEOUT)
+
+extern bool esp_in_isr;
+extern void *xPortSupervisorStackPointer;
+extern _xt_isr isr[];
+
+static inline size_t ring_used(const uart_tx_ring_t *ring)
+{
+    size_t head = ring->head, tail = ring->tail;
+    return (head >= tail) ? head - tail : ring->size - tail + head;
+}
+
+/* One slot is kept free to tell a full ring from an empty one */
+static inline size_t ring_free(const uart_tx_ring_t *ring)
+{
+    return ring->size - 1 - ring_used(ring);
+}
+
+/* Tasks may wait for ring space only when running under the scheduler with
+   interrupts enabled. Otherwise (ISRs, critical sections, fatal exception
+   dumps, before the scheduler starts) output is written out polled. */
+static inline bool can_block(void)
+{
+    return !esp_in_isr && !sdk_NMIIrqIsOn && !level1_int_disabled
+        && xPortSupervisorStackPointer != NULL;
+}
+
+/* Move as much of the ring into the TX FIFO as fits */
+static IRAM void tx_refill(int uart_num, uart_tx_ring_t *ring)
+{
+    size_t tail = ring->tail;
+    int space = UART_FIFO_MAX - FIELD2VAL(UART_STATUS_TXFIFO_COUNT, UART(uart_num).STATUS);
+
+    while (space-- > 0 && tail != ring->head) {
+        UART(uart_num).FIFO = ring->buf[tail];
+        if (++tail == ring->size) {
+            tail = 0;
+        }
+    }
+    ring->tail = tail;
+
+    if (tail == ring->head) {
+        UART(uart_num).INT_ENABLE &= ~UART_INT_ENABLE_TXFIFO_EMPTY;
+    }
+}
+
+/* Move everything in the RX FIFO into the ring */
+static IRAM void rx_drain(int uart_num, uart_rx_ring_t *ring)
+{
+    size_t head = ring->head;
+    int count = FIELD2VAL(UART_STATUS_RXFIFO_COUNT, UART(uart_num).STATUS);
+
+    while (count--) {
+        uint8_t c = UART(uart_num).FIFO;
+        size_t next = (head + 1 == ring->size) ? 0 : head + 1;
+        if (next == ring->tail) {
+            ring->stats.ring_overflow++;
+            continue;
+        }
+        ring->buf[head] = c;
+        head = next;
+    }
+    ring->head = head;
+}
+
+static IRAM void uart_isr(void)
+{
+    BaseType_t task_woken = pdFALSE;
+
+    for (int uart_num = 0; uart_num < 2; uart_num++) {
+        uint32_t status = UART(uart_num).INT_STATUS;
+        uart_tx_ring_t *ring = tx_ring[uart_num];
+        uart_rx_ring_t *rx = rx_ring[uart_num];
+
+        if ((status & (UART_RX_DATA_INTS | UART_RX_ERROR_INTS)) && rx) {
+            if (status & UART_INT_STATUS_RXFIFO_OVERFLOW) {
+                rx->stats.fifo_overrun++;
+            }
+            if (status & UART_INT_STATUS_FRAMING_ERR) {
+                rx->stats.framing_errors++;
+            }
+            if (status & UART_INT_STATUS_PARITY_ERR) {
+                rx->stats.parity_errors++;
+            }
+            rx_drain(uart_num, rx);
+            /* FIFO full/timeout stay asserted until the FIFO is drained,
+               clear them afterwards */
+            UART(uart_num).INT_CLEAR = status & (UART_RX_DATA_INTS | UART_RX_ERROR_INTS);
+            if (rx->waiting && rx->head != rx->tail) {
+                rx->waiting = false;
+                xSemaphoreGiveFromISR(rx->data, &task_woken);
+            }
+        }
+
+        if ((status & UART_INT_STATUS_TXFIFO_EMPTY) && ring) {
+            tx_refill(uart_num, ring);
+            UART(uart_num).INT_CLEAR = UART_INT_CLEAR_TXFIFO_EMPTY;
+            if (ring->waiting) {
+                ring->waiting = false;
+                xSemaphoreGiveFromISR(ring->space, &task_woken);
+            }
+        }
+    }
+
+    portEND_SWITCHING_ISR(task_woken);
+}
+
+/* uart_isr serves both UARTs. Don't replace a handler someone else attached
+   to INUM_UART. */
+static bool isr_available(void)
+{
+    return isr[INUM_UART] == NULL || isr[INUM_UART] == uart_isr;
+}
+
+/* Send everything in the ring without interrupts. Called from an ISR, with
+   interrupts disabled or before the scheduler starts, in which case
+   interrupts may be enabled: mask TXFIFO_EMPTY so uart_isr leaves the ring
+   alone. */
+static void tx_drain_polled(int uart_num, uart_tx_ring_t *ring)
+{
+    UART(uart_num).INT_ENABLE &= ~UART_INT_ENABLE_TXFIFO_EMPTY;
+    while (ring->tail != ring->head) {
+        uart_putc(uart_num, ring->buf[ring->tail]);
+        ring->tail = (ring->tail + 1 == ring->size) ? 0 : ring->tail + 1;
+    }
+}
+
+bool uart_tx_buffer_init(int uart_num, size_t size, uart_tx_policy_t policy)
+{
+    if (uart_num < 0 || uart_num > 1 || size < 2 || tx_ring[uart_num] ||
+            !isr_available()) {
+        return false;
+    }
+
+    uart_tx_ring_t *ring = calloc(1, sizeof(uart_tx_ring_t));
+    if (!ring) {
+        return false;
+    }
+    ring->buf = malloc(size);
+    ring->space = xSemaphoreCreateBinary();
+    if (!ring->buf || !ring->space) {
+        if (ring->space) {
+            vSemaphoreDelete(ring->space);
+        }
+        free(ring->buf);
+        free(ring);
+        return false;
+    }
+    ring->size = size;
+    ring->policy = policy;
+
+    UART(uart_num).CONF1 = SET_FIELD(UART(uart_num).CONF1,
+            UART_CONF1_TXFIFO_EMPTY_THRESHOLD, UART_TX_EMPTY_THRESHOLD);
+    UART(uart_num).INT_ENABLE &= ~UART_INT_ENABLE_TXFIFO_EMPTY;
+    UART(uart_num).INT_CLEAR = UART_INT_CLEAR_TXFIFO_EMPTY;
+
+    tx_ring[uart_num] = ring;
+
+    _xt_isr_attach(INUM_UART, uart_isr);
+    _xt_isr_unmask(BIT(INUM_UART));
+
+    return true;
+}
+
+bool uart_tx_buffered(int uart_num)
+{
+    return tx_ring[uart_num] != NULL;
+}
+
+/* Copy up to len bytes into the ring, returns the number of bytes copied.
+   Called in a critical section. */
+static size_t ring_put(uart_tx_ring_t *ring, const uint8_t *data, size_t len)
+{
+    size_t n = ring_free(ring);
+    if (n > len) {
+        n = len;
+    }
+
+    size_t head = ring->head;
+    size_t first = ring->size - head;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(ring->buf + head, data, first);
+    memcpy(ring->buf, data + first, n - first);
+    head += n;
+    if (head >= ring->size) {
+        head -= ring->size;
+    }
+    ring->head = head;
+
+    return n;
+}
+
+int uart_write(int uart_num, const void *buf, size_t len)
+{
+    uart_tx_ring_t *ring = tx_ring[uart_num];
+    const uint8_t *data = buf;
+
+    if (!ring || !can_block()) {
+        /* Unbuffered, or no interrupts to send the ring: keep the output in
+           order and write it out directly */
+        if (ring) {
+            tx_drain_polled(uart_num, ring);
+        }
+        for (size_t i = 0; i < len; i++) {
+            uart_putc(uart_num, data[i]);
+        }
+        return len;
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        size_t left = len - done;
+
+        taskENTER_CRITICAL();
+        if (ring->policy == UART_TX_DROP_OLDEST) {
+            /* Only the newest ring-size bytes can be kept */
+            size_t keep = ring->size - 1;
+            if (left > keep) {
+                ring->dropped += left - keep;
+                done += left - keep;
+                left = keep;
+            }
+            size_t space = ring_free(ring);
+            if (space < left) {
+                ring->tail = (ring->tail + left - space) % ring->size;
+                ring->dropped += left - space;
+            }
+        }
+        size_t n = ring_put(ring, data + done, left);
+        if (n < left) {
+            if (ring->policy == UART_TX_DROP_NEWEST) {
+                ring->dropped += left - n;
+            } else {
+                ring->waiting = true;
+            }
+        }
+        if (ring->head != ring->tail) {
+            UART(uart_num).INT_ENABLE |= UART_INT_ENABLE_TXFIFO_EMPTY;
+        }
+        taskEXIT_CRITICAL();
+
+        done += n;
+        if (ring->policy == UART_TX_DROP_NEWEST) {
+            break;
+        }
+        if (done < len) {
+            xSemaphoreTake(ring->space, portMAX_DELAY);
+        }
+    }
+
+    return done;
+}
+
+void uart_tx_buffer_flush(int uart_num)
+{
+    uart_tx_ring_t *ring = tx_ring[uart_num];
+
+    if (ring) {
+        if (can_block()) {
+            while (ring->head != ring->tail) {
+                vTaskDelay(1);
+            }
+        } else {
+            tx_drain_polled(uart_num, ring);
+        }
+    }
+    uart_flush_txfifo(uart_num);
+}
+
+uint32_t uart_tx_dropped(int uart_num)
+{
+    uart_tx_ring_t *ring = tx_ring[uart_num];
+    return ring ? ring->dropped : 0;
+}
+
+bool uart_rx_buffer_init(int uart_num, size_t size, uint8_t threshold)
+{
+    if (uart_num < 0 || uart_num > 1 || size < 2 || rx_ring[uart_num] ||
+            !isr_available()) {
+        return false;
+    }
+    if (threshold < 1 || threshold > UART_FIFO_MAX) {
+        threshold = UART_RX_DEFAULT_THRESHOLD;
+    }
+
+    uart_rx_ring_t *ring = calloc(1, sizeof(uart_rx_ring_t));
+    if (!ring) {
+        return false;
+    }
+    ring->buf = malloc(size);
+    ring->data = xSemaphoreCreateBinary();
+    if (!ring->buf || !ring->data) {
+        if (ring->data) {
+            vSemaphoreDelete(ring->data);
+        }
+        free(ring->buf);
+        free(ring);
+        return false;
+    }
+    ring->size = size;
+
+    /* Interrupt when `threshold` bytes are waiting, or when the line has
+       been idle for UART_RX_TIMEOUT byte times with data in the FIFO */
+    uint32_t conf1 = UART(uart_num).CONF1;
+    conf1 = SET_FIELD(conf1, UART_CONF1_RXFIFO_FULL_THRESHOLD, threshold);
+    conf1 = SET_FIELD(conf1, UART_CONF1_RX_TIMEOUT_THRESHOLD, UART_RX_TIMEOUT);
+    UART(uart_num).CONF1 = conf1 | UART_CONF1_RX_TIMEOUT_ENABLE;
+
+    uart_clear_rxfifo(uart_num);
+    UART(uart_num).INT_CLEAR = UART_RX_DATA_INTS | UART_RX_ERROR_INTS;
+
+    rx_ring[uart_num] = ring;
+
+    _xt_isr_attach(INUM_UART, uart_isr);
+    UART(uart_num).INT_ENABLE |= UART_RX_DATA_INTS | UART_RX_ERROR_INTS;
+    _xt_isr_unmask(BIT(INUM_UART));
+
+    return true;
+}
+
+bool uart_rx_buffered(int uart_num)
+{
+    return rx_ring[uart_num] != NULL;
+}
+
+size_t uart_rx_available(int uart_num)
+{
+    uart_rx_ring_t *ring = rx_ring[uart_num];
+
+    if (!ring) {
+        return FIELD2VAL(UART_STATUS_RXFIFO_COUNT, UART(uart_num).STATUS);
+    }
+    size_t head = ring->head, tail = ring->tail;
+    return (head >= tail) ? head - tail : ring->size - tail + head;
+}
+
+/* Copy up to len bytes out of the ring */
+static size_t ring_get(uart_rx_ring_t *ring, uint8_t *data, size_t len)
+{
+    size_t head = ring->head;
+    size_t tail = ring->tail;
+    size_t n = 0;
+
+    while (n < len && tail != head) {
+        size_t chunk = (head > tail) ? head - tail : ring->size - tail;
+        if (chunk > len - n) {
+            chunk = len - n;
+        }
+        memcpy(data + n, ring->buf + tail, chunk);
+        n += chunk;
+        tail += chunk;
+        if (tail == ring->size) {
+            tail = 0;
+        }
+    }
+    ring->tail = tail;
+
+    return n;
+}
+
+int uart_read(int uart_num, void *buf, size_t len, uint32_t timeout_ms)
+{
+    uart_rx_ring_t *ring = rx_ring[uart_num];
+    uint8_t *data = buf;
+    size_t done = 0;
+
+    if (!ring) {
+        /* Unbuffered, poll the FIFO */
+        while (done < len) {
+            int c = uart_getc_nowait(uart_num);
+            if (c < 0) {
+                if (!timeout_ms) {
+                    break;
+                }
+                uart_rxfifo_wait(uart_num, 1);
+                continue;
+            }
+            data[done++] = c;
+        }
+        return done;
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t ticks = (timeout_ms == UART_WAIT_FOREVER) ? portMAX_DELAY
+        : timeout_ms / portTICK_PERIOD_MS;
+
+    while (1) {
+        done += ring_get(ring, data + done, len - done);
+        if (done == len) {
+            break;
+        }
+
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (ticks != portMAX_DELAY && elapsed >= ticks) {
+            break;
+        }
+
+        taskENTER_CRITICAL();
+        bool empty = (ring->head == ring->tail);
+        if (empty) {
+            ring->waiting = true;
+        }
+        taskEXIT_CRITICAL();
+
+        if (empty && !xSemaphoreTake(ring->data,
+                    (ticks == portMAX_DELAY) ? portMAX_DELAY : ticks - elapsed)) {
+            ring->waiting = false;
+        }
+    }
+
+    return done;
+}
+
+void uart_get_rx_stats(int uart_num, uart_rx_stats_t *stats)
+{
+    uart_rx_ring_t *ring = rx_ring[uart_num];
+
+    if (!ring) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    taskENTER_CRITICAL();
+    *stats = ring->stats;
+    taskEXIT_CRITICAL();
+}
@@ -185,8 +185,8 @@ void spi_set_frequency_div(uint8_t bus, uint32_t divider);
  */
 inline uint32_t spi_get_frequency_div(uint8_t bus)
 {
-    return (FIELD2VAL(SPI_CLOCK_DIV_PRE, SPI(bus).CLOCK) + 1) |
-            (FIELD2VAL(SPI_CLOCK_COUNT_NUM, SPI(bus).CLOCK) + 1);
+    return SPI_GET_FREQ_DIV(FIELD2VAL(SPI_CLOCK_DIV_PRE, SPI(bus).CLOCK) + 1,
+            FIELD2VAL(SPI_CLOCK_COUNT_NUM, SPI(bus).CLOCK) + 1);
 }
 /**
  * \brief Get SPI bus frequency in Hz
@@ -274,6 +274,55 @@ uint32_t spi_transfer_32(uint8_t bus, uint32_t data);
  */
 size_t spi_transfer(uint8_t bus, const void *out_data, void *in_data, size_t len, spi_word_size_t word_size);
 
+/**
+ * \brief Completion callback of spi_transfer_async()
+ * Called from the SPI interrupt handler, so it must be short and may only use
+ * ISR safe functions (e.g. xSemaphoreGiveFromISR()).
+ * \param bus Bus ID
+ * \param arg Argument passed to spi_transfer_async()
+ */
+typedef void (*spi_transfer_cb_t)(uint8_t bus, void *arg);
+
+/**
+ * \brief Transfer buffer of words over SPI in background
+ * Same as spi_transfer() but returns immediately, the transfer is driven by
+ * the SPI transaction done interrupt. The 64 bytes SPI buffer is split in two
+ * halves: while one half is shifted out the interrupt handler reads back and
+ * refills the other one, so the bus is only idle for the interrupt latency
+ * between 32 bytes chunks.
+ * Buffers must stay valid until the callback is called. Don't use other SPI
+ * functions on the bus until then.
+ * Example:
+ *
+ *    static void done(uint8_t bus, void *arg)
+ *    {
+ *        BaseType_t woken = pdFALSE;
+ *        xSemaphoreGiveFromISR((SemaphoreHandle_t)arg, &woken);
+ *        portEND_SWITCHING_ISR(woken);
+ *    }
+ *    ...
+ *    spi_transfer_async(1, frame, NULL, sizeof(frame), SPI_8BIT, done, sem);
+ *    // prepare next frame here
+ *    xSemaphoreTake(sem, portMAX_DELAY);
+ *
+ * \param bus Bus ID: only 1 (HSPI) is supported
+ * \param out_data Data to send.
+ * \param in_data Receive buffer. If NULL, received data will be lost.
+ * \param len Buffer size in words
+ * \param word_size Size of the word
+ * \param cb Function called when the transfer is complete, may be NULL
+ * \param arg Argument for cb
+ * \return false if the bus is not supported or a transfer is in progress
+ */
+bool spi_transfer_async(uint8_t bus, const void *out_data, void *in_data, size_t len,
+    spi_word_size_t word_size, spi_transfer_cb_t cb, void *arg);
+/**
+ * \brief Check for asynchronous transfer in progress
+ * \param bus Bus ID: 0 - system, 1 - user
+ * \return true if spi_transfer_async() has not completed yet
+ */
+bool spi_transfer_busy(uint8_t bus);
+
 /**
  * \brief Add permanent command bits when transfert data over SPI
  * Example:
@@ -397,6 +446,99 @@ void spi_repeat_send_16(uint8_t bus, uint16_t data, int32_t repeats);
  */
 void spi_repeat_send_32(uint8_t bus, uint32_t data, int32_t repeats);
 
+/**
+ * Device on a shared SPI bus
+ *
+ * Several devices with different settings can share a bus. Transactions are
+ * serialized by a bus lock and the bus is only reconfigured when the settings
+ * differ from the current ones, so consecutive transactions to one device
+ * don't reinitialize it. Descriptors can be temporaries, devices are told
+ * apart by their settings.
+ * Example:
+ *
+ *     static const spi_device_t adc = {
+ *         .bus = 1,
+ *         .cs_pin = 4,
+ *         .settings = {
+ *             .mode = SPI_MODE3,
+ *             .freq_divider = SPI_FREQ_DIV_500K,
+ *             .msb = true,
+ *             .endianness = SPI_BIG_ENDIAN,
+ *             .minimal_pins = true
+ *         }
+ *     };
+ *     ...
+ *     spi_device_init(&adc);
+ *     spi_device_select(&adc);
+ *     spi_transfer_8(1, cmd);
+ *     value = spi_transfer_16(1, 0);
+ *     spi_device_deselect(&adc);
+ */
+#define SPI_CS_NONE 0xff  ///< No chip select GPIO, use hardware CS or none
+
+typedef struct
+{
+    uint8_t bus;              ///< Bus ID: 0 - system, 1 - user
+    uint8_t cs_pin;           ///< Chip select GPIO, active low, or SPI_CS_NONE
+    spi_settings_t settings;  ///< Bus settings for the device
+} spi_device_t;
+
+/**
+ * \brief Initialize device on a shared bus
+ * Creates the bus lock and sets the CS pin as a high output. Call for each
+ * device before using it.
+ * \param dev Device descriptor
+ * \return false when error
+ */
+bool spi_device_init(const spi_device_t *dev);
+/**
+ * \brief Lock the bus and apply the device settings if needed
+ * The lock is recursive for the owning task. Locking is skipped before the
+ * scheduler runs.
+ * \param dev Device descriptor
+ */
+void spi_device_acquire(const spi_device_t *dev);
+/**
+ * \brief Unlock the bus after spi_device_acquire()
+ * \param dev Device descriptor
+ */
+void spi_device_release(const spi_device_t *dev);
+/**
+ * \brief Acquire the bus and drive the device CS low
+ * \param dev Device descriptor
+ */
+void spi_device_select(const spi_device_t *dev);
+/**
+ * \brief Drive the device CS high and release the bus
+ * \param dev Device descriptor
+ */
+void spi_device_deselect(const spi_device_t *dev);
+/**
+ * \brief Transfer buffer of words to the device
+ * spi_transfer() between spi_device_select() and spi_device_deselect().
+ * \param dev Device descriptor
+ * \param out_data Data to send.
+ * \param in_data Receive buffer. If NULL, received data will be lost.
+ * \param len Buffer size in words
+ * \param word_size Size of the word
+ * \return Transmitted/received words count
+ */
+size_t spi_device_transfer(const spi_device_t *dev, const void *out_data, void *in_data, size_t len, spi_word_size_t word_size);
+
+/**
+ * \brief Lock the bus for direct use of the bus functions
+ * For code not using the device layer on a shared bus. The settings are read
+ * back from the bus by spi_device_acquire(), so they may be changed freely
+ * while the lock is held.
+ * \param bus Bus ID: 0 - system, 1 - user
+ */
+void spi_bus_lock(uint8_t bus);
+/**
+ * \brief Unlock the bus
+ * \param bus Bus ID: 0 - system, 1 - user
+ */
+void spi_bus_unlock(uint8_t bus);
+
 #ifdef __cplusplus
 }
 #endif
@@ -124,4 +124,104 @@ static inline int uart_get_baud(int uart_num)
     return APB_CLK_FREQ / FIELD2VAL(UART_CLOCK_DIVIDER_VALUE, UART(uart_num).CLOCK_DIVIDER);
 }
 
+/* Buffered transmit (see core/esp_uart.c)
+ *
+ * uart_tx_buffer_init() adds a RAM ring in front of the TX FIFO, refilled
+ * from the TXFIFO_EMPTY interrupt, so writers don't busy-wait for the
+ * hardware. stdout uses it automatically once enabled for UART0.
+ */
+
+typedef enum {
+    UART_TX_BLOCK = 0,      /* wait for space in the ring */
+    UART_TX_DROP_OLDEST,    /* discard the oldest unsent data to make room */
+    UART_TX_DROP_NEWEST,    /* accept only what fits, discard the rest */
+} uart_tx_policy_t;
+
+/* Enable buffered transmit with a `size` bytes ring, using `policy` when
+ * the ring is full.
+ *
+ * Both UARTs, transmit and receive, share one handler for INUM_UART. It is
+ * only installed if no other handler is attached to that interrupt.
+ *
+ * Returns false if out of memory, already enabled or another INUM_UART
+ * handler is attached.
+ */
+bool uart_tx_buffer_init(int uart_num, size_t size, uart_tx_policy_t policy);
+
+/* Returns true if buffered transmit is enabled for the UART */
+bool uart_tx_buffered(int uart_num);
+
+/* Write data to the UART.
+ *
+ * With buffered transmit this returns as soon as the data is in the ring
+ * (or, depending on the policy, dropped). Without it, or when called from an
+ * ISR or with interrupts disabled, data is written to the FIFO directly.
+ *
+ * Returns the number of bytes accepted, less than `len` only with the
+ * UART_TX_DROP_NEWEST policy.
+ */
+int uart_write(int uart_num, const void *buf, size_t len);
+
+/* Wait until the ring and the TX FIFO are empty */
+void uart_tx_buffer_flush(int uart_num);
+
+/* Returns the number of bytes dropped because the ring was full */
+uint32_t uart_tx_dropped(int uart_num);
+
+/* Buffered receive (see core/esp_uart.c)
+ *
+ * uart_rx_buffer_init() drains the RX FIFO into a RAM ring from the
+ * RXFIFO_FULL and RX timeout interrupts, so data isn't lost when tasks
+ * can't keep up with the 128 byte hardware FIFO.
+ */
+
+/* Default RX FIFO fill level that triggers the interrupt */
+#ifndef UART_RX_DEFAULT_THRESHOLD
+#define UART_RX_DEFAULT_THRESHOLD 64
+#endif
+
+/* Idle time, in byte times, after which data left in the RX FIFO is moved
+   to the ring */
+#ifndef UART_RX_TIMEOUT
+#define UART_RX_TIMEOUT 2
+#endif
+
+/* uart_read() timeout to wait until all data is read */
+#define UART_WAIT_FOREVER UINT32_MAX
+
+typedef struct {
+    uint32_t fifo_overrun;      /* RX FIFO overflowed before it was drained */
+    uint32_t ring_overflow;     /* bytes discarded because the ring was full */
+    uint32_t framing_errors;
+    uint32_t parity_errors;
+} uart_rx_stats_t;
+
+/* Enable buffered receive with a `size` bytes ring. `threshold` is the RX
+ * FIFO fill level (1-127) that triggers the interrupt, lower values give
+ * more margin at high baud rates for more interrupts. 0 selects
+ * UART_RX_DEFAULT_THRESHOLD.
+ *
+ * Returns false if out of memory, already enabled or another INUM_UART
+ * handler is attached (see uart_tx_buffer_init()).
+ */
+bool uart_rx_buffer_init(int uart_num, size_t size, uint8_t threshold);
+
+/* Returns true if buffered receive is enabled for the UART */
+bool uart_rx_buffered(int uart_num);
+
+/* Returns the number of bytes that can be read without waiting */
+size_t uart_rx_available(int uart_num);
+
+/* Read up to `len` bytes from the UART, waiting at most `timeout_ms` for
+ * all of them to arrive (0 returns what is available, UART_WAIT_FOREVER
+ * waits until `len` bytes are read). Without buffered receive any nonzero
+ * timeout busy-waits until `len` bytes are read.
+ *
+ * Returns the number of bytes read.
+ */
+int uart_read(int uart_num, void *buf, size_t len, uint32_t timeout_ms);
+
+/* Get the receive error counters */
+void uart_get_rx_stats(int uart_num, uart_rx_stats_t *stats);
+
 #endif /* _ESP_UART_H */
@@ -30,6 +30,43 @@
 
 #define SPI_FLASH_SECTOR_SIZE      4096
 
+/**
+ * Some flash chips hang if 64 bytes are read in one SPI transaction.
+ * By default reads are split into 60 byte transactions to work around it.
+ * Set to 0 to use the full 64 byte SPI buffer on chips known to be fine.
+ */
+#ifndef SPIFLASH_READ_WORKAROUND
+#define SPIFLASH_READ_WORKAROUND 1
+#endif
+
+/**
+ * In preemptible mode an erase runs for this many microseconds before it is
+ * suspended to service interrupts.
+ */
+#ifndef SPIFLASH_ERASE_SLICE_US
+#define SPIFLASH_ERASE_SLICE_US 1000
+#endif
+
+/**
+ * Read mode the SPI flash controller is configured for.
+ */
+typedef enum {
+    SPIFLASH_READ_MODE_SLOW = 0,
+    SPIFLASH_READ_MODE_FAST,
+    SPIFLASH_READ_MODE_DOUT,
+    SPIFLASH_READ_MODE_DIO,
+    SPIFLASH_READ_MODE_QOUT,
+    SPIFLASH_READ_MODE_QIO,
+} spiflash_read_mode_t;
+
+/**
+ * Longest time interrupts were disabled by write/erase operations.
+ */
+typedef struct {
+    uint32_t last_op_us;  // longest blackout of the last write/erase
+    uint32_t max_us;      // longest blackout since the last reset
+} spiflash_blackout_stats_t;
+
 /**
  * Read data from SPI flash.
  *
@@ -52,6 +89,12 @@ bool IRAM spiflash_read(uint32_t addr, uint8_t *buf, uint32_t size);
  */
 bool IRAM spiflash_write(uint32_t addr, uint8_t *buf, uint32_t size);
 
+/**
+ * Get the read mode the flash controller has been configured for by the
+ * bootloader. All reads done by spiflash_read use this mode.
+ */
+spiflash_read_mode_t spiflash_get_read_mode(void);
+
 /**
  * Erase a sector.
  *
@@ -61,4 +104,47 @@ bool IRAM spiflash_write(uint32_t addr, uint8_t *buf, uint32_t size);
  */
 bool IRAM spiflash_erase_sector(uint32_t addr);
 
+/**
+ * Enable or disable preemptible mode for write and erase operations.
+ *
+ * In preemptible mode writes are done one page at a time and interrupts are
+ * serviced between pages. Erases are suspended periodically on flash chips
+ * that support erase suspend/resume (Winbond, GigaDevice, Macronix).
+ *
+ * A write or erase is no longer atomic in this mode. Other tasks may run
+ * in the middle of it, so they must not access the region being modified.
+ * Writes and erases from tasks are serialized by a mutex, so one started
+ * while another erase is suspended waits for it to complete. Those from
+ * interrupts or critical sections can't wait and fail instead (see
+ * spiflash_erase_suspended()), as do the SDK spi_flash_write/erase calls.
+ *
+ * Must be called from a task or user_init().
+ *
+ * @param enable true to enable preemptible mode, it is disabled by default
+ */
+void spiflash_set_preemptible(bool enable);
+
+/**
+ * Check if a preemptible erase is currently suspended.
+ *
+ * The flash chip ignores erase and program commands while an erase is
+ * suspended, and reading the sector being erased gives undefined data.
+ * Reads of other sectors are fine.
+ *
+ * @return true while interrupts or other tasks run in the middle of an erase
+ */
+bool spiflash_erase_suspended(void);
+
+/**
+ * Get the interrupt blackout times of write/erase operations.
+ *
+ * @param stats Structure to fill
+ */
+void spiflash_get_blackout_stats(spiflash_blackout_stats_t *stats);
+
+/**
+ * Reset the maximum blackout time.
+ */
+void spiflash_reset_blackout_stats(void);
+
 #endif  // __SPIFLASH_H__
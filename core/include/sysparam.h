@@ -13,6 +13,15 @@
 #define DEFAULT_SYSPARAM_SECTORS 4
 #endif
 
+/* Maximum number of keys in the in-RAM lookup index built by
+ * sysparam_init().  Each key takes 20 bytes of heap.  Set to 0 to disable the
+ * index.  The size can also be changed at runtime with
+ * sysparam_set_index_size().
+ */
+#ifndef SYSPARAM_INDEX_ENTRIES
+#define SYSPARAM_INDEX_ENTRIES 0
+#endif
+
 /** @file sysparam.h
  *
  *  Read/write "system parameters" to persistent flash.
@@ -138,6 +147,59 @@ sysparam_status_t sysparam_create_area(uint32_t base_addr, uint16_t num_sectors,
  */
 sysparam_status_t sysparam_get_info(uint32_t *base_addr, uint32_t *num_sectors);
 
+/** Set the maximum number of keys held by the in-RAM lookup index
+ *
+ *  With the index, looking up a key costs a couple of flash reads instead of
+ *  a scan through the whole region.  If there are more keys than `max_keys`
+ *  lookups fall back to scanning the flash.
+ *
+ *  @param[in] max_keys  Maximum number of keys in the index, 0 to disable it
+ *
+ *  @retval ::SYSPARAM_OK           Completed successfully
+ *  @retval ::SYSPARAM_ERR_NOINIT   sysparam_init() must be called first
+ *  @retval ::SYSPARAM_ERR_NOMEM    Unable to allocate memory for the index
+ *  @retval ::SYSPARAM_ERR_IO       I/O error reading flash
+ */
+sysparam_status_t sysparam_set_index_size(uint16_t max_keys);
+
+/** Start a batch of updates
+ *
+ *  Until sysparam_batch_commit() is called, sysparam_set_*() calls made by
+ *  the calling task are only staged in RAM.  sysparam_get_*() calls made by
+ *  the same task see the staged values, other tasks keep seeing the old ones.
+ *
+ *  Only one batch can be in progress at a time.
+ *
+ *  @retval ::SYSPARAM_OK           Completed successfully
+ *  @retval ::SYSPARAM_ERR_NOINIT   No current sysparam area is active
+ *  @retval ::SYSPARAM_ERR_BADVALUE A batch is already in progress
+ */
+sysparam_status_t sysparam_batch_begin();
+
+/** Write all updates staged since sysparam_batch_begin()
+ *
+ *  The current values and the staged updates are written to the alternate
+ *  region in a single compaction pass, which only becomes active once
+ *  everything has been written.  If this fails for any reason (including a
+ *  power loss) the old set of values is left intact and none of the staged
+ *  updates are applied.
+ *
+ *  The batch is finished after this call whether it succeeded or not.
+ *
+ *  @retval ::SYSPARAM_OK           Completed successfully
+ *  @retval ::SYSPARAM_ERR_NOINIT   No current sysparam area is active
+ *  @retval ::SYSPARAM_ERR_BADVALUE No batch was started by this task
+ *  @retval ::SYSPARAM_ERR_FULL     The new set doesn't fit in the region
+ *  @retval ::SYSPARAM_ERR_NOMEM    Unable to allocate memory
+ *  @retval ::SYSPARAM_ERR_CORRUPT  Sysparam region has bad/corrupted data
+ *  @retval ::SYSPARAM_ERR_IO       I/O error reading/writing flash
+ */
+sysparam_status_t sysparam_batch_commit();
+
+/** Discard all updates staged since sysparam_batch_begin()
+ */
+void sysparam_batch_abort();
+
 /** Compact the sysparam area.
  *
  *  This also flattens the log.
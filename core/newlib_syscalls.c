@@ -44,6 +44,26 @@ IRAM caddr_t _sbrk_r (struct _reent *r, int incr)
 /* syscall implementation for stdio write to UART */
 __attribute__((weak)) long _write_stdout_r(struct _reent *r, int fd, const char *ptr, int len )
 {
+    if(uart_tx_buffered(0)) {
+        /* Convert line endings in chunks and hand them to the TX ring */
+        char buf[64];
+        int n = 0;
+        for(int i = 0; i < len; i++) {
+            if(ptr[i] == '\r')
+                continue;
+            if(ptr[i] == '\n')
+                buf[n++] = '\r';
+            buf[n++] = ptr[i];
+            if(n >= sizeof(buf) - 1) {
+                uart_write(0, buf, n);
+                n = 0;
+            }
+        }
+        if(n)
+            uart_write(0, buf, n);
+        return len;
+    }
+
     for(int i = 0; i < len; i++) {
         /* Auto convert CR to CRLF, ignore other LFs (compatible with Espressif SDK behaviour) */
         if(ptr[i] == '\r')
@@ -26,8 +26,12 @@
 #include "include/flashchip.h"
 #include "include/esp/rom.h"
 #include "include/esp/spi_regs.h"
+#include "include/xtensa_ops.h"
+#include "espressif/esp_system.h"
 
 #include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
 #include <string.h>
 
 /**
@@ -48,10 +52,147 @@
 
 #define SPI_WRITE_MAX_SIZE  64
 
-// 64 bytes read causes hang
+#if SPIFLASH_READ_WORKAROUND
+// 64 bytes read causes hang on some chips
 // http://bbs.espressif.com/viewtopic.php?f=6&t=2439
 #define SPI_READ_MAX_SIZE   60
+#else
+#define SPI_READ_MAX_SIZE   64
+#endif
 
+// Flash status register bit set while a write/erase is in progress
+#define SPI_FLASH_STATUS_BUSY   BIT(0)
+
+// Erase suspend/resume opcodes
+#define SPI_FLASH_CMD_SUSPEND_75    0x75  // Winbond, GigaDevice
+#define SPI_FLASH_CMD_RESUME_7A     0x7A
+#define SPI_FLASH_CMD_SUSPEND_B0    0xB0  // Macronix
+#define SPI_FLASH_CMD_RESUME_30     0x30
+
+// JEDEC manufacturer IDs
+#define SPI_FLASH_MFG_WINBOND       0xEF
+#define SPI_FLASH_MFG_GIGADEVICE    0xC8
+#define SPI_FLASH_MFG_MACRONIX      0xC2
+
+static bool preemptible = false;
+
+// 0 - not detected yet, 0xFF - suspend is not supported
+static uint8_t suspend_cmd = 0;
+static uint8_t resume_cmd = 0;
+
+// Interrupt blackout times in CPU cycles
+static uint32_t blackout_start;
+static uint32_t last_op_blackout;
+static uint32_t max_blackout;
+
+/**
+ * Disable interrupts and flash cache, start measuring the blackout time.
+ */
+static inline void IRAM flash_lock(void)
+{
+    vPortEnterCritical();
+    Cache_Read_Disable();
+    RSR(blackout_start, ccount);
+}
+
+/**
+ * Enable flash cache and interrupts. Longest blackout time of the current
+ * operation is kept in op_max.
+ */
+static inline void IRAM flash_unlock(uint32_t *op_max)
+{
+    uint32_t now;
+    RSR(now, ccount);
+    if (now - blackout_start > *op_max) {
+        *op_max = now - blackout_start;
+    }
+
+    Cache_Read_Enable(0, 0, 1);
+    vPortExitCritical();
+}
+
+extern bool esp_in_isr;
+
+// Serializes writes and erases in preemptible mode, where other tasks run
+// while an erase is suspended. Created by spiflash_set_preemptible().
+static SemaphoreHandle_t op_mutex;
+// Set while an erase is suspended, the chip ignores erase and program
+// commands then
+static volatile bool erase_suspended;
+
+/**
+ * Take the operation mutex when called from a task outside of a critical
+ * section.
+ *
+ * @return true if taken, only then other tasks may run during the operation
+ */
+static bool IRAM op_begin(void)
+{
+    if (op_mutex && !esp_in_isr && !level1_int_disabled &&
+            xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+        xSemaphoreTake(op_mutex, portMAX_DELAY);
+        return true;
+    }
+    return false;
+}
+
+static void IRAM op_end(bool locked)
+{
+    if (locked) {
+        xSemaphoreGive(op_mutex);
+    }
+}
+
+static void IRAM record_blackout(uint32_t op_max)
+{
+    last_op_blackout = op_max;
+    if (op_max > max_blackout) {
+        max_blackout = op_max;
+    }
+}
+
+/**
+ * Issue a single byte command that doesn't have address or data phase.
+ */
+static void IRAM spi_flash_command(uint8_t cmd)
+{
+    uint32_t user0 = SPI(0).USER0;
+    uint32_t user2 = SPI(0).USER2;
+
+    SPI(0).USER0 = SPI_USER0_COMMAND;
+    SPI(0).USER2 = (7 << SPI_USER2_COMMAND_BITLEN_S) | cmd;
+    SPI(0).CMD = SPI_CMD_USR;
+    while (SPI(0).CMD) {};
+
+    SPI(0).USER0 = user0;
+    SPI(0).USER2 = user2;
+}
+
+/**
+ * Find out which erase suspend/resume commands the flash chip supports.
+ * Must be called with flash locked.
+ */
+static void IRAM detect_suspend_cmd(void)
+{
+    SPI(0).W[0] = 0;
+    SPI(0).CMD = SPI_CMD_READ_ID;
+    while (SPI(0).CMD) {};
+
+    switch (SPI(0).W[0] & 0xFF) {
+        case SPI_FLASH_MFG_WINBOND:
+        case SPI_FLASH_MFG_GIGADEVICE:
+            suspend_cmd = SPI_FLASH_CMD_SUSPEND_75;
+            resume_cmd = SPI_FLASH_CMD_RESUME_7A;
+            break;
+        case SPI_FLASH_MFG_MACRONIX:
+            suspend_cmd = SPI_FLASH_CMD_SUSPEND_B0;
+            resume_cmd = SPI_FLASH_CMD_RESUME_30;
+            break;
+        default:
+            suspend_cmd = 0xFF;
+            break;
+    }
+}
 
 /**
  * Low level SPI flash write. Write block of data up to 64 bytes.
@@ -153,25 +294,64 @@ static bool IRAM spi_write(uint32_t addr, uint8_t *dst, uint32_t size)
 bool IRAM spiflash_write(uint32_t addr, uint8_t *buf, uint32_t size)
 {
     bool result = false;
+    uint32_t op_max = 0;
+    bool locked;
 
-    if (buf) {
-        vPortEnterCritical();
-        Cache_Read_Disable();
+    if (!buf) {
+        return false;
+    }
+
+    // Fail from an interrupt serviced while an erase is suspended
+    locked = op_begin();
+    if (!locked && spiflash_erase_suspended()) {
+        return false;
+    }
+
+    if (!preemptible) {
+        flash_lock();
 
         result = spi_write(addr, buf, size);
 
         // make sure all write operations is finished before exiting
         Wait_SPI_Idle(&sdk_flashchip);
 
-        Cache_Read_Enable(0, 0, 1);
-        vPortExitCritical();
+        flash_unlock(&op_max);
+        op_end(locked);
+        record_blackout(op_max);
+        return result;
     }
 
+    // Write one page at a time and let interrupts through between pages
+    do {
+        uint32_t chunk = sdk_flashchip.page_size -
+            (addr % sdk_flashchip.page_size);
+        if (chunk > size) {
+            chunk = size;
+        }
+
+        flash_lock();
+        result = spi_write(addr, buf, chunk);
+        Wait_SPI_Idle(&sdk_flashchip);
+        flash_unlock(&op_max);
+
+        addr += chunk;
+        buf += chunk;
+        size -= chunk;
+    } while (result && size);
+
+    op_end(locked);
+    record_blackout(op_max);
     return result;
 }
 
 /**
  * Read SPI flash up to 64 bytes.
+ *
+ * The READ command issued by the controller uses the fast/dual/quad read
+ * opcode selected by the flash mode bits in SPI(0).CTRL0, which are set up
+ * by the bootloader from the image header. So the data transfer itself is
+ * already as fast as the configured flash mode allows, what is left to
+ * optimize is getting the data out of the W registers.
  */
 static inline void IRAM read_block(sdk_flashchip_t *chip, uint32_t addr,
         uint8_t *buf, uint32_t size)
@@ -183,7 +363,20 @@ static inline void IRAM read_block(sdk_flashchip_t *chip, uint32_t addr,
 
     __asm__ volatile("memw");
 
-    memcpy(buf, (const void*)SPI(0).W, size);
+    if (((uint32_t)buf & 0b11) == 0) {
+        // Word aligned destination, stream the W registers directly
+        uint32_t *dst = (uint32_t*)buf;
+        uint32_t words = size >> 2;
+        for (uint32_t i = 0; i < words; i++) {
+            dst[i] = SPI(0).W[i];
+        }
+        if (size & 0b11) {
+            uint32_t last = SPI(0).W[words];
+            memcpy(buf + (words << 2), &last, size & 0b11);
+        }
+    } else {
+        memcpy(buf, (const void*)SPI(0).W, size);
+    }
 }
 
 /**
@@ -217,22 +410,43 @@ static inline bool IRAM read_data(sdk_flashchip_t *flashchip, uint32_t addr,
 bool IRAM spiflash_read(uint32_t dest_addr, uint8_t *buf, uint32_t size)
 {
     bool result = false;
+    uint32_t op_max = 0;
 
     if (buf) {
-        vPortEnterCritical();
-        Cache_Read_Disable();
+        flash_lock();
 
         result = read_data(&sdk_flashchip, dest_addr, buf, size);
 
-        Cache_Read_Enable(0, 0, 1);
-        vPortExitCritical();
+        flash_unlock(&op_max);
     }
 
     return result;
 }
 
+spiflash_read_mode_t spiflash_get_read_mode(void)
+{
+    uint32_t ctrl0 = SPI(0).CTRL0;
+
+    if (ctrl0 & SPI_CTRL0_QIO_MODE) {
+        return SPIFLASH_READ_MODE_QIO;
+    } else if (ctrl0 & SPI_CTRL0_QOUT_MODE) {
+        return SPIFLASH_READ_MODE_QOUT;
+    } else if (ctrl0 & SPI_CTRL0_DIO_MODE) {
+        return SPIFLASH_READ_MODE_DIO;
+    } else if (ctrl0 & SPI_CTRL0_DOUT_MODE) {
+        return SPIFLASH_READ_MODE_DOUT;
+    } else if (ctrl0 & SPI_CTRL0_FASTRD_MODE) {
+        return SPIFLASH_READ_MODE_FAST;
+    }
+    return SPIFLASH_READ_MODE_SLOW;
+}
+
 bool IRAM spiflash_erase_sector(uint32_t addr)
 {
+    uint32_t op_max = 0;
+    uint32_t slice = SPIFLASH_ERASE_SLICE_US * sdk_system_get_cpu_freq();
+    bool locked;
+
     if ((addr + sdk_flashchip.sector_size) > sdk_flashchip.chip_size) {
         return false;
     }
@@ -241,8 +455,17 @@ bool IRAM spiflash_erase_sector(uint32_t addr)
         return false;
     }
 
-    vPortEnterCritical();
-    Cache_Read_Disable();
+    // Fail from an interrupt serviced while another erase is suspended
+    locked = op_begin();
+    if (!locked && spiflash_erase_suspended()) {
+        return false;
+    }
+
+    flash_lock();
+
+    if (!suspend_cmd) {
+        detect_suspend_cmd();
+    }
 
     SPI_write_enable(&sdk_flashchip);
 
@@ -250,10 +473,70 @@ bool IRAM spiflash_erase_sector(uint32_t addr)
     SPI(0).CMD = SPI_CMD_SE;
     while (SPI(0).CMD) {};
 
+    if (preemptible && suspend_cmd != 0xFF) {
+        uint32_t status;
+        uint32_t slice_start = blackout_start;
+        uint32_t now;
+
+        while (true) {
+            SPI_read_status(&sdk_flashchip, &status);
+            if (!(status & SPI_FLASH_STATUS_BUSY)) {
+                break;
+            }
+
+            RSR(now, ccount);
+            if (now - slice_start > slice) {
+                // Suspend the erase, service pending interrupts and, when
+                // called from a task, let other tasks run. Code can be
+                // fetched from flash while erase is suspended.
+                spi_flash_command(suspend_cmd);
+                Wait_SPI_Idle(&sdk_flashchip);
+                erase_suspended = true;
+                flash_unlock(&op_max);
+                if (locked) {
+                    taskYIELD();
+                }
+
+                flash_lock();
+                erase_suspended = false;
+                spi_flash_command(resume_cmd);
+                slice_start = blackout_start;
+            }
+        }
+    }
+
     Wait_SPI_Idle(&sdk_flashchip);
 
-    Cache_Read_Enable(0, 0, 1);
-    vPortExitCritical();
+    flash_unlock(&op_max);
+    op_end(locked);
+    record_blackout(op_max);
 
     return true;
 }
+
+bool IRAM spiflash_erase_suspended(void)
+{
+    return erase_suspended;
+}
+
+void spiflash_set_preemptible(bool enable)
+{
+    if (enable && !op_mutex) {
+        op_mutex = xSemaphoreCreateMutex();
+    }
+    preemptible = enable;
+}
+
+void spiflash_get_blackout_stats(spiflash_blackout_stats_t *stats)
+{
+    uint32_t mhz = sdk_system_get_cpu_freq();
+
+    stats->last_op_us = last_op_blackout / mhz;
+    stats->max_us = max_blackout / mhz;
+}
+
+void spiflash_reset_blackout_stats(void)
+{
+    last_op_blackout = 0;
+    max_blackout = 0;
+}
@@ -12,6 +12,7 @@
 #include "flashchip.h"
 #include <common_macros.h>
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
 
 /* The "magic" value that indicates the start of a sysparam region in flash.
@@ -101,6 +102,25 @@ struct entry_header {
     uint16_t len;
 } __attribute__ ((packed));
 
+struct index_entry {
+    uint32_t hash;
+    uint32_t key_addr;
+    uint32_t value_addr;  // 0 if the key currently has no value
+    struct entry_header value;
+    uint16_t key_id;
+    uint16_t key_len;
+};
+
+struct batch_entry {
+    struct batch_entry *next;
+    char *key;
+    uint8_t *value;
+    uint16_t key_len;
+    uint16_t value_len;  // 0 means the key is to be deleted
+    bool binary;
+    bool written;
+};
+
 struct sysparam_context {
     uint32_t addr;
     struct entry_header entry;
@@ -120,6 +140,24 @@ static struct {
     SemaphoreHandle_t sem;
 } _sysparam_info;
 
+/* In-RAM index of keys sorted by hash.  If it's not valid (disabled, out of
+ * space or out of sync after an error) lookups scan the flash instead.
+ */
+static struct {
+    struct index_entry *entries;
+    uint16_t count;
+    uint16_t max_keys;
+    bool valid;
+} _sysparam_index = { .max_keys = SYSPARAM_INDEX_ENTRIES };
+
+/* Updates staged by sysparam_set_data() between sysparam_batch_begin() and
+ * sysparam_batch_commit().
+ */
+static struct {
+    struct batch_entry *entries;
+    TaskHandle_t owner;
+} _sysparam_batch;
+
 /***************************** Internal routines *****************************/
 
 static sysparam_status_t _write_and_verify(uint32_t addr, const void *data, size_t data_size) {
@@ -344,6 +382,191 @@ static inline sysparam_status_t _find_value(struct sysparam_context *ctx, uint16
     return _find_entry(ctx, id_field & ENTRY_MASK_ID, true);
 }
 
+/** FNV-1a hash of a key, `hash` is the result of previous chunks or
+ *  FNV_OFFSET_BASIS for the first one */
+#define FNV_OFFSET_BASIS 0x811c9dc5
+#define FNV_PRIME 0x01000193
+
+static uint32_t _index_hash(uint32_t hash, const uint8_t *data, size_t len) {
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/** Position of the first index entry with hash >= `hash` */
+static int _index_lower_bound(uint32_t hash) {
+    int lo = 0;
+    int hi = _sysparam_index.count;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (_sysparam_index.entries[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static struct index_entry *_index_find_id(uint16_t key_id) {
+    for (int i = 0; i < _sysparam_index.count; i++) {
+        if (_sysparam_index.entries[i].key_id == key_id) {
+            return &_sysparam_index.entries[i];
+        }
+    }
+    return NULL;
+}
+
+/** Empty the index so it can be filled again from scratch */
+static void _index_reset(void) {
+    _sysparam_index.count = 0;
+    _sysparam_index.valid = (_sysparam_index.entries != NULL);
+}
+
+static void _index_add(uint32_t hash, uint16_t key_id, uint32_t key_addr, uint16_t key_len) {
+    struct index_entry *entry;
+    int pos;
+
+    if (!_sysparam_index.valid) return;
+    if (_sysparam_index.count >= _sysparam_index.max_keys) {
+        debug(1, "index full (%d keys), falling back to flash scan", _sysparam_index.max_keys);
+        _sysparam_index.valid = false;
+        return;
+    }
+
+    // Keys with the same hash keep flash order, so if the same key name
+    // exists more than once _index_lookup() finds the first one, just as
+    // _find_key() does.
+    pos = _index_lower_bound(hash);
+    while (pos < _sysparam_index.count && _sysparam_index.entries[pos].hash == hash) {
+        pos++;
+    }
+    entry = &_sysparam_index.entries[pos];
+    memmove(entry + 1, entry, (_sysparam_index.count - pos) * sizeof(*entry));
+    _sysparam_index.count++;
+
+    entry->hash = hash;
+    entry->key_addr = key_addr;
+    entry->value_addr = 0;
+    entry->key_id = key_id;
+    entry->key_len = key_len;
+}
+
+/** Record the location of the current value for a key, or 0 if deleted */
+static void _index_set_value(uint16_t key_id, uint32_t addr, uint16_t idflags, uint16_t len) {
+    struct index_entry *entry;
+
+    if (!_sysparam_index.valid) return;
+    entry = _index_find_id(key_id);
+    if (!entry) {
+        _sysparam_index.valid = false;
+        return;
+    }
+    entry->value_addr = addr;
+    entry->value.idflags = idflags;
+    entry->value.len = len;
+}
+
+/** Hash the payload of the key entry pointed to by `ctx` */
+static sysparam_status_t _index_hash_key(struct sysparam_context *ctx, uint32_t *hash) {
+    uint32_t bounce[BOUNCE_BUFFER_WORDS];
+    uint32_t addr = ctx->addr + ENTRY_HEADER_SIZE;
+    int i;
+
+    *hash = FNV_OFFSET_BASIS;
+    for (i = 0; i < ctx->entry.len; i += BOUNCE_BUFFER_SIZE) {
+        int len = min(ctx->entry.len - i, BOUNCE_BUFFER_SIZE);
+        CHECK_FLASH_OP(spiflash_read(addr + i, (void*)bounce, len));
+        *hash = _index_hash(*hash, (uint8_t *)bounce, len);
+    }
+    return SYSPARAM_OK;
+}
+
+/** Build the index by scanning the whole active region */
+static sysparam_status_t _index_rebuild(void) {
+    struct sysparam_context ctx;
+    sysparam_status_t status;
+    uint32_t hash;
+    uint16_t id;
+
+    _index_reset();
+    if (!_sysparam_index.valid) return SYSPARAM_OK;
+
+    // First pass: all keys
+    _init_context(&ctx);
+    while ((status = _find_key(&ctx, NULL, 0)) == SYSPARAM_OK) {
+        status = _index_hash_key(&ctx, &hash);
+        if (status < 0) break;
+        _index_add(hash, ctx.entry.idflags & ENTRY_MASK_ID, ctx.addr, ctx.entry.len);
+    }
+
+    // Second pass: values. The first live value of a key is the one
+    // _find_value() would return, so later ones are ignored.
+    _init_context(&ctx);
+    while (status >= 0 && (status = _find_entry(&ctx, ENTRY_ID_ANY, true)) == SYSPARAM_OK) {
+        id = ctx.entry.idflags & ENTRY_MASK_ID;
+        struct index_entry *entry = _index_find_id(id);
+        if (entry && !entry->value_addr) {
+            entry->value_addr = ctx.addr;
+            entry->value = ctx.entry;
+        }
+    }
+
+    if (status < 0) {
+        _sysparam_index.valid = false;
+        return status;
+    }
+    debug(2, "index rebuilt (%d keys%s)", _sysparam_index.count, _sysparam_index.valid ? "" : ", incomplete");
+    return SYSPARAM_OK;
+}
+
+/** Look up the value for a key using the index */
+static sysparam_status_t _index_lookup(struct sysparam_context *ctx, const char *key, uint16_t key_len) {
+    uint32_t hash = _index_hash(FNV_OFFSET_BASIS, (const uint8_t *)key, key_len);
+    sysparam_status_t status;
+    int i;
+
+    for (i = _index_lower_bound(hash); i < _sysparam_index.count; i++) {
+        struct index_entry *entry = &_sysparam_index.entries[i];
+        if (entry->hash != hash) break;
+        if (entry->key_len != key_len) continue;
+
+        // Make sure it's not a hash collision
+        memset(ctx, 0, sizeof(*ctx));
+        ctx->addr = entry->key_addr;
+        ctx->entry.len = key_len;
+        status = _compare_payload(ctx, (uint8_t *)key, key_len);
+        if (status == SYSPARAM_NOTFOUND) continue;
+        if (status != SYSPARAM_OK) return status;
+
+        if (!entry->value_addr) break;
+        ctx->addr = entry->value_addr;
+        ctx->entry = entry->value;
+        return SYSPARAM_OK;
+    }
+    ctx->entry.len = 0;
+    ctx->entry.idflags = 0;
+    return SYSPARAM_NOTFOUND;
+}
+
+/** Find the value entry for the specified key name, using the index if
+ *  available */
+static sysparam_status_t _find_key_value(struct sysparam_context *ctx, const char *key, uint16_t key_len) {
+    sysparam_status_t status;
+
+    if (_sysparam_index.valid) {
+        return _index_lookup(ctx, key, key_len);
+    }
+
+    _init_context(ctx);
+    status = _find_key(ctx, key, key_len);
+    if (status != SYSPARAM_OK) return status;
+
+    return _find_value(ctx, ctx->entry.idflags);
+}
+
 /** Write an entry at the specified address */
 static inline sysparam_status_t _write_entry(uint32_t addr, uint16_t id, const uint8_t *payload, uint16_t len) {
     struct entry_header entry;
@@ -407,25 +630,131 @@ static inline sysparam_status_t _delete_entry(uint32_t addr) {
     return _write_and_verify(addr, &entry, ENTRY_HEADER_SIZE);
 }
 
+/** Look up a key in the list of staged batch updates */
+static struct batch_entry *_batch_find(const char *key, uint16_t key_len) {
+    struct batch_entry *entry;
+
+    for (entry = _sysparam_batch.entries; entry; entry = entry->next) {
+        if (entry->key_len == key_len && !memcmp(entry->key, key, key_len)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void _batch_free(void) {
+    struct batch_entry *entry = _sysparam_batch.entries;
+
+    while (entry) {
+        struct batch_entry *next = entry->next;
+        free(entry);
+        entry = next;
+    }
+    _sysparam_batch.entries = NULL;
+    _sysparam_batch.owner = NULL;
+}
+
+/** True if the calling task has a batch in progress */
+static inline bool _batch_active(void) {
+    return _sysparam_batch.owner &&
+        _sysparam_batch.owner == xTaskGetCurrentTaskHandle();
+}
+
+/** Stage an update (replacing any earlier one for the same key) */
+static sysparam_status_t _batch_stage(const char *key, uint16_t key_len, const uint8_t *value, uint16_t value_len, bool binary) {
+    struct batch_entry **link = &_sysparam_batch.entries;
+    struct batch_entry *entry;
+
+    // Drop a previously staged update for this key
+    while (*link) {
+        entry = *link;
+        if (entry->key_len == key_len && !memcmp(entry->key, key, key_len)) {
+            *link = entry->next;
+            free(entry);
+        } else {
+            link = &entry->next;
+        }
+    }
+
+    entry = malloc(sizeof(struct batch_entry) + key_len + value_len);
+    if (!entry) return SYSPARAM_ERR_NOMEM;
+
+    entry->next = NULL;
+    entry->key = (char *)(entry + 1);
+    entry->value = (uint8_t *)entry->key + key_len;
+    memcpy(entry->key, key, key_len);
+    if (value_len) {
+        memcpy(entry->value, value, value_len);
+    }
+    entry->key_len = key_len;
+    entry->value_len = value_len;
+    entry->binary = binary;
+    *link = entry;
+
+    debug(2, "staged value for '%s' (%d bytes)", key, value_len);
+    return SYSPARAM_OK;
+}
+
+/** Write a key and its value to a region being compacted, advancing *addr */
+static sysparam_status_t _compact_write_pair(uint32_t *addr, uint32_t region_end, uint16_t key_id, const char *key, uint16_t key_len, const uint8_t *value, uint16_t value_len, bool binary) {
+    uint16_t binary_flag = binary ? ENTRY_FLAG_BINARY : 0;
+    sysparam_status_t status;
+
+    if (*addr + ENTRY_SIZE(key_len) + ENTRY_SIZE(value_len) > region_end) {
+        debug(1, "compacted data doesn't fit in region");
+        return SYSPARAM_ERR_FULL;
+    }
+
+    // Write the key to the new region
+    debug(2, "writing %d key @ 0x%08x", key_id, *addr);
+    status = _write_entry(*addr, key_id, (const uint8_t *)key, key_len);
+    if (status < 0) return status;
+    _index_add(_index_hash(FNV_OFFSET_BASIS, (const uint8_t *)key, key_len),
+            key_id, *addr, key_len);
+    *addr += ENTRY_SIZE(key_len);
+
+    if (!value) {
+        return SYSPARAM_OK;
+    }
+
+    // Write the value to the new region
+    debug(2, "writing %d value @ 0x%08x", key_id, *addr);
+    status = _write_entry(*addr, key_id | ENTRY_FLAG_VALUE | binary_flag, value, value_len);
+    if (status < 0) return status;
+    _index_set_value(key_id, *addr,
+            key_id | ENTRY_FLAG_ALIVE | ENTRY_FLAG_VALUE | binary_flag,
+            value_len);
+    *addr += ENTRY_SIZE(value_len);
+
+    return SYSPARAM_OK;
+}
+
 /** Compact the current region, removing all deleted/unused entries, and write
  *  the result to the alternate region, then make the new alternate region the
  *  active one.
  *
  *  @param key_id  A pointer to the "current" key ID, or NULL if none.
+ *  @param batch   List of staged updates to apply while compacting, or NULL.
  *
  *  NOTE: The value corresponding to the passed key ID will not be written to
  *  the output (because it is assumed it will be overwritten as the next step
  *  in `sysparam_set_data` anyway).  When compacting, this routine will
  *  automatically update *key_id to contain the ID of this key in the new
  *  compacted result as well.
+ *
+ *  Staged updates replace the values of existing keys (or drop the key if the
+ *  staged value is empty), new keys are appended at the end.  The new region
+ *  only becomes active once everything has been written, so if anything fails
+ *  (including running out of space) the current region stays as it was.
  */
-static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_id) {
+static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_id, struct batch_entry *batch) {
     uint32_t new_base = _sysparam_info.alt_base;
+    uint32_t region_end = new_base + _sysparam_info.region_size;
     sysparam_status_t status;
     uint32_t addr = new_base + REGION_HEADER_SIZE;
     uint16_t current_key_id = 0;
     sysparam_iter_t iter;
-    uint16_t binary_flag;
+    struct batch_entry *staged;
     uint16_t num_sectors = _sysparam_info.region_size / sdk_flashchip.sector_size;
 
     debug(1, "compacting region (current size %d, expect to recover %d%s bytes)...",
@@ -433,51 +762,75 @@ static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_
             ctx ? ctx->compactable : 0,
             (ctx && ctx->unused_keys > 0) ? "+ (unused keys present)" : "");
 
+    _sysparam_index.valid = false;
     status = _format_region(new_base, num_sectors);
     if (status < 0) return status;
     status = sysparam_iter_start(&iter);
     if (status < 0) return status;
+    _index_reset();
+
+    for (staged = batch; staged; staged = staged->next) {
+        staged->written = false;
+    }
 
     while (true) {
         status = sysparam_iter_next(&iter);
         if (status != SYSPARAM_OK) break;
 
-        current_key_id++;
+        staged = batch ? _batch_find(iter.key, iter.key_len) : NULL;
+        if (staged) {
+            staged->written = true;
+            if (!staged->value_len) {
+                // Staged deletion, leave the key out entirely
+                continue;
+            }
+        }
 
-        // Write the key to the new region
-        debug(2, "writing %d key @ 0x%08x", current_key_id, addr);
-        status = _write_entry(addr, current_key_id, (uint8_t *)iter.key, iter.key_len);
-        if (status < 0) break;
-        addr += ENTRY_SIZE(iter.key_len);
+        current_key_id++;
 
         if (key_id && (iter.ctx->entry.idflags & ENTRY_MASK_ID) == *key_id) {
             // Update key_id to have the correct id for the compacted result
             *key_id = current_key_id;
             // Don't copy the old value, since we'll just be deleting it
             // and writing a new one as soon as we return.
-            continue;
+            status = _compact_write_pair(&addr, region_end, current_key_id,
+                    iter.key, iter.key_len, NULL, 0, false);
+        } else if (staged) {
+            status = _compact_write_pair(&addr, region_end, current_key_id,
+                    iter.key, iter.key_len, staged->value, staged->value_len,
+                    staged->binary);
+        } else {
+            // Copy the value to the new region
+            status = _compact_write_pair(&addr, region_end, current_key_id,
+                    iter.key, iter.key_len, iter.value, iter.value_len,
+                    iter.binary);
         }
-
-        // Copy the value to the new region
-        debug(2, "writing %d value @ 0x%08x", current_key_id, addr);
-        binary_flag = iter.binary ? ENTRY_FLAG_BINARY : 0;
-        status = _write_entry(addr, current_key_id | ENTRY_FLAG_VALUE | binary_flag, iter.value, iter.value_len);
         if (status < 0) break;
-        addr += ENTRY_SIZE(iter.value_len);
     }
     sysparam_iter_end(&iter);
 
-    // If we broke out with an error, return the error instead of continuing.
-    if (status < 0) {
-        debug(1, "error encountered during compacting (%d)", status);
-        return status;
+    // Staged updates for keys which didn't exist yet
+    for (staged = batch; status >= 0 && staged; staged = staged->next) {
+        if (staged->written || !staged->value_len) continue;
+        if (current_key_id >= MAX_KEY_ID) {
+            debug(1, "out of ids!");
+            status = SYSPARAM_ERR_FULL;
+            break;
+        }
+        current_key_id++;
+        status = _compact_write_pair(&addr, region_end, current_key_id,
+                staged->key, staged->key_len, staged->value, staged->value_len,
+                staged->binary);
     }
 
+    // If we broke out with an error, return the error instead of continuing.
+    if (status < 0) goto fail;
+
     // Switch to officially using the new region.
     status = _write_region_header(new_base, _sysparam_info.cur_base, true);
-    if (status < 0) return status;
+    if (status < 0) goto fail;
     status = _write_region_header(_sysparam_info.cur_base, new_base, false);
-    if (status < 0) return status;
+    if (status < 0) goto fail;
 
     _sysparam_info.alt_base = _sysparam_info.cur_base;
     _sysparam_info.cur_base = new_base;
@@ -494,6 +847,12 @@ static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_
     debug(1, "done compacting (current size %d)", _sysparam_info.end_addr - _sysparam_info.cur_base);
 
     return SYSPARAM_OK;
+
+fail:
+    // The index now describes the new region, which didn't become active
+    _sysparam_index.valid = false;
+    debug(1, "error encountered during compacting (%d)", status);
+    return status;
 }
 
 /***************************** Public Functions ******************************/
@@ -584,7 +943,14 @@ sysparam_status_t sysparam_init(uint32_t base_addr, uint32_t top_addr) {
         _sysparam_info.end_addr = ctx.addr;
     }
 
-    _sysparam_info.sem = xSemaphoreCreateMutex();
+    if (!_sysparam_info.sem) {
+        _sysparam_info.sem = xSemaphoreCreateMutex();
+    }
+
+    if (_sysparam_index.max_keys && !_sysparam_index.entries) {
+        _sysparam_index.entries = malloc(_sysparam_index.max_keys * sizeof(struct index_entry));
+    }
+    _index_rebuild();
 
     return SYSPARAM_OK;
 }
@@ -622,7 +988,10 @@ sysparam_status_t sysparam_create_area(uint32_t base_addr, uint16_t num_sectors,
         // We're reformating the same region we're already using.
         // De-initialize everything to force the caller to do a clean
         // `sysparam_init()` afterwards.
+        SemaphoreHandle_t sem = _sysparam_info.sem;
         memset(&_sysparam_info, 0, sizeof(_sysparam_info));
+        _sysparam_info.sem = sem;
+        _sysparam_index.valid = false;
     }
     status = _format_region(base_addr, num_sectors);
     if (status < 0) return status;
@@ -644,12 +1013,88 @@ sysparam_status_t sysparam_get_info(uint32_t *base_addr, uint32_t *num_sectors)
     return SYSPARAM_OK;
 }
 
+sysparam_status_t sysparam_set_index_size(uint16_t max_keys) {
+    sysparam_status_t status = SYSPARAM_OK;
+
+    if (!_sysparam_info.sem) return SYSPARAM_ERR_NOINIT;
+    xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
+
+    free(_sysparam_index.entries);
+    _sysparam_index.entries = NULL;
+    _sysparam_index.max_keys = max_keys;
+    _sysparam_index.valid = false;
+    _sysparam_index.count = 0;
+
+    if (max_keys) {
+        _sysparam_index.entries = malloc(max_keys * sizeof(struct index_entry));
+        if (!_sysparam_index.entries) {
+            status = SYSPARAM_ERR_NOMEM;
+        } else if (_sysparam_info.cur_base) {
+            status = _index_rebuild();
+        }
+    }
+
+    xSemaphoreGive(_sysparam_info.sem);
+    return status;
+}
+
+sysparam_status_t sysparam_batch_begin() {
+    sysparam_status_t status = SYSPARAM_OK;
+
+    if (!_sysparam_info.sem) return SYSPARAM_ERR_NOINIT;
+    xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
+
+    if (!_sysparam_info.cur_base) {
+        status = SYSPARAM_ERR_NOINIT;
+    } else if (_sysparam_batch.owner) {
+        // Only one batch can be in progress at a time
+        status = SYSPARAM_ERR_BADVALUE;
+    } else {
+        _sysparam_batch.owner = xTaskGetCurrentTaskHandle();
+    }
+
+    xSemaphoreGive(_sysparam_info.sem);
+    return status;
+}
+
+sysparam_status_t sysparam_batch_commit() {
+    sysparam_status_t status = SYSPARAM_OK;
+
+    if (!_sysparam_info.sem) return SYSPARAM_ERR_NOINIT;
+    xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
+
+    if (!_batch_active()) {
+        status = SYSPARAM_ERR_BADVALUE;
+    } else if (!_sysparam_info.cur_base) {
+        status = SYSPARAM_ERR_NOINIT;
+    } else if (_sysparam_batch.entries) {
+        // A compaction writes the complete new set to the alternate region
+        // and only switches over once it's all there.
+        status = _compact_params(NULL, NULL, _sysparam_batch.entries);
+    }
+    _batch_free();
+
+    xSemaphoreGive(_sysparam_info.sem);
+    return status;
+}
+
+void sysparam_batch_abort() {
+    if (!_sysparam_info.sem) return;
+    xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
+
+    if (_batch_active()) {
+        _batch_free();
+    }
+
+    xSemaphoreGive(_sysparam_info.sem);
+}
+
 sysparam_status_t sysparam_compact() {
     xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
     sysparam_status_t status;
 
     if (_sysparam_info.cur_base) {
-        status = _compact_params(NULL, NULL);
+        status = _compact_params(NULL, NULL, NULL);
     } else {
         status = SYSPARAM_ERR_NOINIT;
     }
@@ -663,6 +1108,7 @@ sysparam_status_t sysparam_get_data(const char *key, uint8_t **destptr, size_t *
     sysparam_status_t status;
     size_t key_len = strlen(key);
     uint8_t *buffer;
+    struct batch_entry *staged;
 
     xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
 
@@ -673,12 +1119,26 @@ sysparam_status_t sysparam_get_data(const char *key, uint8_t **destptr, size_t *
         goto done;
     }
 
-    _init_context(&ctx);
-    status = _find_key(&ctx, key, key_len);
-    if (status != SYSPARAM_OK) goto done;
+    if (_batch_active() && (staged = _batch_find(key, key_len))) {
+        if (!staged->value_len) {
+            status = SYSPARAM_NOTFOUND;
+            goto done;
+        }
+        buffer = malloc(staged->value_len + 1);
+        if (!buffer) {
+            status = SYSPARAM_ERR_NOMEM;
+            goto done;
+        }
+        memcpy(buffer, staged->value, staged->value_len);
+        buffer[staged->value_len] = 0;
+
+        *destptr = buffer;
+        if (actual_length) *actual_length = staged->value_len;
+        if (is_binary) *is_binary = staged->binary;
+        goto done;
+    }
 
-    // Find the associated value
-    status = _find_value(&ctx, ctx.entry.idflags);
+    status = _find_key_value(&ctx, key, key_len);
     if (status != SYSPARAM_OK) goto done;
 
     buffer = malloc(ctx.entry.len + 1);
@@ -712,6 +1172,7 @@ sysparam_status_t sysparam_get_data_static(const char *key, uint8_t *dest, size_
     struct sysparam_context ctx;
     sysparam_status_t status = SYSPARAM_OK;
     size_t key_len = strlen(key);
+    struct batch_entry *staged;
 
     xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
 
@@ -722,10 +1183,18 @@ sysparam_status_t sysparam_get_data_static(const char *key, uint8_t *dest, size_
         goto done;
     }
 
-    _init_context(&ctx);
-    status = _find_key(&ctx, key, key_len);
-    if (status != SYSPARAM_OK) goto done;
-    status = _find_value(&ctx, ctx.entry.idflags);
+    if (_batch_active() && (staged = _batch_find(key, key_len))) {
+        if (!staged->value_len) {
+            status = SYSPARAM_NOTFOUND;
+            goto done;
+        }
+        memcpy(dest, staged->value, min(dest_size, staged->value_len));
+        if (actual_length) *actual_length = staged->value_len;
+        if (is_binary) *is_binary = staged->binary;
+        goto done;
+    }
+
+    status = _find_key_value(&ctx, key, key_len);
     if (status != SYSPARAM_OK) goto done;
     status = _read_payload(&ctx, dest, dest_size);
     if (status != SYSPARAM_OK) goto done;
@@ -859,6 +1328,13 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
         goto done;
     }
 
+    if (_batch_active()) {
+        // Nothing is written until sysparam_batch_commit()
+        status = _batch_stage(key, key_len, value, value_len, is_binary);
+        xSemaphoreGive(_sysparam_info.sem);
+        return status;
+    }
+
     do {
         _init_context(&ctx);
         status = _find_key(&ctx, key, key_len);
@@ -912,7 +1388,7 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 _find_entry(&ctx, ENTRY_ID_END, false);
                 if (needed_space <= free_space + ctx.compactable) {
                     // We should be able to get enough space by compacting.
-                    status = _compact_params(&ctx, &key_id);
+                    status = _compact_params(&ctx, &key_id, NULL);
                     if (status < 0) break;
                     old_value_addr = 0;
                 } else if (ctx.unused_keys > 0) {
@@ -920,7 +1396,7 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                     // there are some keys that can be omitted too, but we
                     // don't know exactly how much that will gain, so all we
                     // can do is give it a try and see if it gives us enough.
-                    status = _compact_params(&ctx, &key_id);
+                    status = _compact_params(&ctx, &key_id, NULL);
                     if (status < 0) break;
                     old_value_addr = 0;
                 }
@@ -943,7 +1419,7 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 // region.
                 if (ctx.max_key_id >= MAX_KEY_ID) {
                     if (ctx.unused_keys > 0) {
-                        status = _compact_params(&ctx, &key_id);
+                        status = _compact_params(&ctx, &key_id, NULL);
                         if (status < 0) break;
                         old_value_addr = 0;
                     } else {
@@ -958,7 +1434,7 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 // We didn't need to compact above, but due to previously
                 // detected inconsistencies, we should compact anyway before
                 // writing anything new, so do that.
-                status = _compact_params(&ctx, &key_id);
+                status = _compact_params(&ctx, &key_id, NULL);
                 if (status < 0) break;
             }
 
@@ -969,12 +1445,17 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 key_id = ctx.max_key_id + 1;
                 status = _write_entry(write_ctx.addr, key_id, (uint8_t *)key, key_len);
                 if (status < 0) break;
+                _index_add(_index_hash(FNV_OFFSET_BASIS, (uint8_t *)key, key_len),
+                        key_id, write_ctx.addr, key_len);
                 write_ctx.addr += ENTRY_SIZE(key_len);
             }
 
             // Write new value
             status = _write_entry(write_ctx.addr, key_id | ENTRY_FLAG_VALUE | binary_flag, value, value_len);
             if (status < 0) break;
+            _index_set_value(key_id, write_ctx.addr,
+                    key_id | ENTRY_FLAG_ALIVE | ENTRY_FLAG_VALUE | binary_flag,
+                    value_len);
             write_ctx.addr += ENTRY_SIZE(value_len);
             _sysparam_info.end_addr = write_ctx.addr;
         }
@@ -983,12 +1464,20 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
         if (old_value_addr) {
             status = _delete_entry(old_value_addr);
             if (status < 0) break;
+            if (!value_len) {
+                _index_set_value(key_id, 0, 0, 0);
+            }
         }
 
         debug(1, "New addr is 0x%08x (%d bytes remaining)", _sysparam_info.end_addr, _sysparam_info.cur_base + _sysparam_info.region_size - _sysparam_info.end_addr);
     } while (false);
 
  done:
+    if (status < 0) {
+        // We can't be sure what made it to the flash, don't trust the index
+        // until it's rebuilt.
+        _sysparam_index.valid = false;
+    }
     xSemaphoreGive(_sysparam_info.sem);
 
     return status;
@@ -26,6 +26,7 @@ static void bmp280_task_forced(void *pvParameters)
     params.mode = BMP280_MODE_FORCED;
 
     bmp280_t bmp280_dev;
+    bmp280_dev.i2c_bus = 0;
     bmp280_dev.i2c_addr = BMP280_I2C_ADDRESS_0;
 
     while (1) {
@@ -67,6 +68,7 @@ static void bmp280_task_normal(void *pvParameters)
     bmp280_init_default_params(&params);
 
     bmp280_t bmp280_dev;
+    bmp280_dev.i2c_bus = 0;
     bmp280_dev.i2c_addr = BMP280_I2C_ADDRESS_0;
 
     while (1) {
@@ -39,6 +39,9 @@
 
 #define DEFAULT_FONT FONT_FACE_TERMINUS_6X12_ISO8859_1
 
+/* Changed part of the frame buffer, only that is sent to the display */
+static ssd1306_dirty_t dirty;
+
 /* Declare device descriptor */
 static const ssd1306_t dev = {
     .protocol = PROTOCOL,
@@ -49,7 +52,8 @@ static const ssd1306_t dev = {
     .dc_pin   = DC_PIN,
 #endif
     .width    = DISPLAY_WIDTH,
-    .height   = DISPLAY_HEIGHT
+    .height   = DISPLAY_HEIGHT,
+    .dirty    = &dirty
 };
 
 /* Local frame buffer */
@@ -72,6 +76,7 @@ static void ssd1306_task(void *pvParameters)
     vTaskDelay(SECOND);
 
     ssd1306_set_whole_display_lighting(&dev, false);
+    ssd1306_load_frame_buffer(&dev, buffer); // following flushes send changes only
 
     char text[20];
     uint8_t x0 = LOAD_ICON_X;
@@ -120,7 +125,7 @@ static void ssd1306_task(void *pvParameters)
                 ssd1306_draw_circle(&dev,buffer, CIRCLE_COUNT_ICON_X, CIRCLE_COUNT_ICON_Y, i, OLED_COLOR_WHITE);
         }
 
-        if (ssd1306_load_frame_buffer(&dev, buffer))
+        if (ssd1306_flush(&dev, buffer) < 0)
             goto error_loop;
 
         frame_done++;
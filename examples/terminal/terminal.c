@@ -15,6 +15,9 @@
 #include <stdio.h>
 #include "FreeRTOS.h"
 #include "task.h"
+#include "lwip/netif.h"
+#include "lwip/sys.h"
+#include "esp_interface.h"
 
 #define MAX_ARGC (10)
 
@@ -51,11 +54,54 @@ static void cmd_help(uint32_t argc, char *argv[])
     printf("on <gpio number> [ <gpio number>]+     Set gpio to 1\n");
     printf("off <gpio number> [ <gpio number>]+    Set gpio to 0\n");
     printf("sleep                                  Take a nap\n");
+    printf("netstats [reset]                       Show (or reset) network statistics\n");
     printf("\nExample:\n");
     printf("  on 0<enter> switches on gpio 0\n");
     printf("  on 0 2 4<enter> switches on gpios 0, 2 and 4\n");
 }
 
+static void cmd_netstats(uint32_t argc, char *argv[])
+{
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        esp_interface_reset_stats();
+        sys_arch_reset_stats();
+        printf("Statistics reset\n");
+        return;
+    }
+
+    for (struct netif *netif = netif_list; netif; netif = netif->next) {
+        esp_interface_stats_t stats;
+        if (!esp_interface_get_stats(netif, &stats)) {
+            continue;
+        }
+        printf("%c%c%d:\n", netif->name[0], netif->name[1], netif->num);
+        printf("  rx %u packets %u bytes, %u dropped, %u ignored\n",
+               stats.rx_packets, stats.rx_bytes, stats.rx_drops, stats.rx_ignored);
+        printf("  tx %u packets %u bytes, %u dropped (%u passed through, %u coalesced)\n",
+               stats.tx_packets, stats.tx_bytes, stats.tx_drops,
+               stats.tx_passthrough, stats.tx_coalesced);
+    }
+
+    sys_arch_stats_t sys_stats;
+    sys_arch_get_stats(&sys_stats);
+    printf("mbox high water %u (tcpip_thread %u), post blocked %u, trypost full %u\n",
+           sys_stats.mbox_high_water, sys_stats.tcpip_mbox_high_water,
+           sys_stats.mbox_post_blocked, sys_stats.mbox_trypost_full);
+    printf("tcpip_thread queueing delay:\n");
+    for (int i = 0; i < SYS_ARCH_DELAY_BUCKETS; i++) {
+        if (!sys_stats.tcpip_delay_us[i]) {
+            continue;
+        }
+        if (i == 0) {
+            printf("  < 1us     %u\n", sys_stats.tcpip_delay_us[i]);
+        } else if (i == SYS_ARCH_DELAY_BUCKETS - 1) {
+            printf("  >= %uus  %u\n", 1 << (i - 1), sys_stats.tcpip_delay_us[i]);
+        } else {
+            printf("  < %uus  %u\n", 1 << i, sys_stats.tcpip_delay_us[i]);
+        }
+    }
+}
+
 static void cmd_sleep(uint32_t argc, char *argv[])
 {
     printf("Type away while I take a 2 second nap (ie. let you test the UART HW FIFO\n");
@@ -83,6 +129,7 @@ static void handle_command(char *cmd)
         else if (strcmp(argv[0], "on") == 0) cmd_on(argc, argv);
         else if (strcmp(argv[0], "off") == 0) cmd_off(argc, argv);
         else if (strcmp(argv[0], "sleep") == 0) cmd_sleep(argc, argv);
+        else if (strcmp(argv[0], "netstats") == 0) cmd_netstats(argc, argv);
         else printf("Unknown command %s, try 'help'\n", argv[0]);
     }
 }
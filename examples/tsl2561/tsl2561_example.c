@@ -27,6 +27,7 @@ void tsl2561MeasurementTask(void *pvParameters)
     // TSL2561_I2C_ADDR_VCC   (0x49)
     // TSL2561_I2C_ADDR_GND   (0x29)
     // TSL2561_I2C_ADDR_FLOAT (0x39) Default
+    lightSensor.i2c_bus = 0;
     lightSensor.i2c_addr = TSL2561_I2C_ADDR_FLOAT;
 
     tsl2561_init(&lightSensor);
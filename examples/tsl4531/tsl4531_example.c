@@ -22,6 +22,7 @@
 void tsl4531MeasurementTask(void *pvParameters)
 {
     tsl4531_t lightSensor;
+    lightSensor.i2c_bus = 0;
     lightSensor.i2c_addr = TSL4531_I2C_ADDR;
     tsl4531_init(&lightSensor);
 
@@ -0,0 +1,116 @@
+/**
+ * Benchmark of the ws2812_i2s pixel encoder.
+ *
+ * Measures the CPU cycles ws2812_i2s_submit takes to encode a frame of
+ * 1000 pixels for RGB, RGB with per-channel lookup tables and RGBW strips.
+ * The output on GPIO3 is not meant to drive a real strip.
+ *
+ * This sample code is in the public domain.
+ */
+#include "espressif/esp_common.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "esp/uart.h"
+#include "xtensa_ops.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ws2812_i2s/ws2812_i2s.h"
+
+#define PIXELS_NUMBER 1000
+#define ROUNDS 10
+
+static uint8_t lut[256];
+
+static inline uint32_t get_ccount(void)
+{
+    uint32_t ccount;
+    RSR(ccount, ccount);
+    return ccount;
+}
+
+static void report(const char *name, uint32_t cycles)
+{
+    printf("%-12s %7u cycles per %d pixels, %u us\n", name, cycles,
+            PIXELS_NUMBER, cycles / sdk_system_get_cpu_freq());
+}
+
+static uint32_t bench_rgb(ws2812_pixel_t *pixels)
+{
+    uint32_t best = UINT32_MAX;
+    for (int i = 0; i < ROUNDS; i++) {
+        while (ws2812_i2s_busy()) {};
+        uint32_t start = get_ccount();
+        ws2812_i2s_submit(pixels);
+        uint32_t cycles = get_ccount() - start;
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+    return best;
+}
+
+static uint32_t bench_rgbw(ws2812_pixel_rgbw_t *pixels)
+{
+    uint32_t best = UINT32_MAX;
+    for (int i = 0; i < ROUNDS; i++) {
+        while (ws2812_i2s_busy()) {};
+        uint32_t start = get_ccount();
+        ws2812_i2s_submit_rgbw(pixels);
+        uint32_t cycles = get_ccount() - start;
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+    return best;
+}
+
+static void bench_task(void *pvParameters)
+{
+    ws2812_pixel_t *pixels = malloc(PIXELS_NUMBER * sizeof(ws2812_pixel_t));
+    ws2812_pixel_rgbw_t *pixels_rgbw =
+        malloc(PIXELS_NUMBER * sizeof(ws2812_pixel_rgbw_t));
+
+    for (int i = 0; i < PIXELS_NUMBER; i++) {
+        pixels[i].red = rand();
+        pixels[i].green = rand();
+        pixels[i].blue = rand();
+        pixels_rgbw[i].red = pixels[i].red;
+        pixels_rgbw[i].green = pixels[i].green;
+        pixels_rgbw[i].blue = pixels[i].blue;
+        pixels_rgbw[i].white = rand();
+    }
+    for (int i = 0; i < 256; i++) {
+        lut[i] = (i * i) >> 9;  // gamma 2, half brightness
+    }
+
+    ws2812_i2s_config_t config = {
+        .buffers_number = 1,
+        .colour_order = WS2812_ORDER_GRB,
+        .rgbw = false,
+    };
+
+    while (1) {
+        config.rgbw = false;
+        ws2812_i2s_init_config(PIXELS_NUMBER, &config);
+        report("RGB", bench_rgb(pixels));
+
+        ws2812_i2s_set_lut(WS2812_CHANNEL_RED, lut);
+        ws2812_i2s_set_lut(WS2812_CHANNEL_GREEN, lut);
+        ws2812_i2s_set_lut(WS2812_CHANNEL_BLUE, lut);
+        report("RGB + LUT", bench_rgb(pixels));
+
+        config.rgbw = true;
+        ws2812_i2s_init_config(PIXELS_NUMBER, &config);
+        report("RGBW", bench_rgbw(pixels_rgbw));
+
+        vTaskDelay(5000 / portTICK_PERIOD_MS);
+    }
+}
+
+void user_init(void)
+{
+    uart_set_baud(0, 115200);
+
+    xTaskCreate(&bench_task, "ws2812_bench", 512, NULL, 2, NULL);
+}
@@ -77,18 +77,23 @@ static const spi_settings_t config = {
     .freq_divider = SPI_FREQ_DIV_500K
 };
 
+inline static void spi_device(uint8_t cs_pin, spi_device_t *spi)
+{
+    spi->bus = BUS;
+    spi->cs_pin = cs_pin;
+    spi->settings = config;
+}
+
 static uint8_t write(uint8_t cs_pin, uint8_t value)
 {
-    spi_settings_t old;
-    spi_get_settings(BUS, &old);
-    spi_set_settings(BUS, &config);
+    spi_device_t spi;
+    spi_device(cs_pin, &spi);
 
-    gpio_write(cs_pin, false);
+    spi_device_select(&spi);
     uint8_t res = spi_transfer_8(BUS, value);
     //debug("byte wr: 0x%02x", value);
-    gpio_write(cs_pin, true);
+    spi_device_deselect(&spi);
 
-    spi_set_settings(BUS, &old);
     return res;
 }
 
@@ -99,15 +104,13 @@ inline static uint8_t read_byte(uint8_t cs_pin)
 
 static uint16_t read_word(uint8_t cs_pin)
 {
-    spi_settings_t old;
-    spi_get_settings(BUS, &old);
-    spi_set_settings(BUS, &config);
+    spi_device_t spi;
+    spi_device(cs_pin, &spi);
 
-    gpio_write(cs_pin, false);
+    spi_device_select(&spi);
     uint16_t res = spi_transfer_16(BUS, 0);
-    gpio_write(cs_pin, true);
+    spi_device_deselect(&spi);
 
-    spi_set_settings(BUS, &old);
     return res;
 }
 
@@ -123,7 +126,9 @@ static void prepare(uint8_t channel, uint8_t reg, bool read, uint8_t cs_pin, boo
 
 int ad770x_init(const ad770x_params_t *params, uint8_t channel)
 {
-    if (!spi_set_settings(BUS, &config))
+    spi_device_t spi;
+    spi_device(params->cs_pin, &spi);
+    if (!spi_device_init(&spi))
     {
         debug("Cannot init SPI");
         return -EIO;
@@ -136,9 +141,6 @@ int ad770x_init(const ad770x_params_t *params, uint8_t channel)
         return -EINVAL;
     }
 
-    gpio_enable(params->cs_pin, GPIO_OUTPUT);
-    gpio_write(params->cs_pin, true);
-
     prepare(channel, REG_CLOCK, false, params->cs_pin, false);
     write(params->cs_pin,
         ((params->master_clock << BIT_CLOCK_CLK) & MASK_CLOCK_CLK) |
@@ -127,6 +127,7 @@ typedef struct {
     int16_t  dig_H5;
     int8_t   dig_H6;
 
+    uint8_t  i2c_bus;   /* I2C bus number. */
     uint8_t  i2c_addr;  /* I2C address. */
     uint8_t  id;        /* Chip ID */
 } bmp280_t;
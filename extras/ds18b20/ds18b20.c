@@ -1,6 +1,7 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "math.h"
+#include "string.h"
 
 #include "ds18b20.h"
 
@@ -120,21 +121,36 @@ float ds18b20_read_single(uint8_t pin) {
     //debug("Got a DS18B20 Reading: %d.%02d\n", (int)temperature, (int)(temperature - (int)temperature) * 100);
 }
 
-bool ds18b20_measure(int pin, ds18b20_addr_t addr, bool wait) {
-    if (!onewire_reset(pin)) {
-        return false;
-    }
+// Put the ROM select (or skip) part of a command in `cmd`, returns its length
+static size_t ds18b20_address(ds18b20_addr_t addr, uint8_t *cmd) {
     if (addr == DS18B20_ANY) {
-        onewire_skip_rom(pin);
-    } else {
-        onewire_select(pin, addr);
+        cmd[0] = DS18B20_SKIP_ROM;
+        return 1;
     }
-    taskENTER_CRITICAL();
-    onewire_write(pin, DS18B20_CONVERT_T);
+    cmd[0] = DS18B20_MATCHROM;
+    for (int i = 1; i < 9; i++) {
+        cmd[i] = addr & 0xff;
+        addr >>= 8;
+    }
+    return 9;
+}
+
+// Reset the bus, send a command to a device and read its answer as one
+// 1-Wire transfer. The task sleeps while the transfer is in progress.
+static bool ds18b20_command(int pin, ds18b20_addr_t addr, uint8_t command, uint8_t *in, size_t in_count, uint8_t flags) {
+    uint8_t cmd[10];
+    size_t len = ds18b20_address(addr, cmd);
+
+    cmd[len++] = command;
+    return onewire_transfer(pin, cmd, len, in, in_count, ONEWIRE_TRANSFER_RESET | flags);
+}
+
+bool ds18b20_measure(int pin, ds18b20_addr_t addr, bool wait) {
     // For parasitic devices, power must be applied within 10us after issuing
     // the convert command.
-    onewire_power(pin);
-    taskEXIT_CRITICAL();
+    if (!ds18b20_command(pin, addr, DS18B20_CONVERT_T, NULL, 0, ONEWIRE_TRANSFER_POWER)) {
+        return false;
+    }
 
     if (wait) {
         os_sleep_ms(750);
@@ -145,23 +161,15 @@ bool ds18b20_measure(int pin, ds18b20_addr_t addr, bool wait) {
 }
 
 bool ds18b20_read_scratchpad(int pin, ds18b20_addr_t addr, uint8_t *buffer) {
+    uint8_t data[9];
     uint8_t crc;
     uint8_t expected_crc;
 
-    if (!onewire_reset(pin)) {
+    if (!ds18b20_command(pin, addr, DS18B20_READ_SCRATCHPAD, data, sizeof(data), 0)) {
         return false;
     }
-    if (addr == DS18B20_ANY) {
-        onewire_skip_rom(pin);
-    } else {
-        onewire_select(pin, addr);
-    }
-    onewire_write(pin, DS18B20_READ_SCRATCHPAD);
-
-    for (int i = 0; i < 8; i++) {
-        buffer[i] = onewire_read(pin);
-    }
-    crc = onewire_read(pin);
+    memcpy(buffer, data, 8);
+    crc = data[8];
 
     expected_crc = onewire_crc8(buffer, 8);
     if (crc != expected_crc) {
@@ -172,15 +180,9 @@ bool ds18b20_read_scratchpad(int pin, ds18b20_addr_t addr, uint8_t *buffer) {
     return true;
 }
 
-float ds18b20_read_temperature(int pin, ds18b20_addr_t addr) {
-    uint8_t scratchpad[8];
-    int16_t temp;
-
-    if (!ds18b20_read_scratchpad(pin, addr, scratchpad)) {
-        return NAN;
-    }
-
-    temp = scratchpad[1] << 8 | scratchpad[0];
+// Temperature in degrees Celsius from the first 8 scratchpad bytes
+static float ds18b20_decode(ds18b20_addr_t addr, const uint8_t *scratchpad) {
+    int16_t temp = scratchpad[1] << 8 | scratchpad[0];
 
     float res;
     if ((uint8_t)addr == DS18B20_FAMILY_ID) {
@@ -193,6 +195,15 @@ float ds18b20_read_temperature(int pin, ds18b20_addr_t addr) {
     return res;
 }
 
+float ds18b20_read_temperature(int pin, ds18b20_addr_t addr) {
+    uint8_t scratchpad[8];
+
+    if (!ds18b20_read_scratchpad(pin, addr, scratchpad)) {
+        return NAN;
+    }
+    return ds18b20_decode(addr, scratchpad);
+}
+
 float ds18b20_measure_and_read(int pin, ds18b20_addr_t addr) {
     if (!ds18b20_measure(pin, addr, true)) {
         return NAN;
@@ -240,4 +251,138 @@ bool ds18b20_read_temp_multi(int pin, ds18b20_addr_t *addr_list, int addr_count,
     return result;
 }
 
+// Each GPIO can carry its own bus
+#define DS18B20_MAX_BUSES 17
+
+typedef struct {
+    int pin;
+    uint8_t resolution;   // highest resolution of the sensors on the bus
+    bool measuring;       // conversion started, not read yet
+    int next;             // next sensor to read, index into the sensor list
+    TickType_t ready;     // tick count when the conversion has finished
+} ds18b20_bus_t;
+
+static uint8_t ds18b20_resolution(const ds18b20_sensor_t *sensor) {
+    // DS18S20 always converts with the 12 bit timing
+    if ((uint8_t)sensor->addr != DS18B20_FAMILY_ID || sensor->resolution < 9 || sensor->resolution > 12) {
+        return 12;
+    }
+    return sensor->resolution;
+}
+
+// Conversion time in ticks, 93.75ms for 9 bits doubling up to 750ms for 12
+static TickType_t ds18b20_conversion_ticks(uint8_t resolution) {
+    uint32_t ms = (750 >> (12 - resolution)) + 1;
+    return (ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS + 1;
+}
+
+// Read one sensor and update its result and statistics
+static bool ds18b20_read_sensor(ds18b20_sensor_t *sensor) {
+    uint8_t data[9];
+
+    sensor->timestamp = xTaskGetTickCount();
+    sensor->value = NAN;
+    if (!ds18b20_command(sensor->pin, sensor->addr, DS18B20_READ_SCRATCHPAD, data, sizeof(data), 0)) {
+        sensor->errors++;
+        return false;
+    }
+    if (onewire_crc8(data, 8) != data[8]) {
+        debug("CRC check failed reading scratchpad of %08x%08x", (uint32_t)(sensor->addr >> 32), (uint32_t)sensor->addr);
+        sensor->crc_errors++;
+        return false;
+    }
+    if ((uint8_t)sensor->addr == DS18B20_FAMILY_ID) {
+        // Configuration register, R1 R0 in bits 6 and 5
+        sensor->resolution = 9 + ((data[4] >> 5) & 3);
+    }
+    sensor->value = ds18b20_decode(sensor->addr, data);
+    return true;
+}
+
+int ds18b20_measure_and_read_sensors(ds18b20_sensor_t *sensors, int count) {
+    ds18b20_bus_t buses[DS18B20_MAX_BUSES];
+    int bus_count = 0;
+    int found = 0;
 
+    // Group the sensors by bus
+    for (int i = 0; i < count; i++) {
+        int b;
+        for (b = 0; b < bus_count && buses[b].pin != sensors[i].pin; b++);
+        if (b == bus_count) {
+            if (bus_count == DS18B20_MAX_BUSES) {
+                return -1;
+            }
+            buses[b].pin = sensors[i].pin;
+            buses[b].resolution = 9;
+            buses[b].next = i;
+            bus_count++;
+        }
+        if (ds18b20_resolution(&sensors[i]) > buses[b].resolution) {
+            buses[b].resolution = ds18b20_resolution(&sensors[i]);
+        }
+    }
+
+    // Start the conversion on every bus at once
+    TickType_t start = xTaskGetTickCount();
+    for (int b = 0; b < bus_count; b++) {
+        buses[b].measuring = ds18b20_measure(buses[b].pin, DS18B20_ANY, false);
+        buses[b].ready = start + ds18b20_conversion_ticks(buses[b].resolution);
+        if (!buses[b].measuring) {
+            for (int i = buses[b].next; i < count; i++) {
+                if (sensors[i].pin == buses[b].pin) {
+                    sensors[i].timestamp = start;
+                    sensors[i].value = NAN;
+                    sensors[i].errors++;
+                }
+            }
+        }
+    }
+
+    for (;;) {
+        // Sleep until the next bus has finished converting
+        bool pending = false;
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = portMAX_DELAY;
+        for (int b = 0; b < bus_count; b++) {
+            if (buses[b].measuring) {
+                TickType_t left = (int32_t)(buses[b].ready - now) > 0 ? buses[b].ready - now : 0;
+                if (left < wait) {
+                    wait = left;
+                }
+                pending = true;
+            }
+        }
+        if (!pending) {
+            break;
+        }
+        if (wait) {
+            vTaskDelay(wait);
+        }
+
+        // Read the buses that are ready, one sensor of each bus in turn
+        now = xTaskGetTickCount();
+        bool reading = true;
+        while (reading) {
+            reading = false;
+            for (int b = 0; b < bus_count; b++) {
+                if (!buses[b].measuring || (int32_t)(buses[b].ready - now) > 0) {
+                    continue;
+                }
+                int i = buses[b].next;
+                while (i < count && sensors[i].pin != buses[b].pin) {
+                    i++;
+                }
+                if (i == count) {
+                    buses[b].measuring = false;
+                    continue;
+                }
+                if (ds18b20_read_sensor(&sensors[i])) {
+                    found++;
+                }
+                buses[b].next = i + 1;
+                reading = true;
+            }
+        }
+    }
+    return found;
+}
@@ -82,6 +82,11 @@ float ds18b20_read_temperature(int pin, ds18b20_addr_t addr);
  *  This should be called after ds18b20_measure() to fetch the result of the
  *  temperature measurement.
  *
+ *  Each device is read with a single 1-Wire transfer during which the calling
+ *  task sleeps.  With the onewire timer backend (::ONEWIRE_HW_TIMER) the bits
+ *  are moved by the timer interrupt, so reading a whole bus leaves the CPU
+ *  free for other tasks.
+ *
  *  @param pin         The GPIO pin connected to the DS18B20 bus
  *  @param addr_list   A list of addresses for devices to read.
  *  @param addr_count  The number of entries in `addr_list`.
@@ -136,6 +141,42 @@ bool ds18b20_measure_and_read_multi(int pin, ds18b20_addr_t *addr_list, int addr
  */
 bool ds18b20_read_scratchpad(int pin, ds18b20_addr_t addr, uint8_t *buffer);
 
+/** A sensor taking part in ds18b20_measure_and_read_sensors().
+ *
+ *  Set `pin` and `addr` (and `resolution` if known) and zero the other fields
+ *  before the first call.  The error counters accumulate over calls.
+ */
+typedef struct {
+    int pin;                ///< GPIO pin of the bus the sensor is connected to
+    ds18b20_addr_t addr;    ///< 64-bit address of the sensor
+    uint8_t resolution;     ///< Conversion resolution in bits (9-12), 0 if not known yet
+    float value;            ///< Last temperature in degrees Celsius, NaN on error
+    TickType_t timestamp;   ///< Tick count when `value` was read
+    uint16_t crc_errors;    ///< Number of reads which failed the CRC check
+    uint16_t errors;        ///< Number of reads which failed otherwise
+} ds18b20_sensor_t;
+
+/** Measure and read the temperature of many sensors on one or more buses.
+ *
+ *  A conversion is started on all buses at once, then the calling task sleeps
+ *  until the first bus has finished converting.  The conversion time of a bus
+ *  depends on the highest resolution of its sensors, a bus of 9 bit sensors is
+ *  ready after about 94ms instead of 750ms.  Sensors with a `resolution` of 0
+ *  are assumed to use 12 bits until the resolution has been read from their
+ *  scratchpad.  Ready buses are read interleaved, one sensor of each bus in
+ *  turn.
+ *
+ *  Sensors on the same bus must be connected to the same pin, parasitic power
+ *  is supported.
+ *
+ *  @param sensors  List of sensors, the results are stored in its entries.
+ *  @param count    Number of entries in `sensors`.
+ *
+ *  @returns The number of sensors which were read successfully, or -1 if the
+ *           sensors use more distinct pins than there are GPIOs.
+ */
+int ds18b20_measure_and_read_sensors(ds18b20_sensor_t *sensors, int count);
+
 // The following are obsolete/deprecated APIs
 
 typedef struct {
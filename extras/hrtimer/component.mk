@@ -0,0 +1,9 @@
+# Component makefile for extras/hrtimer
+
+# expected anyone using this driver includes it as 'hrtimer/hrtimer.h'
+INC_DIRS += $(hrtimer_ROOT)..
+
+# args for passing into compile rule generation
+hrtimer_SRC_DIR = $(hrtimer_ROOT)
+
+$(eval $(call component_compile_rules,hrtimer))
@@ -0,0 +1,277 @@
+/**
+ * High resolution software timers on FRC2.
+ *
+ * Part of esp-open-rtos
+ * BSD Licensed as described in the file LICENSE
+ */
+#include "hrtimer.h"
+
+#include <task.h>
+#include <queue.h>
+#include <esp/timer.h>
+#include <esplibs/libmain.h>
+
+// FRC2 runs at 80MHz / 16 as set up by the SDK timer code
+#define HRTIMER_TICKS(us) ((us) * 5)
+
+// The alarm is never set closer than this to the current count, the
+// interrupt could be missed otherwise
+#define HRTIMER_MIN_TICKS HRTIMER_TICKS(4)
+
+#define HRTIMER_IDLE 0xffff
+
+static hrtimer_t *heap[HRTIMER_MAX_ARMED];
+static uint16_t heap_size;
+
+// Last value we wrote to the FRC2 alarm, any other value was written by the
+// SDK timer code.
+static uint32_t alarm;
+static uint32_t sdk_alarm;
+static bool sdk_pending;
+
+static QueueHandle_t queue;
+
+static inline bool IRAM before(const hrtimer_t *a, const hrtimer_t *b)
+{
+    return (int32_t)(a->expires - b->expires) < 0;
+}
+
+static inline void IRAM heap_set(uint16_t i, hrtimer_t *timer)
+{
+    heap[i] = timer;
+    timer->index = i;
+}
+
+static void IRAM sift_up(uint16_t i)
+{
+    hrtimer_t *timer = heap[i];
+
+    while (i > 0) {
+        uint16_t parent = (i - 1) / 2;
+        if (!before(timer, heap[parent])) {
+            break;
+        }
+        heap_set(i, heap[parent]);
+        i = parent;
+    }
+    heap_set(i, timer);
+}
+
+static void IRAM sift_down(uint16_t i)
+{
+    hrtimer_t *timer = heap[i];
+
+    for (;;) {
+        uint16_t child = 2 * i + 1;
+        if (child >= heap_size) {
+            break;
+        }
+        if (child + 1 < heap_size && before(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!before(heap[child], timer)) {
+            break;
+        }
+        heap_set(i, heap[child]);
+        i = child;
+    }
+    heap_set(i, timer);
+}
+
+static void IRAM heap_remove(hrtimer_t *timer)
+{
+    uint16_t i = timer->index;
+    hrtimer_t *last = heap[--heap_size];
+
+    timer->index = HRTIMER_IDLE;
+    if (last != timer) {
+        heap_set(i, last);
+        sift_down(i);
+        sift_up(last->index);
+    }
+}
+
+static void IRAM heap_insert(hrtimer_t *timer)
+{
+    heap_set(heap_size++, timer);
+    sift_up(timer->index);
+}
+
+// Program the alarm for the first of our timers and the SDK timers.
+// Called with interrupts disabled.
+static void IRAM program_alarm(void)
+{
+    if (TIMER(FRC2).ALARM != alarm) {
+        // Written by sdk_ets_timer_arm() meanwhile
+        sdk_alarm = TIMER(FRC2).ALARM;
+        sdk_pending = true;
+    }
+
+    bool set = false;
+    uint32_t next = 0;
+    if (heap_size) {
+        next = heap[0]->expires;
+        set = true;
+    }
+    if (sdk_pending && (!set || (int32_t)(sdk_alarm - next) < 0)) {
+        next = sdk_alarm;
+        set = true;
+    }
+    if (!set) {
+        return;
+    }
+
+    uint32_t now = TIMER(FRC2).COUNT;
+    if ((int32_t)(next - now) < HRTIMER_MIN_TICKS) {
+        next = now + HRTIMER_MIN_TICKS;
+    }
+    alarm = next;
+    TIMER(FRC2).ALARM = next;
+}
+
+static void IRAM hrtimer_isr(void)
+{
+    BaseType_t task_woken = pdFALSE;
+
+    if (TIMER(FRC2).ALARM != alarm) {
+        sdk_alarm = TIMER(FRC2).ALARM;
+        sdk_pending = true;
+    }
+    if (sdk_pending && (int32_t)(sdk_alarm - TIMER(FRC2).COUNT) <= 0) {
+        // Park the alarm far away, the SDK handler sets it again if it
+        // has more timers
+        sdk_pending = false;
+        alarm = TIMER(FRC2).COUNT + 0x7fffffff;
+        TIMER(FRC2).ALARM = alarm;
+        sdk_ets_timer_handler_isr();
+    }
+
+    // Run each armed timer at most once per interrupt, so callbacks slower
+    // than the periods can't keep us here forever.  Whatever is left over
+    // runs from the next interrupt.
+    for (int budget = HRTIMER_MAX_ARMED; budget > 0; budget--) {
+        uint32_t now = TIMER(FRC2).COUNT;
+        if (!heap_size || (int32_t)(heap[0]->expires - now) > 0) {
+            break;
+        }
+        hrtimer_t *timer = heap[0];
+
+        heap_remove(timer);
+        if (timer->period) {
+            timer->expires += timer->period;
+            if ((int32_t)(timer->expires - now) <= 0) {
+                // Fell behind by a whole period, skip the missed expiries
+                timer->expires = now + timer->period;
+            }
+            heap_insert(timer);
+        }
+        if (timer->dispatch == HRTIMER_ISR) {
+            timer->cb(timer->arg);
+        } else if (!timer->queued) {
+            timer->queued = 1;
+            if (xQueueSendFromISR(queue, &timer, &task_woken) != pdTRUE) {
+                timer->queued = 0;
+            }
+        }
+    }
+
+    program_alarm();
+    portEND_SWITCHING_ISR(task_woken);
+}
+
+static void hrtimer_task(void *params)
+{
+    hrtimer_t *timer;
+
+    for (;;) {
+        if (xQueueReceive(queue, &timer, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        // Skip the callback if the timer was disarmed meanwhile
+        uint32_t ps = _xt_disable_interrupts();
+        bool run = timer->queued;
+        timer->queued = 0;
+        _xt_restore_interrupts(ps);
+        if (run) {
+            timer->cb(timer->arg);
+        }
+    }
+}
+
+bool hrtimer_init(UBaseType_t task_priority)
+{
+    if (queue) {
+        return true;
+    }
+    queue = xQueueCreate(HRTIMER_MAX_ARMED, sizeof(hrtimer_t *));
+    if (!queue) {
+        return false;
+    }
+    if (xTaskCreate(hrtimer_task, "hrtimer", HRTIMER_TASK_STACK, NULL, task_priority, NULL) != pdPASS) {
+        vQueueDelete(queue);
+        queue = NULL;
+        return false;
+    }
+
+    uint32_t ps = _xt_disable_interrupts();
+    // Whatever alarm is set belongs to the SDK timers
+    alarm = TIMER(FRC2).ALARM;
+    sdk_alarm = alarm;
+    sdk_pending = true;
+    timer_set_divider(FRC2, TIMER_CLKDIV_16);
+    timer_set_run(FRC2, true);
+    _xt_isr_attach(INUM_TIMER_FRC2, hrtimer_isr);
+    program_alarm();
+    _xt_restore_interrupts(ps);
+    timer_set_interrupts(FRC2, true);
+    return true;
+}
+
+void hrtimer_setup(hrtimer_t *timer, hrtimer_cb_t cb, void *arg, hrtimer_dispatch_t dispatch)
+{
+    timer->cb = cb;
+    timer->arg = arg;
+    timer->period = 0;
+    timer->index = HRTIMER_IDLE;
+    timer->dispatch = dispatch;
+    timer->queued = 0;
+}
+
+bool IRAM hrtimer_arm(hrtimer_t *timer, uint32_t us, uint32_t period_us)
+{
+    if (us > HRTIMER_MAX_US || period_us > HRTIMER_MAX_US ||
+        (period_us && period_us < HRTIMER_MIN_PERIOD_US)) {
+        return false;
+    }
+
+    uint32_t ps = _xt_disable_interrupts();
+    if (timer->index != HRTIMER_IDLE) {
+        heap_remove(timer);
+    } else if (heap_size == HRTIMER_MAX_ARMED) {
+        _xt_restore_interrupts(ps);
+        return false;
+    }
+    timer->expires = TIMER(FRC2).COUNT + HRTIMER_TICKS(us);
+    timer->period = HRTIMER_TICKS(period_us);
+    heap_insert(timer);
+    if (heap[0] == timer) {
+        program_alarm();
+    }
+    _xt_restore_interrupts(ps);
+    return true;
+}
+
+void IRAM hrtimer_disarm(hrtimer_t *timer)
+{
+    uint32_t ps = _xt_disable_interrupts();
+    timer->queued = 0;
+    if (timer->index != HRTIMER_IDLE) {
+        heap_remove(timer);
+    }
+    _xt_restore_interrupts(ps);
+}
+
+bool hrtimer_is_armed(const hrtimer_t *timer)
+{
+    return timer->index != HRTIMER_IDLE;
+}
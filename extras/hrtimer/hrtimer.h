@@ -0,0 +1,126 @@
+/**
+ * High resolution software timers on FRC2.
+ *
+ * Part of esp-open-rtos
+ * BSD Licensed as described in the file LICENSE
+ */
+#ifndef __HRTIMER_H__
+#define __HRTIMER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file hrtimer.h
+ *
+ *  Microsecond resolution timers, multiplexed onto the FRC2 hardware timer.
+ *
+ *  Armed timers are kept in a binary heap ordered by expiry time, so arming
+ *  and cancelling take O(log n) and the FRC2 alarm is always set for the
+ *  first one.  Timers are caller-owned structures, arming and re-arming them
+ *  never allocates memory.
+ *
+ *  FRC2 is shared with the SDK timers (sdk_ets_timer_*), whose interrupt
+ *  handler is called from the hrtimer interrupt when one of them is due.  An
+ *  SDK timer armed from a task while hrtimers are pending may take over the
+ *  alarm, in which case the next hrtimer can fire late, at the expiry of
+ *  that SDK timer.
+ */
+
+/** Maximum number of simultaneously armed timers */
+#ifndef HRTIMER_MAX_ARMED
+#define HRTIMER_MAX_ARMED 16
+#endif
+
+/** Stack size of the task running ::HRTIMER_TASK callbacks */
+#ifndef HRTIMER_TASK_STACK
+#define HRTIMER_TASK_STACK 256
+#endif
+
+/** Longest delay or period accepted by hrtimer_arm(), in microseconds */
+#define HRTIMER_MAX_US 200000000
+
+/** Shortest period accepted by hrtimer_arm(), in microseconds.  Shorter
+ *  periods would leave little time for anything but the interrupt. */
+#define HRTIMER_MIN_PERIOD_US 100
+
+typedef void (*hrtimer_cb_t)(void *arg);
+
+/** Where the callback of a timer runs */
+typedef enum {
+    HRTIMER_ISR = 0,  ///< In the FRC2 interrupt, must be short and in IRAM
+    HRTIMER_TASK,     ///< In the hrtimer task, may use blocking calls
+} hrtimer_dispatch_t;
+
+/** A timer. Initialise with hrtimer_setup(), the fields are private. */
+typedef struct {
+    hrtimer_cb_t cb;
+    void *arg;
+    uint32_t expires;          // FRC2 count of the next expiry
+    uint32_t period;           // FRC2 counts between expiries, 0 if one-shot
+    uint16_t index;            // position in the heap
+    uint8_t dispatch;
+    volatile uint8_t queued;   // expired, waiting for the hrtimer task
+} hrtimer_t;
+
+/** Start the timer service.
+ *
+ *  Installs the FRC2 interrupt handler and creates the task running
+ *  ::HRTIMER_TASK callbacks.  Must be called after the SDK startup code has
+ *  initialised its timers, i.e. from user_init() or later.
+ *
+ *  @param task_priority  Priority of the callback task
+ *
+ *  @returns `true` on success, `false` if the task or its queue could not be
+ *           created.
+ */
+bool hrtimer_init(UBaseType_t task_priority);
+
+/** Set the callback of a timer.
+ *
+ *  Must be called before the first hrtimer_arm() and not while the timer is
+ *  armed.
+ *
+ *  @param timer     The timer to initialise
+ *  @param cb        Function called when the timer expires
+ *  @param arg       Argument passed to `cb`
+ *  @param dispatch  Run `cb` in the interrupt or in the hrtimer task
+ */
+void hrtimer_setup(hrtimer_t *timer, hrtimer_cb_t cb, void *arg, hrtimer_dispatch_t dispatch);
+
+/** Arm (or re-arm) a timer.
+ *
+ *  A timer which is already armed is rescheduled.  Periodic timers are
+ *  rescheduled relative to their previous expiry, so they don't drift.  A
+ *  periodic timer which falls a whole period behind (e.g. because interrupts
+ *  were disabled for too long) skips the missed expiries.  Can be called
+ *  from ::HRTIMER_ISR callbacks.
+ *
+ *  @param timer      The timer to arm
+ *  @param us         Delay until the first expiry, in microseconds
+ *  @param period_us  Period in microseconds, 0 for a one-shot timer
+ *
+ *  @returns `false` if a time is out of range or ::HRTIMER_MAX_ARMED timers
+ *           are already armed.
+ */
+bool hrtimer_arm(hrtimer_t *timer, uint32_t us, uint32_t period_us);
+
+/** Cancel a timer.
+ *
+ *  A pending ::HRTIMER_TASK callback of the timer is dropped as well.  Can be
+ *  called from ::HRTIMER_ISR callbacks.
+ */
+void hrtimer_disarm(hrtimer_t *timer);
+
+/** Check if a timer is armed */
+bool hrtimer_is_armed(const hrtimer_t *timer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HRTIMER_H__ */
@@ -58,6 +58,42 @@ u8_t fs_wait_read_custom(struct fs_file *file, fs_wait_cb callback_fn, void *cal
 #endif /* LWIP_HTTPD_FS_ASYNC_READ */
 #endif /* LWIP_HTTPD_CUSTOM_FILES */
 
+/*-----------------------------------------------------------------------------------*/
+/** Look up a file by name. makefsdata emits FS_INDEX, the files sorted by
+ * name, which is binary searched; older fsdata files only have the FS_ROOT
+ * list. */
+static const struct fsdata_file *
+fs_find(const char *name)
+{
+#ifdef FS_INDEX
+  int lo = 0;
+  int hi = FS_NUMFILES - 1;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    const struct fsdata_file *f = FS_INDEX[mid];
+    int cmp = strcmp(name, (const char *)f->name);
+    if (cmp == 0) {
+      return f;
+    }
+    if (cmp < 0) {
+      hi = mid - 1;
+    } else {
+      lo = mid + 1;
+    }
+  }
+#else /* FS_INDEX */
+  const struct fsdata_file *f;
+
+  for (f = FS_ROOT; f != NULL; f = f->next) {
+    if (!strcmp(name, (const char *)f->name)) {
+      return f;
+    }
+  }
+#endif /* FS_INDEX */
+  return NULL;
+}
+
 /*-----------------------------------------------------------------------------------*/
 err_t
 fs_open(struct fs_file *file, const char *name)
@@ -68,6 +104,9 @@ fs_open(struct fs_file *file, const char *name)
      return ERR_ARG;
   }
 
+  file->etag = NULL;
+  file->not_modified = NULL;
+
 #if LWIP_HTTPD_CUSTOM_FILES
   if (fs_open_custom(file, name)) {
     file->is_custom_file = 1;
@@ -76,25 +115,27 @@ fs_open(struct fs_file *file, const char *name)
   file->is_custom_file = 0;
 #endif /* LWIP_HTTPD_CUSTOM_FILES */
 
-  for (f = FS_ROOT; f != NULL; f = f->next) {
-    if (!strcmp(name, (char *)f->name)) {
-      file->data = (const char *)f->data;
-      file->len = f->len;
-      file->index = f->len;
-      file->pextension = NULL;
-      file->http_header_included = f->http_header_included;
+  f = fs_find(name);
+  if (f == NULL) {
+    /* file not found */
+    return ERR_VAL;
+  }
+
+  file->data = (const char *)f->data;
+  file->len = f->len;
+  file->index = f->len;
+  file->pextension = NULL;
+  file->http_header_included = f->http_header_included;
+  file->etag = f->etag;
+  file->not_modified = f->not_modified;
 #if HTTPD_PRECALCULATED_CHECKSUM
-      file->chksum_count = f->chksum_count;
-      file->chksum = f->chksum;
+  file->chksum_count = f->chksum_count;
+  file->chksum = f->chksum;
 #endif /* HTTPD_PRECALCULATED_CHECKSUM */
 #if LWIP_HTTPD_FILE_STATE
-      file->state = fs_state_init(file, name);
+  file->state = fs_state_init(file, name);
 #endif /* #if LWIP_HTTPD_FILE_STATE */
-      return ERR_OK;
-    }
-  }
-  /* file not found */
-  return ERR_VAL;
+  return ERR_OK;
 }
 
 /*-----------------------------------------------------------------------------------*/
@@ -96,6 +96,10 @@ struct fs_file {
   u16_t chksum_count;
 #endif /* HTTPD_PRECALCULATED_CHECKSUM */
   u8_t http_header_included;
+  /** entity tag of the file and the response to a matching conditional GET,
+   * NULL if the file has no ETag */
+  const char *etag;
+  const char *not_modified;
 #if LWIP_HTTPD_CUSTOM_FILES
   u8_t is_custom_file;
 #endif /* LWIP_HTTPD_CUSTOM_FILES */
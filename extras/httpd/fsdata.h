@@ -45,6 +45,10 @@ struct fsdata_file {
   u16_t chksum_count;
   const struct fsdata_chksum *chksum;
 #endif /* HTTPD_PRECALCULATED_CHECKSUM */
+  /** quoted entity tag and complete "304 Not Modified" response,
+   * NULL for files that change when sent (SSI, 404) */
+  const char *etag;
+  const char *not_modified;
 };
 
 #endif /* __FSDATA_H__ */
@@ -84,6 +84,7 @@
 #include "lwip/stats.h"
 #include "httpd_structs.h"
 #include "lwip/tcp.h"
+#include "lwip/tcpip.h"
 #include "fs.h"
 
 #include <string.h>
@@ -220,6 +221,7 @@
 
 #define CRLF "\r\n"
 #define HTTP11_CONNECTIONKEEPALIVE "Connection: keep-alive"
+#define HTTP_IF_NONE_MATCH "If-None-Match:"
 
 #if LWIP_HTTPD_SSI
 #define LWIP_HTTPD_IS_SSI(hs) ((hs)->ssi)
@@ -291,6 +293,11 @@ static const char WS_RSP[] = "HTTP/1.1 101 Switching Protocols\r\n" \
 static tWsHandler websocket_cb = NULL;
 static tWsOpenHandler websocket_open_cb = NULL;
 
+/* Open websocket connections, linked through ws_next */
+static struct http_state *websocket_connections = NULL;
+/* The tcpip thread, known once the first websocket is opened */
+static TaskHandle_t websocket_tcpip_task = NULL;
+
 typedef struct
 {
   const char *name;
@@ -365,6 +372,8 @@ struct http_state {
   char *file;       /* Pointer to first unsent byte in buf. */
 
   u8_t is_websocket;
+  u8_t ws_broken;   /* Partial frame queued, close at next poll */
+  struct http_state *ws_next; /* Next open websocket, for broadcasts */
 
   struct tcp_pcb *pcb;
 #if LWIP_HTTPD_SUPPORT_REQUESTLIST
@@ -410,9 +419,11 @@ static err_t http_close_conn(struct tcp_pcb *pcb, struct http_state *hs);
 static err_t http_close_or_abort_conn(struct tcp_pcb *pcb, struct http_state *hs, u8_t abort_conn);
 static err_t http_find_file(struct http_state *hs, const char *uri, int is_09);
 static err_t http_init_file(struct http_state *hs, struct fs_file *file, int is_09, const char *uri, u8_t tag_check);
+static void http_check_not_modified(struct http_state *hs, const char *headers, u16_t headers_len);
 static err_t http_poll(void *arg, struct tcp_pcb *pcb);
 
 static err_t websocket_send_close(struct tcp_pcb *pcb);
+static void websocket_unlink(struct http_state *hs);
 
 #if LWIP_HTTPD_FS_ASYNC_READ
 static void http_continue(void *connection);
@@ -598,6 +609,9 @@ http_state_free(struct http_state *hs)
 {
   if (hs != NULL) {
     http_state_eof(hs);
+    if (hs->is_websocket) {
+      websocket_unlink(hs);
+    }
 #if LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED
     /* take the connection off the list */
     if (http_connections) {
@@ -756,9 +770,11 @@ http_eof(struct tcp_pcb *pcb, struct http_state *hs)
   } else
 #endif /* LWIP_HTTPD_SUPPORT_11_KEEPALIVE */
   if (hs->is_websocket) {
+    struct http_state *ws_next = hs->ws_next;
     http_state_eof(hs);
     http_state_init(hs);
     hs->is_websocket = 1;
+    hs->ws_next = ws_next;
   } else {
     http_close_conn(pcb, hs);
   }
@@ -2102,11 +2118,19 @@ http_parse_request(struct pbuf **inp, struct http_state *hs, struct tcp_pcb *pcb
               u16_t len = strlen((char *) retval);
               http_write(pcb, retval, &len, 0);
               mem_free(retval);
+              hs->ws_next = websocket_connections;
+              websocket_connections = hs;
+              websocket_tcpip_task = xTaskGetCurrentTaskHandle();
               if(websocket_open_cb)
                 websocket_open_cb(pcb, uri);
               return ERR_OK; // We handled this
             } else {
-              return http_find_file(hs, uri, is_09);
+              err_t find_err = http_find_file(hs, uri, is_09);
+              if ((find_err == ERR_OK) && !is_09) {
+                /* the URI was terminated at sp2, headers follow it */
+                http_check_not_modified(hs, sp2 + 1, data_len - (u16_t)(sp2 + 1 - data));
+              }
+              return find_err;
             }
           }
         }
@@ -2309,6 +2333,43 @@ http_init_file(struct http_state *hs, struct fs_file *file, int is_09, const cha
   return ERR_OK;
 }
 
+/** Answer a conditional GET with the file's "304 Not Modified" response if
+ * the request has an If-None-Match header matching the file's ETag. The file
+ * data is never touched, hs->handle stays open with no bytes left.
+ *
+ * @param hs http connection state with the requested file opened
+ * @param headers request headers following the request line
+ * @param headers_len length of headers
+ */
+static void
+http_check_not_modified(struct http_state *hs, const char *headers, u16_t headers_len)
+{
+  const char *match;
+  const char *end;
+
+  if ((hs->handle == NULL) || (hs->handle->etag == NULL)) {
+    return;
+  }
+  match = strncasestr(headers, HTTP_IF_NONE_MATCH, headers_len);
+  if (match == NULL) {
+    return;
+  }
+  match += sizeof(HTTP_IF_NONE_MATCH) - 1;
+  end = strnstr(match, CRLF, headers_len - (match - headers));
+  if (end == NULL) {
+    return;
+  }
+  while ((match < end) && (*match == ' ')) {
+    match++;
+  }
+  /* the header holds "*" or a list of (possibly weak) entity tags */
+  if ((*match == '*') || (strnstr(match, hs->handle->etag, end - match) != NULL)) {
+    LWIP_DEBUGF(HTTPD_DEBUG, ("ETag %s matches, not modified\n", hs->handle->etag));
+    hs->file = (char *)hs->handle->not_modified;
+    hs->left = strlen(hs->handle->not_modified);
+  }
+}
+
 /**
  * The pcb had an error and is already deallocated.
  * The argument might still be valid (if != NULL).
@@ -2379,7 +2440,8 @@ http_poll(void *arg, struct tcp_pcb *pcb)
     return ERR_OK;
   } else {
     hs->retries++;
-    if (hs->retries == ((hs->is_websocket) ? WS_TIMEOUT : HTTPD_MAX_RETRIES)) {
+    if (hs->ws_broken ||
+        (hs->retries == ((hs->is_websocket) ? WS_TIMEOUT : HTTPD_MAX_RETRIES))) {
       LWIP_DEBUGF(HTTPD_DEBUG, ("http_poll: too many retries, close\n"));
       http_close_conn(pcb, hs);
       return ERR_OK;
@@ -2408,34 +2470,200 @@ websocket_register_callbacks(tWsOpenHandler ws_open_cb, tWsHandler ws_cb)
   websocket_cb = ws_cb;
 }
 
-err_t
-websocket_write(struct tcp_pcb *pcb, const uint8_t *data, uint16_t len, uint8_t mode)
+/** Take a connection off the list of open websockets. */
+static void
+websocket_unlink(struct http_state *hs)
 {
-  uint8_t *buf = mem_malloc(len + 4);
-  if (buf == NULL) {
-    LWIP_DEBUGF(HTTPD_DEBUG, ("[websocket_write] out of memory\n"));
-    return ERR_MEM;
+  struct http_state **link;
+  for (link = &websocket_connections; *link != NULL; link = &(*link)->ws_next) {
+    if (*link == hs) {
+      *link = hs->ws_next;
+      break;
+    }
   }
+  hs->ws_next = NULL;
+}
 
-  int offset = 2;
-  buf[0] = 0x80 | mode;
+/** Build the header of an unmasked, unfragmented frame.
+ * @return header length (2 or 4 bytes)
+ */
+static u16_t
+websocket_frame_header(u8_t *hdr, u16_t len, u8_t mode)
+{
+  hdr[0] = 0x80 | mode;
   if (len > 125) {
-    offset = 4;
-    buf[1] = 126;
-    buf[2] = len >> 8;
-    buf[3] = len;
-  } else {
-    buf[1] = len;
+    hdr[1] = 126;
+    hdr[2] = len >> 8;
+    hdr[3] = len;
+    return 4;
+  }
+  hdr[1] = len;
+  return 2;
+}
+
+/* With LWIP_NETIF_TX_SINGLE_PBUF tcp_write() copies the payload anyway */
+#if LWIP_NETIF_TX_SINGLE_PBUF
+#define WEBSOCKET_REF_FLAGS TCP_WRITE_FLAG_COPY
+#else
+#define WEBSOCKET_REF_FLAGS 0
+#endif
+
+/** Upper bound of the send queue entries (pbufs) tcp_write() takes for a
+ * copied header followed by len payload bytes. A copied payload needs one
+ * pbuf per segment, a referenced one a header pbuf plus a ROM pbuf per
+ * segment. The payload may start in the segment of the header, so count
+ * one segment more than it strictly needs.
+ */
+static u16_t
+websocket_queue_entries(struct tcp_pcb *pcb, u16_t len, u8_t apiflags)
+{
+  u16_t mss = tcp_mss(pcb);
+  u16_t segs;
+
+  if (len == 0) {
+    return 1;
+  }
+  if (mss == 0) {
+    mss = 1;
+  }
+  segs = (len + mss - 1) / mss + 1;
+  return 1 + ((apiflags & TCP_WRITE_FLAG_COPY) ? segs : 2 * segs);
+}
+
+/** Queue a frame header and its payload as two tcp_write() calls.
+ * The whole frame must fit in the send buffer, a partial frame would
+ * corrupt the stream for the client.
+ *
+ * @param apiflags TCP_WRITE_FLAG_COPY to copy the payload,
+ *        WEBSOCKET_REF_FLAGS to reference it where lwIP allows
+ */
+static err_t
+websocket_send_frame(struct tcp_pcb *pcb, const u8_t *hdr, u16_t hdr_len,
+                     const u8_t *data, u16_t len, u8_t apiflags)
+{
+  struct http_state *hs = (struct http_state *)pcb->callback_arg;
+  err_t err;
+
+  if ((hs == NULL) || hs->ws_broken) {
+    return ERR_CONN;
   }
+  if ((tcp_sndbuf(pcb) < hdr_len + len) ||
+      (tcp_sndqueuelen(pcb) + websocket_queue_entries(pcb, len, apiflags) >
+       TCP_SND_QUEUELEN)) {
+    LWIP_DEBUGF(HTTPD_DEBUG | LWIP_DBG_TRACE, ("[wsoc] send buffer full\n"));
+    return ERR_MEM;
+  }
+  err = tcp_write(pcb, hdr, hdr_len, TCP_WRITE_FLAG_COPY | (len ? TCP_WRITE_FLAG_MORE : 0));
+  if (err != ERR_OK) {
+    return err;
+  }
+  if (len) {
+    err = tcp_write(pcb, data, len, apiflags);
+    if (err != ERR_OK) {
+      /* The header is already queued, the stream can't be recovered. This
+         may run in a callback of this pcb, so leave the close to http_poll */
+      LWIP_DEBUGF(HTTPD_DEBUG, ("[wsoc] payload write failed, closing\n"));
+      hs->ws_broken = 1;
+      return ERR_CONN;
+    }
+  }
+  tcp_output(pcb);
+  return ERR_OK;
+}
 
-  memcpy(&buf[offset], data, len);
-  len += offset;
+err_t
+websocket_write(struct tcp_pcb *pcb, const uint8_t *data, uint16_t len, uint8_t mode)
+{
+  u8_t hdr[4];
+  u16_t hdr_len = websocket_frame_header(hdr, len, mode);
 
   LWIP_DEBUGF(HTTPD_DEBUG, ("[websocket_write] sending packet\n"));
-  err_t retval = http_write(pcb, buf, &len, TCP_WRITE_FLAG_COPY);
-  mem_free(buf);
+  return websocket_send_frame(pcb, hdr, hdr_len, data, len, TCP_WRITE_FLAG_COPY);
+}
+
+err_t
+websocket_write_static(struct tcp_pcb *pcb, const uint8_t *data, uint16_t len, uint8_t mode)
+{
+  u8_t hdr[4];
+  u16_t hdr_len = websocket_frame_header(hdr, len, mode);
 
-  return retval;
+  return websocket_send_frame(pcb, hdr, hdr_len, data, len, WEBSOCKET_REF_FLAGS);
+}
+
+/* Broadcast arguments passed to the tcpip thread */
+struct websocket_broadcast_msg {
+  const uint8_t *data;
+  uint16_t len;
+  uint8_t mode;
+  uint8_t is_static;
+  tWsBroadcastHandler cb;
+  int sent;
+  sys_sem_t done;
+};
+
+/* Walks websocket_connections, which the tcpip thread changes as clients
+   come and go, so this must run in the tcpip thread */
+static int
+websocket_broadcast_local(const uint8_t *data, uint16_t len, uint8_t mode, uint8_t is_static,
+                          tWsBroadcastHandler ws_bcast_cb)
+{
+  u8_t hdr[4];
+  u16_t hdr_len = websocket_frame_header(hdr, len, mode);
+  struct http_state *hs = websocket_connections;
+  int sent = 0;
+
+  while (hs != NULL) {
+    err_t err = websocket_send_frame(hs->pcb, hdr, hdr_len, data, len,
+                                     is_static ? WEBSOCKET_REF_FLAGS : TCP_WRITE_FLAG_COPY);
+    if (err == ERR_OK) {
+      sent++;
+    }
+    if (ws_bcast_cb != NULL) {
+      ws_bcast_cb(hs->pcb, err);
+    }
+    hs = hs->ws_next;
+  }
+  return sent;
+}
+
+static void
+websocket_broadcast_call(void *arg)
+{
+  struct websocket_broadcast_msg *msg = (struct websocket_broadcast_msg *)arg;
+
+  msg->sent = websocket_broadcast_local(msg->data, msg->len, msg->mode, msg->is_static, msg->cb);
+  sys_sem_signal(&msg->done);
+}
+
+int
+websocket_broadcast(const uint8_t *data, uint16_t len, uint8_t mode, uint8_t is_static,
+                    tWsBroadcastHandler ws_bcast_cb)
+{
+  struct websocket_broadcast_msg msg;
+
+  if (websocket_tcpip_task == NULL) {
+    /* No websocket was opened yet */
+    return 0;
+  }
+  if (xTaskGetCurrentTaskHandle() == websocket_tcpip_task) {
+    return websocket_broadcast_local(data, len, mode, is_static, ws_bcast_cb);
+  }
+
+  /* Run it in the tcpip thread and wait, the payload stays valid meanwhile */
+  if (sys_sem_new(&msg.done, 0) != ERR_OK) {
+    return 0;
+  }
+  msg.data = data;
+  msg.len = len;
+  msg.mode = mode;
+  msg.is_static = is_static;
+  msg.cb = ws_bcast_cb;
+  msg.sent = 0;
+  if (tcpip_callback(websocket_broadcast_call, &msg) == ERR_OK) {
+    sys_sem_wait(&msg.done);
+  }
+  sys_sem_free(&msg.done);
+  return msg.sent;
 }
 
 /**
@@ -2547,11 +2775,11 @@ http_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
       LWIP_DEBUGF(HTTPD_DEBUG, ("[wsoc] freeing buffer\n"));
       pbuf_free(p);
     }
+    /* reset timeout */
+    hs->retries = 0;
     if (err == ERR_CLSD) {
       http_close_conn(pcb, hs);
     }
-    /* reset timeout */
-    hs->retries = 0;
     return ERR_OK;
   }
 
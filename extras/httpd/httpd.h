@@ -246,10 +246,54 @@ typedef void (*tWsOpenHandler)(struct tcp_pcb *pcb, const char *uri);
  * @param data data to send.
  * @param len data length.
  * @param mode WS_TEXT_MODE or WS_BIN_MODE.
- * @return ERR_OK if write succeeded.
+ * @return ERR_OK if the frame was queued, ERR_MEM if the send buffer can't
+ *         take the whole frame (nothing queued).
  */
 err_t websocket_write(struct tcp_pcb *pcb, const uint8_t *data, uint16_t len, uint8_t mode);
 
+/**
+ * Write data into a websocket without copying the payload. Only the frame
+ * header is copied, lwIP references the payload until the client
+ * acknowledges it, so it must stay valid and unchanged until then (e.g.
+ * constant data in flash, or buffers rotated slower than the send queue).
+ *
+ * With LWIP_NETIF_TX_SINGLE_PBUF, which the default lwipopts.h sets, lwIP
+ * can't reference data and copies the payload like websocket_write().
+ *
+ * Parameters as for websocket_write().
+ * @return ERR_OK if the frame was queued, ERR_MEM if the send buffer is full
+ *         (nothing queued), ERR_CONN if the connection is being closed.
+ */
+err_t websocket_write_static(struct tcp_pcb *pcb, const uint8_t *data, uint16_t len, uint8_t mode);
+
+/**
+ * Called by websocket_broadcast() with the result for every connection, in
+ * the tcpip thread.
+ * ERR_MEM means the frame was dropped for this client because its send
+ * buffer is full.
+ */
+typedef void (*tWsBroadcastHandler)(struct tcp_pcb *pcb, err_t err);
+
+/**
+ * Send one frame to all open websockets. The frame header is built once,
+ * the payload is copied per connection or referenced if is_static is set
+ * (see websocket_write_static()).
+ *
+ * Can be called from any task. Called from another task than the tcpip
+ * thread, the frame is sent by the tcpip thread through tcpip_callback()
+ * and this waits until it is queued, ws_bcast_cb then runs in the tcpip
+ * thread. Not for use in interrupts.
+ *
+ * @param data data to send.
+ * @param len data length.
+ * @param mode WS_TEXT_MODE or WS_BIN_MODE.
+ * @param is_static nonzero to send without copying the payload.
+ * @param ws_bcast_cb per connection result, or NULL.
+ * @return number of connections the frame was queued to.
+ */
+int websocket_broadcast(const uint8_t *data, uint16_t len, uint8_t mode, uint8_t is_static,
+                        tWsBroadcastHandler ws_bcast_cb);
+
 /**
  * Register websocket callback functions. Use NULL if callback is not needed.
  *
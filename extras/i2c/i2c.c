@@ -25,6 +25,7 @@
 #include <esp8266.h>
 #include <espressif/esp_misc.h> // sdk_os_delay_us
 #include <espressif/esp_system.h>
+#include <xtensa_ops.h>
 #include "i2c.h"
 
 //#define I2C_DEBUG true
@@ -35,293 +36,546 @@
 #define debug(fmt, ...)
 #endif
 
-#define CLK_STRETCH  (10)
+/* Bit timing works on CCOUNT deadlines: every SCL edge is placed half a
+ * period after the previous one, whatever time the code in between took.
+ * The bus therefore runs at the requested frequency (rounded to a whole
+ * number of CPU cycles) at both CPU frequencies, as long as the code between
+ * two edges is shorter than half a period.
+ */
+typedef struct {
+    uint32_t scl;       // pin masks
+    uint32_t sda;
+    uint32_t half;      // half SCL period in CPU cycles
+    uint32_t stretch;   // clock stretching timeout in CPU cycles
+    uint32_t edge;      // CCOUNT at the last SCL edge
+    bool timeout;       // a slave stretched the clock for too long
+    bool lost;          // SDA was low while released
+} i2c_timing_t;
+
+typedef struct {
+    bool started;
+    bool flag;          // a transaction is in progress
+    bool force;
+    bool inited;
+    uint32_t freq;      // requested SCL frequency in Hz
+    uint32_t stretch_us;
+    uint8_t cpu_mhz;    // CPU frequency the timing was computed for
+    i2c_timing_t timing;
+    uint8_t scl_pin;
+    uint8_t sda_pin;
+    SemaphoreHandle_t lock;
+    TaskHandle_t owner; // task holding the lock
+    uint8_t depth;      // i2c_bus_lock nesting depth
+    // Statistics of level 1 transactions
+    uint32_t transactions;
+    uint32_t bytes;
+    uint32_t errors;
+    uint32_t stretch_timeouts;
+    uint32_t arbitration_lost;
+    uint64_t cycles;
+} i2c_bus_t;
 
-static bool started;
-static bool flag;
-static bool force;
-static uint8_t freq ;
-static uint8_t g_scl_pin;
-static uint8_t g_sda_pin;
+static i2c_bus_t buses[I2C_MAX_BUS];
 
-inline bool i2c_status(void)
+inline bool i2c_bus_status(uint8_t bus)
 {
-    return started;
+    return buses[bus].started;
 }
 
-void i2c_init(uint8_t scl_pin, uint8_t sda_pin)
+bool i2c_status(void)
+{
+    return i2c_bus_status(0);
+}
+
+static inline uint32_t get_ccount(void)
+{
+    uint32_t ccount;
+    RSR(ccount, ccount);
+    return ccount;
+}
+
+// Recompute the cycle counts if the CPU frequency changed
+static void update_timing(i2c_bus_t *b)
 {
-    started = false;
-    flag = false ;
-    g_scl_pin = scl_pin;
-    g_sda_pin = sda_pin;
+    uint8_t mhz = sdk_system_get_cpu_freq();
+    uint32_t cpu_hz = mhz * 1000000;
+
+    b->cpu_mhz = mhz;
+    b->timing.half = (cpu_hz + b->freq) / (2 * b->freq);
+    if (b->timing.half == 0)
+        b->timing.half = 1;
+    b->timing.stretch = b->stretch_us * mhz;
+}
+
+int i2c_bus_init(uint8_t bus, uint8_t scl_pin, uint8_t sda_pin, uint32_t freq)
+{
+    if (bus >= I2C_MAX_BUS || scl_pin > 15 || sda_pin > 15)
+        return -EINVAL;
+
+    i2c_bus_t *b = &buses[bus];
+
+    if (!b->lock) {
+        b->lock = xSemaphoreCreateMutex();
+        if (!b->lock)
+            return -ENOMEM;
+    }
+
+    b->started = false;
+    b->flag = false ;
+    b->scl_pin = scl_pin;
+    b->sda_pin = sda_pin;
+    b->timing.scl = BIT(scl_pin);
+    b->timing.sda = BIT(sda_pin);
+    b->stretch_us = I2C_CLK_STRETCH_TIMEOUT;
+    b->inited = true;
 
     // Just to prevent these pins floating too much if not connected.
-    gpio_set_pullup(g_scl_pin, 1, 1);
-    gpio_set_pullup(g_sda_pin, 1, 1);
+    gpio_set_pullup(scl_pin, 1, 1);
+    gpio_set_pullup(sda_pin, 1, 1);
 
-    gpio_enable(g_scl_pin, GPIO_OUT_OPEN_DRAIN);
-    gpio_enable(g_sda_pin, GPIO_OUT_OPEN_DRAIN);
+    gpio_enable(scl_pin, GPIO_OUT_OPEN_DRAIN);
+    gpio_enable(sda_pin, GPIO_OUT_OPEN_DRAIN);
 
     // I2C bus idle state.
-    gpio_write(g_scl_pin, 1);
-    gpio_write(g_sda_pin, 1);
+    gpio_write(scl_pin, 1);
+    gpio_write(sda_pin, 1);
+
+    i2c_bus_set_frequency(bus, freq);
 
-    // Prevent user, if frequency is high
-    if (sdk_system_get_cpu_freq() == SYS_CPU_80MHZ)
-        if (I2C_CUSTOM_DELAY_80MHZ == 1)
-            debug("Max frequency is 320Khz at 80MHz");
+    return 0;
+}
 
+void i2c_init(uint8_t scl_pin, uint8_t sda_pin)
+{
+    i2c_bus_init(0, scl_pin, sda_pin, I2C_DEFAULT_FREQ);
 }
 
-static inline void i2c_delay(void)
+void i2c_bus_set_frequency(uint8_t bus, uint32_t freq)
 {
-    uint32_t delay;
-    if (freq == SYS_CPU_160MHZ)
-    {
-        __asm volatile (
-            "movi %0, %1" "\n"
-            "1: addi %0, %0, -1" "\n"
-            "bnez %0, 1b" "\n"
-        : "=a" (delay) : "i" (I2C_CUSTOM_DELAY_160MHZ));
-    }
-    else
-    {
-        __asm volatile (
-            "movi %0, %1" "\n"
-            "1: addi %0, %0, -1" "\n"
-            "bnez %0, 1b" "\n"
-        : "=a" (delay) : "i" (I2C_CUSTOM_DELAY_80MHZ));
+    if (freq == 0)
+        freq = I2C_DEFAULT_FREQ;
+    if (freq > I2C_FREQ_MAX)
+        freq = I2C_FREQ_MAX;
+    buses[bus].freq = freq;
+    update_timing(&buses[bus]);
+}
+
+uint32_t i2c_bus_get_frequency(uint8_t bus)
+{
+    i2c_bus_t *b = &buses[bus];
+    return b->cpu_mhz * 1000000 / (2 * b->timing.half);
+}
+
+void i2c_bus_set_clock_stretch(uint8_t bus, uint32_t timeout_us)
+{
+    buses[bus].stretch_us = timeout_us;
+    update_timing(&buses[bus]);
+}
+
+// Busy wait until 'cycles' after the last SCL edge
+static inline __attribute__((always_inline)) void wait_edge(const i2c_timing_t *t, uint32_t cycles)
+{
+    while (get_ccount() - t->edge < cycles) ;
+}
+
+// Release SCL and wait for it to go high, slaves may hold it low
+// (clock stretching). The high phase is timed from the rising edge.
+static inline __attribute__((always_inline)) void release_scl(i2c_timing_t *t)
+{
+    GPIO.OUT_SET = t->scl;
+    uint32_t start = get_ccount();
+    while (!(GPIO.IN & t->scl)) {
+        if (get_ccount() - start > t->stretch) {
+            t->timeout = true;
+            break;
+        }
     }
+    t->edge = get_ccount();
 }
 
-// Set SCL as input, allowing it to float high, and return current
-// level of line, 0 or 1
-static inline bool read_scl(void)
+// Drive SCL low at the end of the high phase
+static inline __attribute__((always_inline)) void clear_scl(i2c_timing_t *t)
 {
-    gpio_write(g_scl_pin, 1);
-    return gpio_read(g_scl_pin); // Clock high, valid ACK
+    wait_edge(t, t->half);
+    GPIO.OUT_CLEAR = t->scl;
+    t->edge = get_ccount();
 }
 
-// Set SDA as input, allowing it to float high, and return current
-// level of line, 0 or 1
-static inline bool read_sda(void)
+// Write a bit to I2C bus, SCL is low on entry and exit
+static inline __attribute__((always_inline)) void write_bit(i2c_timing_t *t, bool bit)
 {
-    gpio_write(g_sda_pin, 1);
-    // TODO: Without this delay we get arbitration lost in i2c_stop
-    i2c_delay();
-    return gpio_read(g_sda_pin); // Clock high, valid ACK
+    if (bit)
+        GPIO.OUT_SET = t->sda;
+    else
+        GPIO.OUT_CLEAR = t->sda;
+    wait_edge(t, t->half);
+    release_scl(t);
+    wait_edge(t, t->half);
+    // SCL is high, now data is valid
+    // If SDA is high, check that nobody else is driving SDA
+    if (bit && !(GPIO.IN & t->sda))
+        t->lost = true;
+    GPIO.OUT_CLEAR = t->scl;
+    t->edge = get_ccount();
+}
+
+// Read a bit from I2C bus, SCL is low on entry and exit
+static inline __attribute__((always_inline)) bool read_bit(i2c_timing_t *t)
+{
+    // Let the slave drive data
+    GPIO.OUT_SET = t->sda;
+    wait_edge(t, t->half);
+    release_scl(t);
+    wait_edge(t, t->half);
+    // Sample at the end of the high phase
+    bool bit = GPIO.IN & t->sda;
+    GPIO.OUT_CLEAR = t->scl;
+    t->edge = get_ccount();
+    return bit;
 }
 
-// Actively drive SCL signal low
-static inline void clear_scl(void)
+static inline __attribute__((always_inline)) bool write_byte(i2c_timing_t *t, uint8_t byte)
 {
-    gpio_write(g_scl_pin, 0);
+    for (uint8_t bit = 0; bit < 8; bit++) {
+        write_bit(t, byte & 0x80);
+        byte <<= 1;
+    }
+    return !read_bit(t) && !t->timeout;
 }
 
-// Actively drive SDA signal low
-static inline void clear_sda(void)
+static inline __attribute__((always_inline)) uint8_t read_byte(i2c_timing_t *t, bool ack)
 {
-    gpio_write(g_sda_pin, 0);
+    uint8_t byte = 0;
+    for (uint8_t bit = 0; bit < 8; bit++)
+        byte = (byte << 1) | read_bit(t);
+    write_bit(t, ack);
+    return byte;
 }
 
 // Output start condition
-void i2c_start(void)
+static void start_cond(i2c_bus_t *b, i2c_timing_t *t)
 {
-    uint32_t clk_stretch = CLK_STRETCH;
-    freq = sdk_system_get_cpu_freq();
-    if (started) { // if started, do a restart cond
+    if (b->cpu_mhz != sdk_system_get_cpu_freq()) {
+        update_timing(b);
+        t->half = b->timing.half;
+        t->stretch = b->timing.stretch;
+    }
+    if (b->started) { // if started, do a restart cond
         // Set SDA to 1
-        (void) read_sda();
-        i2c_delay();
-        while (read_scl() == 0 && clk_stretch--) ;
-        // Repeated start setup time, minimum 4.7us
-        i2c_delay();
+        GPIO.OUT_SET = t->sda;
+        wait_edge(t, t->half);
+        release_scl(t);
+        // Repeated start setup time
+        wait_edge(t, t->half);
+    } else {
+        t->edge = get_ccount();
     }
-    started = true;
-    if (read_sda() == 0) {
+    b->started = true;
+    if (!(GPIO.IN & t->sda)) {
         debug("arbitration lost in i2c_start");
+        t->lost = true;
     }
     // SCL is high, set SDA from 1 to 0.
-    clear_sda();
-    i2c_delay();
-    clear_scl();
+    GPIO.OUT_CLEAR = t->sda;
+    t->edge = get_ccount();
+    clear_scl(t);
 }
 
 // Output stop condition
-bool i2c_stop(void)
+static bool stop_cond(i2c_bus_t *b, i2c_timing_t *t)
 {
-    uint32_t clk_stretch = CLK_STRETCH;
     // Set SDA to 0
-    clear_sda();
-    i2c_delay();
+    GPIO.OUT_CLEAR = t->sda;
+    wait_edge(t, t->half);
     // Clock stretching
-    while (read_scl() == 0 && clk_stretch--) ;
-    // Stop bit setup time, minimum 4us
-    i2c_delay();
+    release_scl(t);
+    // Stop bit setup time
+    wait_edge(t, t->half);
     // SCL is high, set SDA from 0 to 1
-    if (read_sda() == 0) {
+    GPIO.OUT_SET = t->sda;
+    t->edge = get_ccount();
+    // Bus free time before the next start
+    wait_edge(t, t->half);
+    if (!(GPIO.IN & t->sda)) {
         debug("arbitration lost in i2c_stop");
+        t->lost = true;
     }
-    i2c_delay();
-    if (!started) {
+    if (!b->started) {
         debug("link was break!");
         return false ; //If bus was stop in other way, the current transmission Failed
     }
-    started = false;
+    b->started = false;
     return true;
 }
 
-// Write a bit to I2C bus
-static void i2c_write_bit(bool bit)
+void i2c_bus_start(uint8_t bus)
 {
-    uint32_t clk_stretch = CLK_STRETCH;
-    if (bit) {
-        (void) read_sda();
-    } else {
-        clear_sda();
-    }
-    i2c_delay();
-    // Clock stretching
-    while (read_scl() == 0 && clk_stretch--) ;
-    // SCL is high, now data is valid
-    // If SDA is high, check that nobody else is driving SDA
-    if (bit && read_sda() == 0) {
-        debug("arbitration lost in i2c_write_bit");
-    }
-    i2c_delay();
-    clear_scl();
+    start_cond(&buses[bus], &buses[bus].timing);
 }
 
-// Read a bit from I2C bus
-static bool i2c_read_bit(void)
+void i2c_start(void)
 {
-    uint32_t clk_stretch = CLK_STRETCH;
-    bool bit;
-    // Let the slave drive data
-    (void) read_sda();
-    i2c_delay();
-    // Clock stretching
-    while (read_scl() == 0 && clk_stretch--) ;
-    // SCL is high, now data is valid
-    bit = read_sda();
-    i2c_delay();
-    clear_scl();
-    return bit;
+    i2c_bus_start(0);
+}
+
+bool i2c_bus_stop(uint8_t bus)
+{
+    return stop_cond(&buses[bus], &buses[bus].timing);
+}
+
+bool i2c_stop(void)
+{
+    return i2c_bus_stop(0);
+}
+
+bool i2c_bus_write(uint8_t bus, uint8_t byte)
+{
+    i2c_timing_t *t = &buses[bus].timing;
+    t->timeout = false;
+    return write_byte(t, byte);
 }
 
 bool i2c_write(uint8_t byte)
 {
-    bool nack;
-    uint8_t bit;
-    for (bit = 0; bit < 8; bit++) {
-        i2c_write_bit((byte & 0x80) != 0);
-        byte <<= 1;
-    }
-    nack = i2c_read_bit();
-    return !nack;
+    return i2c_bus_write(0, byte);
+}
+
+uint8_t i2c_bus_read(uint8_t bus, bool ack)
+{
+    return read_byte(&buses[bus].timing, ack);
 }
 
 uint8_t i2c_read(bool ack)
 {
-    uint8_t byte = 0;
-    uint8_t bit;
-    for (bit = 0; bit < 8; bit++) {
-        byte = (byte << 1) | i2c_read_bit();
-    }
-    i2c_write_bit(ack);
-    return byte;
+    return i2c_bus_read(0, ack);
+}
+
+void i2c_bus_force(uint8_t bus, bool state)
+{
+    buses[bus].force = state ;
 }
 
 void i2c_force_bus(bool state)
 {
-    force = state ;
+    i2c_bus_force(0, state);
 }
 
-static int i2c_bus_test()
+// Locking is skipped before the scheduler runs, e.g. for drivers set up in
+// user_init
+static inline bool can_lock(void)
 {
-    taskENTER_CRITICAL(); // To prevent task swaping after checking flag and before set it!
-    bool status = flag ; // get current status
-    if(force)
-    {
-        flag = true ; // force bus on
-        taskEXIT_CRITICAL();
-        if(status)
-           i2c_stop(); //Bus was busy, stop it.
+    return xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED;
+}
+
+void i2c_bus_lock(uint8_t bus)
+{
+    i2c_bus_t *b = &buses[bus];
+
+    if (!can_lock())
+        return;
+    if (b->owner == xTaskGetCurrentTaskHandle()) {
+        b->depth++;
+        return;
     }
-    else
-    {
-        if (status)
-        {
-            taskEXIT_CRITICAL();
-            debug("busy");
-            taskYIELD(); // If bus busy, change task to try finish last com.
-            return -EBUSY ;  // If bus busy, inform user
-        }
-        else
-        {
-            flag = true ; // Set Bus busy
-            taskEXIT_CRITICAL();
+    xSemaphoreTake(b->lock, portMAX_DELAY);
+    b->owner = xTaskGetCurrentTaskHandle();
+    b->depth = 1;
+}
+
+void i2c_bus_unlock(uint8_t bus)
+{
+    i2c_bus_t *b = &buses[bus];
+
+    if (!can_lock() || b->owner != xTaskGetCurrentTaskHandle())
+        return;
+    if (--b->depth == 0) {
+        b->owner = NULL;
+        xSemaphoreGive(b->lock);
+    }
+}
+
+// Get the bus for a transaction. Sets 'locked' if the lock was taken and
+// has to be released with i2c_bus_release.
+static int i2c_bus_acquire(uint8_t bus, bool *locked)
+{
+    *locked = false;
+    if (bus >= I2C_MAX_BUS || !buses[bus].inited)
+        return -EINVAL;
+
+    i2c_bus_t *b = &buses[bus];
+
+    if (b->force) {
+        // Don't wait for the current transmission, cancel it
+        if (can_lock() && b->owner != xTaskGetCurrentTaskHandle()
+                && xSemaphoreTake(b->lock, 0)) {
+            b->owner = xTaskGetCurrentTaskHandle();
+            b->depth = 1;
+            *locked = true;
         }
+        taskENTER_CRITICAL();
+        bool status = b->flag ; // get current status
+        b->flag = true ; // force bus on
+        taskEXIT_CRITICAL();
+        if (status)
+            i2c_bus_stop(bus); //Bus was busy, stop it.
+        return 0;
+    }
+
+    if (can_lock() && b->owner != xTaskGetCurrentTaskHandle()) {
+        i2c_bus_lock(bus);
+        *locked = true;
     }
-    return 0 ;
+    b->flag = true ; // Set Bus busy
+    return 0;
 }
 
-int i2c_slave_write(uint8_t slave_addr, const uint8_t *data, const uint8_t *buf, uint32_t len)
+static void i2c_bus_release(uint8_t bus, bool locked)
+{
+    buses[bus].flag = false ; // Bus free
+    if (locked)
+        i2c_bus_unlock(bus);
+}
+
+// Account a finished transaction in the bus statistics and give the bus back
+static int i2c_bus_finish(uint8_t bus, const i2c_timing_t *t, uint32_t start,
+                          uint32_t bytes, bool ok, bool locked)
+{
+    i2c_bus_t *b = &buses[bus];
+
+    b->timing = *t;
+    b->transactions++;
+    b->bytes += bytes;
+    b->cycles += get_ccount() - start;
+    if (t->timeout)
+        b->stretch_timeouts++;
+    if (t->lost)
+        b->arbitration_lost++;
+    if (!ok)
+        b->errors++;
+    i2c_bus_release(bus, locked);
+    if (ok)
+        return 0;
+
+    debug("Transaction Error");
+    return t->timeout ? -ETIMEDOUT : -EIO;
+}
+
+// Transactions work on a local copy of the timing, the byte loops are
+// inlined so a burst runs without any call between bytes.
+int i2c_bus_slave_write(uint8_t bus, uint8_t slave_addr, const uint8_t *data, const uint8_t *buf, uint32_t len)
 {
-    if(i2c_bus_test())
-        return -EBUSY ;
-    i2c_start();
-    if (!i2c_write(slave_addr << 1))
-        goto error;
-    if(data != NULL)
-        if (!i2c_write(*data))
-            goto error;
+    bool locked;
+    int err = i2c_bus_acquire(bus, &locked);
+    if (err)
+        return err;
+
+    i2c_bus_t *b = &buses[bus];
+    i2c_timing_t t = b->timing;
+    uint32_t start = get_ccount();
+    uint32_t bytes = 0;
+    bool ok = false;
+
+    t.timeout = false;
+    t.lost = false;
+    start_cond(b, &t);
+    if (!write_byte(&t, slave_addr << 1))
+        goto done;
+    bytes++;
+    if (data != NULL) {
+        if (!write_byte(&t, *data))
+            goto done;
+        bytes++;
+    }
     while (len--) {
-        if (!i2c_write(*buf++))
-            goto error;
+        if (!write_byte(&t, *buf++))
+            goto done;
+        bytes++;
     }
-    if (!i2c_stop())
-        goto error;
-    flag = false ; // Bus free
-    return 0;
+    ok = true;
 
-    error:
-    debug("Write Error");
-    i2c_stop();
-    flag = false ; // Bus free
-    return -EIO;
+    done:
+    ok = stop_cond(b, &t) && ok;
+    return i2c_bus_finish(bus, &t, start, bytes, ok, locked);
 }
 
-int i2c_slave_read(uint8_t slave_addr, const uint8_t *data, uint8_t *buf, uint32_t len)
+int i2c_slave_write(uint8_t slave_addr, const uint8_t *data, const uint8_t *buf, uint32_t len)
+{
+    return i2c_bus_slave_write(0, slave_addr, data, buf, len);
+}
+
+int i2c_bus_slave_read(uint8_t bus, uint8_t slave_addr, const uint8_t *data, uint8_t *buf, uint32_t len)
 {
-    if(i2c_bus_test())
-        return -EBUSY ;
+    bool locked;
+    int err = i2c_bus_acquire(bus, &locked);
+    if (err)
+        return err;
+
+    i2c_bus_t *b = &buses[bus];
+    i2c_timing_t t = b->timing;
+    uint32_t start = get_ccount();
+    uint32_t bytes = 0;
+    bool ok = false;
+
+    t.timeout = false;
+    t.lost = false;
     if(data != NULL) {
-        i2c_start();
-        if (!i2c_write(slave_addr << 1))
-            goto error;
-        if (!i2c_write(*data))
-            goto error;
-        if (!i2c_stop())
-            goto error;
-    }
-    i2c_start();
-    if (!i2c_write(slave_addr << 1 | 1)) // Slave address + read
-        goto error;
-    while(len) {
-        *buf = i2c_read(len == 1);
-        buf++;
-        len--;
+        start_cond(b, &t);
+        if (!write_byte(&t, slave_addr << 1))
+            goto done;
+        if (!write_byte(&t, *data))
+            goto done;
+        bytes += 2;
+        if (!stop_cond(b, &t))
+            goto done;
     }
-    if (!i2c_stop())
-        goto error;
-    flag = false ; // Bus free
-    return 0;
+    start_cond(b, &t);
+    if (!write_byte(&t, slave_addr << 1 | 1)) // Slave address + read
+        goto done;
+    bytes++;
+    for (uint32_t i = 0; i < len; i++)
+        buf[i] = read_byte(&t, i == len - 1);
+    bytes += len;
+    ok = !t.timeout;
+
+    done:
+    ok = stop_cond(b, &t) && ok;
+    return i2c_bus_finish(bus, &t, start, bytes, ok, locked);
+}
+
+int i2c_slave_read(uint8_t slave_addr, const uint8_t *data, uint8_t *buf, uint32_t len)
+{
+    return i2c_bus_slave_read(0, slave_addr, data, buf, len);
+}
+
+void i2c_bus_get_stats(uint8_t bus, i2c_stats_t *stats)
+{
+    i2c_bus_t *b = &buses[bus];
+
+    taskENTER_CRITICAL();
+    uint64_t cycles = b->cycles;
+    stats->transactions = b->transactions;
+    stats->errors = b->errors;
+    stats->stretch_timeouts = b->stretch_timeouts;
+    stats->arbitration_lost = b->arbitration_lost;
+    stats->bytes = b->bytes;
+    taskEXIT_CRITICAL();
+
+    uint32_t mhz = b->cpu_mhz ? b->cpu_mhz : sdk_system_get_cpu_freq();
+    stats->busy_us = cycles / mhz;
+    stats->bytes_per_sec = cycles ? (uint64_t)stats->bytes * mhz * 1000000 / cycles : 0;
+    stats->scl_freq = b->inited ? i2c_bus_get_frequency(bus) : 0;
+}
+
+void i2c_bus_reset_stats(uint8_t bus)
+{
+    i2c_bus_t *b = &buses[bus];
 
-    error:
-    debug("Read Error");
-    i2c_stop();
-    flag = false ; // Bus free
-    return -EIO;
+    taskENTER_CRITICAL();
+    b->transactions = 0;
+    b->errors = 0;
+    b->stretch_timeouts = 0;
+    b->arbitration_lost = 0;
+    b->bytes = 0;
+    b->cycles = 0;
+    taskEXIT_CRITICAL();
 }
@@ -30,6 +30,7 @@
 #include <errno.h>
 #include <FreeRTOS.h>
 #include <task.h>
+#include <semphr.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -37,41 +38,124 @@ extern "C" {
 
 
 /*
- *  Some bit can be transmit slower.
- *  Selected frequency fix the speed of a bit transmission
- *  I2C lib take the maximum frequency defined
+ *  Bus frequencies are given in Hz. The bit timing is measured with the CPU
+ *  cycle counter, so any frequency up to I2C_FREQ_MAX can be used at both
+ *  CPU frequencies. The frequency actually used is rounded to a whole number
+ *  of CPU cycles per half period, see i2c_bus_get_frequency.
  *  Don't change frequency when I2C transaction had begin
  */
 
 #ifdef I2C_FREQUENCY_500K
-#define I2C_CUSTOM_DELAY_160MHZ   6
-#define I2C_CUSTOM_DELAY_80MHZ    1   //Sry, maximum is 320kHz at 80MHz
+#define I2C_DEFAULT_FREQ          I2C_FREQ_500K
 #elif defined(I2C_FREQUENCY_400K)
-#define I2C_CUSTOM_DELAY_160MHZ   10
-#define I2C_CUSTOM_DELAY_80MHZ    1   //Sry, maximum is 320kHz at 80MHz
+#define I2C_DEFAULT_FREQ          I2C_FREQ_400K
 #else
-#define I2C_CUSTOM_DELAY_160MHZ   100
-#define I2C_CUSTOM_DELAY_80MHZ    20
+#define I2C_DEFAULT_FREQ          I2C_FREQ_100K
 #endif
 
+/* Number of independent I2C buses */
+#ifndef I2C_MAX_BUS
+#define I2C_MAX_BUS               2
+#endif
+
+/* Highest supported SCL frequency in Hz. Above this the code between two
+ * edges gets longer than half a period at 80MHz. */
+#ifndef I2C_FREQ_MAX
+#define I2C_FREQ_MAX              1000000
+#endif
+
+/* Default time in microseconds a slave may hold SCL low (clock stretching)
+ * before the transaction fails with -ETIMEDOUT */
+#ifndef I2C_CLK_STRETCH_TIMEOUT
+#define I2C_CLK_STRETCH_TIMEOUT   1000
+#endif
+
+typedef enum {
+    I2C_FREQ_100K = 100000,
+    I2C_FREQ_400K = 400000,
+    I2C_FREQ_500K = 500000,
+    I2C_FREQ_1000K = 1000000, // Fast-mode Plus
+} i2c_freq_t;
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t errors;
+    uint32_t stretch_timeouts;
+    uint32_t arbitration_lost;
+    uint32_t bytes;           // bytes on the bus, address bytes included
+    uint32_t busy_us;         // time spent in transactions
+    uint32_t bytes_per_sec;   // throughput achieved while busy
+    uint32_t scl_freq;        // SCL frequency in Hz
+} i2c_stats_t;
+
 // I2C driver for ESP8266 written for use with esp-open-rtos
 // Based on https://en.wikipedia.org/wiki/I²C#Example_of_bit-banging_the_I.C2.B2C_Master_protocol
-// With calling overhead, we end up at ~320kbit/s
+// SCL edges are timed against CCOUNT, supporting clock stretching and up to
+// 1MHz. Pins have to be GPIO0 to GPIO15.
+//
+// Several buses can be used at the same time, each one with its own pins,
+// frequency and lock. Functions without a bus argument use bus 0.
 
 //Level 0 API
 
 /**
  * Init bitbanging I2C driver on given pins
+ * @param bus Bus number (0 to I2C_MAX_BUS - 1)
+ * @param scl_pin SCL pin for I2C
+ * @param sda_pin SDA pin for I2C
+ * @param freq Bus frequency in Hz
+ * @return Non-Zero if the bus number or a pin is invalid or out of memory
+ */
+int i2c_bus_init(uint8_t bus, uint8_t scl_pin, uint8_t sda_pin, uint32_t freq);
+
+/**
+ * Init bitbanging I2C driver on given pins as bus 0
  * @param scl_pin SCL pin for I2C
  * @param sda_pin SDA pin for I2C
  */
 void i2c_init(uint8_t scl_pin, uint8_t sda_pin);
 
+/**
+ * Change the frequency of a bus.
+ * @param bus Bus number
+ * @param freq Bus frequency in Hz, up to I2C_FREQ_MAX
+ */
+void i2c_bus_set_frequency(uint8_t bus, uint32_t freq);
+
+/**
+ * Get the SCL frequency a bus runs at.
+ * @param bus Bus number
+ * @return Frequency in Hz, the requested one rounded to CPU cycles
+ */
+uint32_t i2c_bus_get_frequency(uint8_t bus);
+
+/**
+ * Set how long a slave may stretch the clock.
+ * @param bus Bus number
+ * @param timeout_us Timeout in microseconds
+ */
+void i2c_bus_set_clock_stretch(uint8_t bus, uint32_t timeout_us);
+
+/**
+ * Take exclusive use of a bus, to run several transactions or level 0
+ * operations without other tasks interleaving. Transactions of the locking
+ * task don't wait for the lock. Can be nested.
+ * @param bus Bus number
+ */
+void i2c_bus_lock(uint8_t bus);
+
+/**
+ * Release a bus locked with i2c_bus_lock.
+ * @param bus Bus number
+ */
+void i2c_bus_unlock(uint8_t bus);
+
 /**
  * Write a byte to I2C bus.
  * @param byte Pointer to device descriptor
  * @return true if slave acked
  */
+bool i2c_bus_write(uint8_t bus, uint8_t byte);
 bool i2c_write(uint8_t byte);
 
 /**
@@ -79,23 +163,27 @@ bool i2c_write(uint8_t byte);
  * @param ack Set Ack for slave (false: Ack // true: NoAck)
  * @return byte read from slave.
  */
+uint8_t i2c_bus_read(uint8_t bus, bool ack);
 uint8_t i2c_read(bool ack);
 
 /**
  * Send start or restart condition
  */
+void i2c_bus_start(uint8_t bus);
 void i2c_start(void);
 
 /**
  * Send stop condition
  * @return false if link was broken
  */
+bool i2c_bus_stop(uint8_t bus);
 bool i2c_stop(void);
 
 /**
  * get status from I2C bus.
  * @return true if busy.
  */
+bool i2c_bus_status(uint8_t bus);
 bool i2c_status(void);
 
 //Level 1 API (Don't need functions above)
@@ -105,29 +193,59 @@ bool i2c_status(void);
  * Warning: Use with precaution. Don't use it if you can avoid it. Usefull for priority transmission.
  * @param state Force the next I2C transmission if true (Use with precaution)
  */
+void i2c_bus_force(uint8_t bus, bool state);
 void i2c_force_bus(bool state);
 
 /**
  * Write 'len' bytes from 'buf' to slave at 'data' register adress .
+ * Waits until no other task uses the bus.
+ * @param bus Bus number
  * @param slave_addr slave device address
  * @param data Pointer to register address to send if non-null
  * @param buf Pointer to data buffer
  * @param len Number of byte to send
- * @return Non-Zero if error occured
+ * @return Non-Zero if error occured, -ETIMEDOUT if the clock was stretched
+ *         for too long
+ */
+int i2c_bus_slave_write(uint8_t bus, uint8_t slave_addr, const uint8_t *data, const uint8_t *buf, uint32_t len);
+
+/**
+ * Same as i2c_bus_slave_write on bus 0.
  */
 int i2c_slave_write(uint8_t slave_addr, const uint8_t *data, const uint8_t *buf, uint32_t len);
 
 /**
  * Issue a send operation of 'data' register adress, followed by reading 'len' bytes
  * from slave into 'buf'.
+ * Waits until no other task uses the bus.
+ * @param bus Bus number
  * @param slave_addr slave device address
  * @param data Pointer to register address to send if non-null
  * @param buf Pointer to data buffer
  * @param len Number of byte to read
- * @return Non-Zero if error occured
+ * @return Non-Zero if error occured, -ETIMEDOUT if the clock was stretched
+ *         for too long
+ */
+int i2c_bus_slave_read(uint8_t bus, uint8_t slave_addr, const uint8_t *data, uint8_t *buf, uint32_t len);
+
+/**
+ * Same as i2c_bus_slave_read on bus 0.
  */
 int i2c_slave_read(uint8_t slave_addr, const uint8_t *data, uint8_t *buf, uint32_t len);
 
+/**
+ * Get the statistics of the level 1 transactions on a bus.
+ * @param bus Bus number
+ * @param stats Filled with the counters and the achieved throughput
+ */
+void i2c_bus_get_stats(uint8_t bus, i2c_stats_t *stats);
+
+/**
+ * Clear the statistics of a bus.
+ * @param bus Bus number
+ */
+void i2c_bus_reset_stats(uint8_t bus);
+
 #ifdef	__cplusplus
 }
 #endif
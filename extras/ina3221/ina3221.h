@@ -132,6 +132,7 @@ typedef union
  *  Device description
  */
 typedef struct {
+    const uint8_t bus; // I2C bus number
     const uint8_t addr; // ina3221 I2C address
     const uint16_t shunt[BUS_NUMBER]; //Memory of shunt value  (mOhm)
     ina3221_config_t config; //Memory of ina3221 config
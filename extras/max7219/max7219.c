@@ -45,6 +45,13 @@ static const spi_settings_t bus_settings = {
     .endianness   = SPI_BIG_ENDIAN
 };
 
+static inline void spi_device(const max7219_display_t *disp, spi_device_t *spi)
+{
+    spi->bus = SPI_BUS;
+    spi->cs_pin = disp->cs_pin;
+    spi->settings = bus_settings;
+}
+
 static void send(const max7219_display_t *disp, uint8_t chip, uint16_t value)
 {
     uint16_t buf[MAX7219_MAX_CASCADE_SIZE] = { 0 };
@@ -55,15 +62,9 @@ static void send(const max7219_display_t *disp, uint8_t chip, uint16_t value)
     }
     else buf[chip] = value;
 
-    spi_settings_t old_settings;
-    spi_get_settings(SPI_BUS, &old_settings);
-    spi_set_settings(SPI_BUS, &bus_settings);
-    gpio_write(disp->cs_pin, false);
-
-    spi_transfer(SPI_BUS, buf, NULL, disp->cascade_size, SPI_16BIT);
-
-    gpio_write(disp->cs_pin, true);
-    spi_set_settings(SPI_BUS, &old_settings);
+    spi_device_t spi;
+    spi_device(disp, &spi);
+    spi_device_transfer(&spi, buf, NULL, disp->cascade_size, SPI_16BIT);
 }
 
 bool max7219_init(max7219_display_t *disp)
@@ -81,8 +82,13 @@ bool max7219_init(max7219_display_t *disp)
         return false;
     }
 
-    gpio_enable(disp->cs_pin, GPIO_OUTPUT);
-    gpio_write(disp->cs_pin, true);
+    spi_device_t spi;
+    spi_device(disp, &spi);
+    if (!spi_device_init(&spi))
+    {
+        debug("Cannot init SPI device");
+        return false;
+    }
 
     // Shutdown all chips
     max7219_set_shutdown_mode(disp, true);
@@ -60,6 +60,7 @@ typedef struct
  */
 typedef struct
 {
+    uint8_t bus;                            //!< I2C bus number
     uint8_t addr;                           //!< I2C address
     ms561101ba03_osr_t osr;                 //!< Oversampling setting
     ms561101ba03_config_data_t config_data; //!< Device configuration, filled upon initalize
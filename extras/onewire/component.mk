@@ -7,4 +7,10 @@ INC_DIRS += $(onewire_ROOT)..
 onewire_INC_DIR =
 onewire_SRC_DIR = $(onewire_ROOT)
 
+# Generate the time slots from the FRC1 timer interrupt instead of
+# bit-banging them, see onewire.h. Conflicts with extras/pwm.
+ONEWIRE_HW_TIMER ?= 0
+
+onewire_CFLAGS = -DONEWIRE_HW_TIMER=$(ONEWIRE_HW_TIMER) $(CFLAGS)
+
 $(eval $(call component_compile_rules,onewire))
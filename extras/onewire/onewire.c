@@ -2,6 +2,11 @@
 #include "string.h"
 #include "task.h"
 #include "esp/gpio.h"
+#if ONEWIRE_HW_TIMER
+#include "semphr.h"
+#include "esp/timer.h"
+#include "espressif/esp_system.h"
+#endif
 
 #define ONEWIRE_SELECT_ROM 0x55
 #define ONEWIRE_SKIP_ROM   0xcc
@@ -23,6 +28,8 @@ static inline bool _onewire_wait_for_bus(int pin, int max_wait) {
     return state;
 }
 
+#if !ONEWIRE_HW_TIMER
+
 // Perform the onewire reset function.  We will wait up to 250uS for
 // the bus to come high, if it doesn't then it is broken or shorted
 // and we return false;
@@ -146,6 +153,372 @@ bool onewire_read_bytes(int pin, uint8_t *buf, size_t count) {
     return true;
 }
 
+static bool _onewire_last_ok;
+
+static bool _onewire_transfer(int pin, const uint8_t *out, size_t out_count, uint8_t *in, size_t in_count, uint8_t flags) {
+    bool ok;
+
+    if ((flags & ONEWIRE_TRANSFER_RESET) && !onewire_reset(pin)) {
+        return false;
+    }
+    if ((flags & ONEWIRE_TRANSFER_POWER) && !in_count) {
+        // Power must be applied within 10us after the last bit
+        if (out_count && !onewire_write_bytes(pin, out, out_count - 1)) {
+            return false;
+        }
+        taskENTER_CRITICAL();
+        ok = (!out_count || onewire_write(pin, out[out_count - 1])) && onewire_power(pin);
+        taskEXIT_CRITICAL();
+        return ok;
+    }
+    if (!onewire_write_bytes(pin, out, out_count)) {
+        return false;
+    }
+    return onewire_read_bytes(pin, in, in_count);
+}
+
+// Without a timer to generate the slots the transfer completes right away.
+bool onewire_transfer_async(int pin, const uint8_t *out, size_t out_count, uint8_t *in, size_t in_count, uint8_t flags, onewire_done_cb_t cb, void *arg) {
+    _onewire_last_ok = _onewire_transfer(pin, out, out_count, in, in_count, flags);
+    if (cb) {
+        cb(pin, _onewire_last_ok, arg);
+    }
+    return true;
+}
+
+bool onewire_transfer_wait(TickType_t timeout) {
+    return _onewire_last_ok;
+}
+
+bool onewire_transfer(int pin, const uint8_t *out, size_t out_count, uint8_t *in, size_t in_count, uint8_t flags) {
+    return _onewire_transfer(pin, out, out_count, in, in_count, flags);
+}
+
+#else /* ONEWIRE_HW_TIMER */
+
+// FRC1 runs at 80MHz / 16, 5 ticks per microsecond
+#define ONEWIRE_TIMER_US(us) ((us) * 5)
+
+typedef enum {
+    _PHASE_RESET_START,
+    _PHASE_RESET_RELEASE,
+    _PHASE_RESET_SAMPLE,
+    _PHASE_RESET_DONE,
+    _PHASE_SLOT,
+    _PHASE_RELEASE,
+} _onewire_phase_t;
+
+// The transfer being generated by the timer interrupt. Bits are sent and
+// received LSB first, `pos` counts the write bits followed by the read bits.
+typedef struct {
+    volatile bool busy;
+    volatile bool ok;
+    uint8_t pin;
+    uint8_t flags;
+    uint8_t phase;
+    bool presence;
+    const uint8_t *out;
+    uint8_t *in;
+    size_t out_bits;
+    size_t in_bits;
+    size_t pos;
+    onewire_done_cb_t cb;
+    void *arg;
+} _onewire_job_t;
+
+static _onewire_job_t _job;
+static SemaphoreHandle_t _lock;  // serializes the blocking functions
+static SemaphoreHandle_t _done;  // given when a transfer (chain) finishes
+static bool _in_callback;
+
+static inline bool _can_block(void) {
+    return xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED;
+}
+
+static bool _onewire_engine_init(void) {
+    if (_lock) return true;
+
+    SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    if (lock && done) {
+        // Another task may create them meanwhile, keep the first ones
+        taskENTER_CRITICAL();
+        if (!_lock) {
+            _done = done;
+            _lock = lock;
+            lock = done = NULL;
+        }
+        taskEXIT_CRITICAL();
+    }
+    if (lock) vSemaphoreDelete(lock);
+    if (done) vSemaphoreDelete(done);
+    return _lock != NULL;
+}
+
+static void IRAM _onewire_finish(bool ok) {
+    timer_set_interrupts(FRC1, false);
+    timer_set_run(FRC1, false);
+    _job.ok = ok;
+    _job.busy = false;
+    if (_job.cb) {
+        // The callback may start the next transfer of a chain
+        _in_callback = true;
+        _job.cb(_job.pin, ok, _job.arg);
+        _in_callback = false;
+    }
+    if (!_job.busy && _done) {
+        BaseType_t task_woken = pdFALSE;
+        xSemaphoreGiveFromISR(_done, &task_woken);
+        portEND_SWITCHING_ISR(task_woken);
+    }
+}
+
+// Drive the bus high right after the last written bit, if requested.
+static bool IRAM _onewire_power_now(void) {
+    if (!(_job.flags & ONEWIRE_TRANSFER_POWER) || _job.in_bits || _job.pos < _job.out_bits) {
+        return false;
+    }
+    gpio_enable(_job.pin, GPIO_OUTPUT);
+    gpio_write(_job.pin, 1);
+    _onewire_finish(true);
+    return true;
+}
+
+// Start the next time slot. Only the parts that must be accurate to a few
+// microseconds are timed with delays, the rest of the slot is left to the
+// timer. Returns the time to the next timer event in microseconds, or 0 if
+// the transfer has finished.
+static uint32_t IRAM _onewire_slot(uint8_t pin) {
+    size_t pos = _job.pos;
+
+    if (pos >= _job.out_bits + _job.in_bits) {
+        if (!_onewire_power_now()) {
+            _onewire_finish(true);
+        }
+        return 0;
+    }
+    // The previous slot must have ended with the bus released
+    if (!gpio_read(pin)) {
+        _onewire_finish(false);
+        return 0;
+    }
+    _job.pos = pos + 1;
+    _job.phase = _PHASE_SLOT;
+
+    if (pos < _job.out_bits) {
+        if (_job.out[pos >> 3] & BIT(pos & 7)) {
+            gpio_write(pin, 0);  // drive output low
+            sdk_os_delay_us(10);
+            gpio_write(pin, 1);  // allow output high
+            if (_onewire_power_now()) return 0;
+            return 55;
+        }
+        gpio_write(pin, 0);  // drive output low, released by the next event
+        _job.phase = _PHASE_RELEASE;
+        return 65;
+    }
+
+    pos -= _job.out_bits;
+    gpio_write(pin, 0);
+    sdk_os_delay_us(2);
+    gpio_write(pin, 1);  // let pin float, pull up will raise
+    sdk_os_delay_us(11);
+    if (gpio_read(pin)) {  // Must sample within 15us of start
+        _job.in[pos >> 3] |= BIT(pos & 7);
+    } else {
+        _job.in[pos >> 3] &= ~BIT(pos & 7);
+    }
+    return 48;
+}
+
+static void IRAM _onewire_timer_isr(void) {
+    uint8_t pin = _job.pin;
+    uint32_t us;
+
+    switch (_job.phase) {
+    case _PHASE_RESET_START:
+        // The bus must be high before starting
+        if (!gpio_read(pin)) {
+            _onewire_finish(false);
+            return;
+        }
+        gpio_write(pin, 0);
+        _job.phase = _PHASE_RESET_RELEASE;
+        us = 480;
+        break;
+    case _PHASE_RESET_RELEASE:
+        gpio_write(pin, 1); // allow it to float
+        _job.phase = _PHASE_RESET_SAMPLE;
+        us = 70;
+        break;
+    case _PHASE_RESET_SAMPLE:
+        _job.presence = !gpio_read(pin);
+        _job.phase = _PHASE_RESET_DONE;
+        us = 410;
+        break;
+    case _PHASE_RESET_DONE:
+        // All devices must have finished pulling the bus low by now
+        if (!_job.presence || !gpio_read(pin)) {
+            _onewire_finish(false);
+            return;
+        }
+        us = _onewire_slot(pin);
+        break;
+    case _PHASE_RELEASE:
+        gpio_write(pin, 1); // allow output high
+        if (_onewire_power_now()) return;
+        _job.phase = _PHASE_SLOT;
+        us = 5;
+        break;
+    default:
+        us = _onewire_slot(pin);
+        break;
+    }
+    if (us) {
+        timer_set_load(FRC1, ONEWIRE_TIMER_US(us));
+    }
+}
+
+static bool _onewire_start(int pin, const uint8_t *out, size_t out_bits, uint8_t *in, size_t in_bits, uint8_t flags, onewire_done_cb_t cb, void *arg) {
+    uint32_t ps = _xt_disable_interrupts();
+    if (_job.busy) {
+        _xt_restore_interrupts(ps);
+        return false;
+    }
+    _job.busy = true;
+    _xt_restore_interrupts(ps);
+
+    if (_done && !_in_callback) {
+        // Drop the completion of a transfer nobody waited for
+        xSemaphoreTake(_done, 0);
+    }
+    _job.pin = pin;
+    _job.flags = flags;
+    _job.phase = (flags & ONEWIRE_TRANSFER_RESET) ? _PHASE_RESET_START : _PHASE_SLOT;
+    _job.out = out;
+    _job.in = in;
+    _job.out_bits = out_bits;
+    _job.in_bits = in_bits;
+    _job.pos = 0;
+    _job.cb = cb;
+    _job.arg = arg;
+
+    // Also depowers the bus
+    gpio_enable(pin, GPIO_OUT_OPEN_DRAIN);
+    gpio_write(pin, 1);
+
+    _xt_isr_attach(INUM_TIMER_FRC1, _onewire_timer_isr);
+    timer_set_divider(FRC1, TIMER_CLKDIV_16);
+    timer_set_reload(FRC1, false);
+    timer_set_load(FRC1, ONEWIRE_TIMER_US(5));
+    timer_set_interrupts(FRC1, true);
+    timer_set_run(FRC1, true);
+    return true;
+}
+
+static void _onewire_abort(void) {
+    uint32_t ps = _xt_disable_interrupts();
+    if (_job.busy) {
+        timer_set_interrupts(FRC1, false);
+        timer_set_run(FRC1, false);
+        gpio_write(_job.pin, 1);
+        _job.ok = false;
+        _job.busy = false;
+    }
+    _xt_restore_interrupts(ps);
+}
+
+// Generous upper bound for the duration of a transfer
+static TickType_t _onewire_timeout(size_t bits, uint8_t flags) {
+    uint32_t us = bits * 100 + ((flags & ONEWIRE_TRANSFER_RESET) ? 1000 : 0);
+    return us / 1000 / portTICK_PERIOD_MS + 2;
+}
+
+// Perform a transfer and wait for it, used by the blocking functions.
+static bool _onewire_run(int pin, const uint8_t *out, size_t out_bits, uint8_t *in, size_t in_bits, uint8_t flags) {
+    bool locked = _onewire_engine_init() && _can_block();
+    bool ok;
+
+    if (locked) {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+    }
+    while (!_onewire_start(pin, out, out_bits, in, in_bits, flags, NULL, NULL)) {
+        // An asynchronous transfer is still in progress
+        if (locked) vTaskDelay(1);
+    }
+    ok = onewire_transfer_wait(_onewire_timeout(out_bits + in_bits, flags));
+    if (locked) {
+        xSemaphoreGive(_lock);
+    }
+    return ok;
+}
+
+bool onewire_reset(int pin) {
+    return _onewire_run(pin, NULL, 0, NULL, 0, ONEWIRE_TRANSFER_RESET);
+}
+
+static bool _onewire_write_bit(int pin, bool v) {
+    uint8_t b = v;
+    return _onewire_run(pin, &b, 1, NULL, 0, 0);
+}
+
+static int _onewire_read_bit(int pin) {
+    uint8_t b;
+    if (!_onewire_run(pin, NULL, 0, &b, 1, 0)) return -1;
+    return b & 1;
+}
+
+bool onewire_write(int pin, uint8_t v) {
+    return _onewire_run(pin, &v, 8, NULL, 0, 0);
+}
+
+bool onewire_write_bytes(int pin, const uint8_t *buf, size_t count) {
+    return _onewire_run(pin, buf, count * 8, NULL, 0, 0);
+}
+
+int onewire_read(int pin) {
+    uint8_t b;
+    if (!_onewire_run(pin, NULL, 0, &b, 8, 0)) return -1;
+    return b;
+}
+
+bool onewire_read_bytes(int pin, uint8_t *buf, size_t count) {
+    return _onewire_run(pin, NULL, 0, buf, count * 8, 0);
+}
+
+bool onewire_transfer_async(int pin, const uint8_t *out, size_t out_count, uint8_t *in, size_t in_count, uint8_t flags, onewire_done_cb_t cb, void *arg) {
+    if (!_in_callback && !_onewire_engine_init()) {
+        return false;
+    }
+    return _onewire_start(pin, out, out_count * 8, in, in_count * 8, flags, cb, arg);
+}
+
+bool onewire_transfer(int pin, const uint8_t *out, size_t out_count, uint8_t *in, size_t in_count, uint8_t flags) {
+    return _onewire_run(pin, out, out_count * 8, in, in_count * 8, flags);
+}
+
+bool onewire_transfer_wait(TickType_t timeout) {
+    if (!_done || !_can_block()) {
+        uint32_t start = sdk_system_get_time();
+        while (_job.busy) {
+            if (sdk_system_get_time() - start > timeout * portTICK_PERIOD_MS * 1000) {
+                _onewire_abort();
+            }
+        }
+        return _job.ok;
+    }
+    if (xSemaphoreTake(_done, timeout) != pdTRUE) {
+        _onewire_abort();
+    }
+    return _job.ok;
+}
+
+#endif /* ONEWIRE_HW_TIMER */
+
+bool onewire_read_bytes_async(int pin, uint8_t *buf, size_t count, onewire_done_cb_t cb, void *arg) {
+    return onewire_transfer_async(pin, NULL, 0, buf, count, 0, cb, arg);
+}
+
 bool onewire_select(int pin, onewire_addr_t addr) {
     uint8_t i;
 
@@ -23,6 +23,17 @@ extern "C" {
 #define ONEWIRE_CRC8_TABLE 0
 #endif
 
+/** Generate the 1-Wire time slots from the FRC1 timer interrupt instead of
+ *  bit-banging them with busy-wait delays by setting this to 1 during
+ *  compilation.  Interrupts are then only masked for the short part of each
+ *  slot that needs microsecond accuracy and the CPU is free for other tasks
+ *  while a transfer is in progress.  The timer backend takes over FRC1, so it
+ *  cannot be used together with the pwm driver.
+ */
+#ifndef ONEWIRE_HW_TIMER
+#define ONEWIRE_HW_TIMER 0
+#endif
+
 /** Type used to hold all 1-Wire device ROM addresses (64-bit) */
 typedef uint64_t onewire_addr_t;
 
@@ -39,6 +50,22 @@ typedef struct {
  */
 #define ONEWIRE_NONE ((onewire_addr_t)(0xffffffffffffffffLL))
 
+/** Flags for onewire_transfer_async() */
+#define ONEWIRE_TRANSFER_RESET  0x01  ///< Perform a reset cycle first
+#define ONEWIRE_TRANSFER_POWER  0x02  ///< Drive the bus high after the last write
+
+/** Called when an asynchronous transfer has finished.
+ *
+ *  With the timer backend (::ONEWIRE_HW_TIMER) this is called from interrupt
+ *  context, otherwise from the task that started the transfer.
+ *
+ *  @param pin  The GPIO pin connected to the 1-Wire bus.
+ *  @param ok   `true` if the transfer completed successfully (and a device
+ *              answered the reset, if one was requested).
+ *  @param arg  The argument passed when starting the transfer.
+ */
+typedef void (*onewire_done_cb_t)(int pin, bool ok, void *arg);
+
 /** Perform a 1-Wire reset cycle.
  *
  *  @param pin  The GPIO pin connected to the 1-Wire bus.
@@ -115,6 +142,78 @@ int onewire_read(int pin);
  */
 bool onewire_read_bytes(int pin, uint8_t *buf, size_t count);
 
+/** Perform a complete 1-Wire transaction and wait for it.
+ *
+ *  Same transaction as onewire_transfer_async(), but the calling task keeps
+ *  the bus until it has finished, so transfers of several tasks don't get in
+ *  each other's way, and the result is that of this transfer.
+ *
+ *  @param pin        The GPIO pin connected to the 1-Wire bus.
+ *  @param out        Bytes to write, may be NULL if `out_count` is 0.
+ *  @param out_count  Number of bytes to write.
+ *  @param in         Buffer for the read bytes, may be NULL if `in_count` is 0.
+ *  @param in_count   Number of bytes to read.
+ *  @param flags      Combination of ONEWIRE_TRANSFER_* flags.
+ *
+ *  @returns `true` on success, `false` on error.
+ */
+bool onewire_transfer(int pin, const uint8_t *out, size_t out_count, uint8_t *in, size_t in_count, uint8_t flags);
+
+/** Start a complete 1-Wire transaction in the background.
+ *
+ *  Optionally performs a reset cycle, then writes `out_count` bytes from `out`
+ *  and reads `in_count` bytes into `in`.  With ::ONEWIRE_TRANSFER_POWER and no
+ *  read part the bus is actively driven high right after the last written bit
+ *  (see onewire_power()), as needed by parasitically-powered devices.
+ *
+ *  With the timer backend the function returns immediately and the slots are
+ *  generated from the FRC1 interrupt.  Only one transfer can be in progress at
+ *  a time.  Without it the transfer is performed before returning.  In both
+ *  cases `cb` (if not NULL) is called on completion and onewire_transfer_wait()
+ *  can be used to block the calling task until then.  Both buffers must stay
+ *  valid until the transfer has finished.
+ *
+ *  @param pin        The GPIO pin connected to the 1-Wire bus.
+ *  @param out        Bytes to write, may be NULL if `out_count` is 0.
+ *  @param out_count  Number of bytes to write.
+ *  @param in         Buffer for the read bytes, may be NULL if `in_count` is 0.
+ *  @param in_count   Number of bytes to read.
+ *  @param flags      Combination of ONEWIRE_TRANSFER_* flags.
+ *  @param cb         Completion callback, may be NULL.
+ *  @param arg        Argument passed to `cb`.
+ *
+ *  @returns `true` if the transfer was started, `false` if another transfer
+ *           is still in progress.
+ */
+bool onewire_transfer_async(int pin, const uint8_t *out, size_t out_count, uint8_t *in, size_t in_count, uint8_t flags, onewire_done_cb_t cb, void *arg);
+
+/** Start reading multiple bytes from a 1-Wire device in the background.
+ *
+ *  Same as onewire_transfer_async() with only a read part.
+ *
+ *  @param pin    The GPIO pin connected to the 1-Wire bus.
+ *  @param buf    A pointer to the buffer to contain the read bytes
+ *  @param count  Number of bytes to read
+ *  @param cb     Completion callback, may be NULL.
+ *  @param arg    Argument passed to `cb`.
+ *
+ *  @returns `true` if the transfer was started, `false` if another transfer
+ *           is still in progress.
+ */
+bool onewire_read_bytes_async(int pin, uint8_t *buf, size_t count, onewire_done_cb_t cb, void *arg);
+
+/** Wait for the last asynchronous transfer to finish.
+ *
+ *  The calling task sleeps while waiting.  A transfer that does not finish in
+ *  time is aborted.
+ *
+ *  @param timeout  Maximum time to wait, in RTOS ticks.
+ *
+ *  @returns `true` if the transfer completed successfully, `false` on error
+ *           or timeout.
+ */
+bool onewire_transfer_wait(TickType_t timeout);
+
 /** Actively drive the bus high to provide extra power for certain operations
  *  of parasitically-powered devices.
  *
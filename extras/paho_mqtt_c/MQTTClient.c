@@ -15,27 +15,44 @@
  *******************************************************************************/
 #include <espressif/esp_common.h>
 #include <lwip/arch.h>
+#include <string.h>
 #include "MQTTClient.h"
 
-static void new_message_data(mqtt_message_data_t* md, mqtt_string_t* aTopicName, mqtt_message_t* aMessgage) {
+static void new_message_data(mqtt_message_data_t* md, mqtt_string_t* aTopicName, mqtt_message_t* aMessgage,
+                             size_t offset, size_t total_len) {
     md->topic = aTopicName;
     md->message = aMessgage;
+    md->offset = offset;
+    md->total_len = total_len;
+}
+
+
+static struct mqtt_inflight* find_inflight(mqtt_client_t *c, unsigned short id)
+{
+    int i;
+    for (i = 0; i < c->window; ++i)
+        if (c->inflight[i].id == id)
+            return &c->inflight[i];
+    return NULL;
 }
 
 
 static int get_next_packet_id(mqtt_client_t *c) {
-    return c->next_packetid = (c->next_packetid == MQTT_MAX_PACKET_ID) ? 1 : c->next_packetid + 1;
+    do
+        c->next_packetid = (c->next_packetid == MQTT_MAX_PACKET_ID) ? 1 : c->next_packetid + 1;
+    while (c->inflight_count && find_inflight(c, c->next_packetid)); // still in use
+    return c->next_packetid;
 }
 
 
-static int send_packet(mqtt_client_t* c, int length, mqtt_timer_t* timer)
+static int send_buf(mqtt_client_t* c, unsigned char* buf, int length, mqtt_timer_t* timer)
 {
     int rc = MQTT_FAILURE,
         sent = 0;
 
     while (sent < length && !mqtt_timer_expired(timer))
     {
-        rc = c->ipstack->mqttwrite(c->ipstack, &c->buf[sent], length - sent, mqtt_timer_left_ms(timer));
+        rc = c->ipstack->mqttwrite(c->ipstack, &buf[sent], length - sent, mqtt_timer_left_ms(timer));
         if (rc < 0)  // there was an error writing the data
             break;
         sent += rc;
@@ -51,6 +68,57 @@ static int send_packet(mqtt_client_t* c, int length, mqtt_timer_t* timer)
 }
 
 
+static int send_packet(mqtt_client_t* c, int length, mqtt_timer_t* timer)
+{
+    return send_buf(c, c->buf, length, timer);
+}
+
+
+static unsigned char* inflight_packet(mqtt_client_t* c, struct mqtt_inflight* f)
+{
+    return c->outbox + (f - c->inflight) * c->outbox_slot;
+}
+
+
+// A pipelined publish got its last acknowledgement
+static void complete_inflight(mqtt_client_t* c, struct mqtt_inflight* f)
+{
+    unsigned short id = f->id;
+    f->id = 0;
+    c->inflight_count--;
+    c->fail_count = 0;
+    if (c->publishHandler)
+        c->publishHandler(id, MQTT_SUCCESS);
+}
+
+
+// Send the pipelined publishes again after a reconnect
+static int resend_inflight(mqtt_client_t* c, mqtt_timer_t* timer)
+{
+    int i, len, rc = MQTT_SUCCESS;
+
+    for (i = 0; i < c->window && rc == MQTT_SUCCESS; ++i)
+    {
+        struct mqtt_inflight* f = &c->inflight[i];
+        if (!f->id)
+            continue;
+        if (f->wait == MQTTPACKET_PUBCOMP) // the broker has the message, release it
+        {
+            if ((len = mqtt_serialize_ack(c->buf, c->buf_size, MQTTPACKET_PUBREL, 0, f->id)) <= 0)
+                return MQTT_FAILURE;
+            rc = send_packet(c, len, timer);
+        }
+        else
+        {
+            unsigned char* packet = inflight_packet(c, f);
+            packet[0] |= 0x08; // DUP
+            rc = send_buf(c, packet, f->len, timer);
+        }
+    }
+    return rc;
+}
+
+
 static int decode_packet(mqtt_client_t* c, int* value, int timeout)
 {
     unsigned char i;
@@ -81,95 +149,282 @@ exit:
 }
 
 
-// Return packet type. If no packet avilable, return FAILURE, or READ_ERROR if timeout
-static int read_packet(mqtt_client_t* c, mqtt_timer_t* timer)
+// Read and drop 'len' bytes of the current packet
+static int skip_bytes(mqtt_client_t* c, int len, mqtt_timer_t* timer)
+{
+    while (len > 0)
+    {
+        int n = len < c->readbuf_size ? len : c->readbuf_size;
+        if (c->ipstack->mqttread(c->ipstack, c->readbuf, n, mqtt_timer_left_ms(timer)) != n)
+            return MQTT_READ_ERROR;
+        len -= n;
+    }
+    return MQTT_SUCCESS;
+}
+
+
+// Read the variable header of a PUBLISH too big for readbuf, the payload is
+// left in the stream for stream_publish. Returns the payload length.
+static int read_publish_header(mqtt_client_t* c, int len, int rem_len, mqtt_timer_t* timer)
+{
+    mqtt_header_t header = {0};
+    unsigned char* topic_len = c->readbuf + len;
+    int hdr_len;
+
+    header.byte = c->readbuf[0];
+    if (rem_len < 2 || len + 2 > c->readbuf_size ||
+        c->ipstack->mqttread(c->ipstack, topic_len, 2, mqtt_timer_left_ms(timer)) != 2)
+        return MQTT_READ_ERROR;
+    hdr_len = 2 + (topic_len[0] << 8) + topic_len[1] + (header.bits.qos ? 2 : 0);
+    if (hdr_len > rem_len)
+        return MQTT_READ_ERROR;
+    if (len + hdr_len >= c->readbuf_size) // no room left for the payload
+    {
+        if (skip_bytes(c, rem_len - 2, timer) != MQTT_SUCCESS)
+            return MQTT_READ_ERROR;
+        return MQTT_BUFFER_OVERFLOW;
+    }
+    if (c->ipstack->mqttread(c->ipstack, topic_len + 2, hdr_len - 2, mqtt_timer_left_ms(timer)) != hdr_len - 2)
+        return MQTT_READ_ERROR;
+    return rem_len - hdr_len;
+}
+
+
+// Return packet type. If no packet avilable, return FAILURE, or READ_ERROR if timeout.
+// A PUBLISH too big for readbuf is read up to its payload, which is then
+// counted in 'stream_len' and has to be read with stream_publish.
+static int read_packet(mqtt_client_t* c, mqtt_timer_t* timer, int* stream_len)
 {
     int rc = MQTT_FAILURE;
     mqtt_header_t header = {0};
+    mqtt_timer_t packet_timer;
     int len = 0;
     int rem_len = 0;
 
+    *stream_len = 0;
     /* 1. read the header byte.  This has the packet type in it */
     if (c->ipstack->mqttread(c->ipstack, c->readbuf, 1, mqtt_timer_left_ms(timer)) != 1)
         goto exit;
+    /* the rest of the packet gets at least the command timeout, giving up
+       halfway would lose track of the packets in the stream */
+    mqtt_timer_init(&packet_timer);
+    mqtt_timer_countdown_ms(&packet_timer, c->command_timeout_ms);
+    if (mqtt_timer_left_ms(timer) > mqtt_timer_left_ms(&packet_timer))
+        packet_timer = *timer;
     len = 1;
+    header.byte = c->readbuf[0];
     /* 2. read the remaining length.  This is variable in itself */
-    len += decode_packet(c, &rem_len, mqtt_timer_left_ms(timer));
-    if (len <= 1 || len + rem_len > c->readbuf_size) /* if packet is too big to fit in our readbuf, abort */
+    len += decode_packet(c, &rem_len, mqtt_timer_left_ms(&packet_timer));
+    if (len <= 1 || len > c->readbuf_size)
     {
         rc = MQTT_READ_ERROR;
         goto exit;
     }
     mqtt_packet_encode(c->readbuf + 1, rem_len); /* put the original remaining length back into the buffer */
+    if (len + rem_len > c->readbuf_size) /* packet is too big to fit in our readbuf */
+    {
+        if (header.bits.type != MQTTPACKET_PUBLISH)
+        {
+            rc = skip_bytes(c, rem_len, &packet_timer);
+            if (rc == MQTT_SUCCESS)
+                rc = MQTT_BUFFER_OVERFLOW;
+            goto exit;
+        }
+        rc = read_publish_header(c, len, rem_len, &packet_timer);
+        if (rc < 0)
+            goto exit;
+        *stream_len = rc;
+        rc = header.bits.type;
+        goto exit;
+    }
     /* 3. read the rest of the buffer using a callback to supply the rest of the data */
-    if (rem_len > 0 && (c->ipstack->mqttread(c->ipstack, c->readbuf + len, rem_len, mqtt_timer_left_ms(timer)) != rem_len))
+    if (rem_len > 0 && (c->ipstack->mqttread(c->ipstack, c->readbuf + len, rem_len, mqtt_timer_left_ms(&packet_timer)) != rem_len))
     {
         rc = MQTT_READ_ERROR;
         goto exit;
     }
-    header.byte = c->readbuf[0];
     rc = header.bits.type;
 exit:
     return rc;
 }
 
 
-// assume topic filter and name is in correct format
-// # can only be at end
-// + and # can only be next to separator
-static char is_topic_matched(char* topicFilter, mqtt_string_t* topicName)
+// Subscriptions are kept in a trie with one node per topic level. Children
+// named by a level are found through a hash table keyed by parent and level,
+// '+' and '#' children hang directly off their parent, so dispatching a
+// message takes time proportional to the topic depth.
+
+static uint32_t level_hash(const char* level, int len)
+{
+    uint32_t h = 2166136261u; // FNV-1a
+    while (len--)
+        h = (h ^ (unsigned char)*level++) * 16777619u;
+    return h;
+}
+
+
+static struct mqtt_topic_node** topic_bucket(mqtt_client_t* c, struct mqtt_topic_node* parent, uint32_t key)
 {
-    char* curf = topicFilter;
-    char* curn = topicName->lenstring.data;
-    char* curn_end = curn + topicName->lenstring.len;
+    uint32_t h = key ^ ((uint32_t)(uintptr_t)parent * 2654435761u);
+    return &c->topic_buckets[(h >> 16) % MQTT_TOPIC_BUCKETS];
+}
 
-    while (*curf && curn < curn_end)
+
+static struct mqtt_topic_node* find_child(mqtt_client_t* c, struct mqtt_topic_node* parent,
+                                          const char* level, int len, uint32_t key)
+{
+    struct mqtt_topic_node* n;
+
+    if (len == 1 && *level == '+')
+        return parent->plus;
+    if (len == 1 && *level == '#')
+        return parent->multi;
+    for (n = *topic_bucket(c, parent, key); n; n = n->next)
+        if (n->parent == parent && n->key == key && n->len == len && !memcmp(n->level, level, len))
+            return n;
+    return NULL;
+}
+
+
+static struct mqtt_topic_node* add_child(mqtt_client_t* c, struct mqtt_topic_node* parent,
+                                         const char* level, int len, uint32_t key)
+{
+    struct mqtt_topic_node* n = c->free_nodes;
+
+    if (!n)
+        return NULL;
+    c->free_nodes = n->next;
+    memset(n, 0, sizeof(*n));
+    n->parent = parent;
+    n->level = level;
+    n->len = len;
+    n->key = key;
+    if (len == 1 && *level == '+')
+        parent->plus = n;
+    else if (len == 1 && *level == '#')
+        parent->multi = n;
+    else
     {
-        if (*curn == '/' && *curf != '/')
-            break;
-        if (*curf != '+' && *curf != '#' && *curf != *curn)
-            break;
-        if (*curf == '+')
-        {   // skip until we meet the next separator, or end of string
-            char* nextpos = curn + 1;
-            while (nextpos < curn_end && *nextpos != '/')
-                nextpos = ++curn + 1;
+        struct mqtt_topic_node** bucket = topic_bucket(c, parent, key);
+        n->next = *bucket;
+        *bucket = n;
+    }
+    parent->children++;
+    return n;
+}
+
+
+// Give back the nodes no longer leading to a subscription, from n up
+static void prune_nodes(mqtt_client_t* c, struct mqtt_topic_node* n)
+{
+    while (n != &c->topics && !n->handler && !n->children)
+    {
+        struct mqtt_topic_node* parent = n->parent;
+        if (parent->plus == n)
+            parent->plus = NULL;
+        else if (parent->multi == n)
+            parent->multi = NULL;
+        else
+        {
+            struct mqtt_topic_node** p = topic_bucket(c, parent, n->key);
+            while (*p != n)
+                p = &(*p)->next;
+            *p = n->next;
         }
-        else if (*curf == '#')
-            curn = curn_end - 1;    // skip until end of string
-        curf++;
-        curn++;
-    };
+        parent->children--;
+        n->next = c->free_nodes;
+        c->free_nodes = n;
+        n = parent;
+    }
+}
 
-    return (curn == curn_end) && (*curf == '\0');
+
+// Find the node of a topic filter, creating the missing levels if 'create'
+static struct mqtt_topic_node* find_filter(mqtt_client_t* c, const char* filter, int create)
+{
+    struct mqtt_topic_node* n = &c->topics;
+    const char* level = filter;
+
+    for (;;)
+    {
+        const char* sep = strchr(level, '/');
+        int len = sep ? sep - level : (int)strlen(level);
+        uint32_t key = level_hash(level, len);
+        struct mqtt_topic_node* child = find_child(c, n, level, len, key);
+        if (!child && create)
+            child = add_child(c, n, level, len, key);
+        if (!child)
+        {
+            if (create)
+                prune_nodes(c, n);
+            return NULL;
+        }
+        n = child;
+        if (!sep)
+            return n;
+        level = sep + 1;
+    }
 }
 
 
-static int deliver_message(mqtt_client_t* c, mqtt_string_t* topicName, mqtt_message_t* message)
+// Call the handlers of node and its descendants matching the topic levels
+// from 'level' ('level' is NULL once all levels are matched)
+static int dispatch(mqtt_client_t* c, struct mqtt_topic_node* n, const char* level, const char* end,
+                    mqtt_message_data_t* md)
 {
-    int i;
-    int rc = MQTT_FAILURE;
+    int count = 0;
 
-    // we have to find the right message handler - indexed by topic
-    for (i = 0; i < MQTT_MAX_MESSAGE_HANDLERS; ++i)
+    if (n->multi && n->multi->handler) // '#' also matches the parent level
     {
-        if (c->messageHandlers[i].topicFilter != 0 && (mqtt_packet_equals(topicName, (char*)c->messageHandlers[i].topicFilter) ||
-                is_topic_matched((char*)c->messageHandlers[i].topicFilter, topicName)))
+        n->multi->handler(md);
+        count++;
+    }
+    if (!level)
+    {
+        if (n->handler)
         {
-            if (c->messageHandlers[i].fp != NULL)
-            {
-                mqtt_message_data_t md;
-                new_message_data(&md, topicName, message);
-                c->messageHandlers[i].fp(&md);
-                rc = MQTT_SUCCESS;
-            }
+            n->handler(md);
+            count++;
         }
+        return count;
+    }
+
+    const char* sep = memchr(level, '/', end - level);
+    int len = (sep ? sep : end) - level;
+    const char* next = sep ? sep + 1 : NULL;
+    struct mqtt_topic_node* child = find_child(c, n, level, len, level_hash(level, len));
+    if (child && child != n->plus && child != n->multi)
+        count += dispatch(c, child, next, end, md);
+    if (n->plus)
+        count += dispatch(c, n->plus, next, end, md);
+    return count;
+}
+
+
+void  mqtt_client_add_topic_nodes(mqtt_client_t* c, struct mqtt_topic_node* nodes, int count)
+{
+    while (count--)
+    {
+        nodes->next = c->free_nodes;
+        c->free_nodes = nodes++;
     }
+}
+
+
+static int deliver_message(mqtt_client_t* c, mqtt_string_t* topicName, mqtt_message_t* message,
+                           size_t offset, size_t total_len)
+{
+    int rc = MQTT_FAILURE;
+    mqtt_message_data_t md;
+    const char* topic = topicName->cstring ? topicName->cstring : topicName->lenstring.data;
+    int len = topicName->cstring ? (int)strlen(topicName->cstring) : topicName->lenstring.len;
+
+    new_message_data(&md, topicName, message, offset, total_len);
+    if (dispatch(c, &c->topics, topic, topic + len, &md))
+        rc = MQTT_SUCCESS;
 
     if (rc == MQTT_FAILURE && c->defaultMessageHandler != NULL)
     {
-        mqtt_message_data_t md;
-        new_message_data(&md, topicName, message);
         c->defaultMessageHandler(&md);
         rc = MQTT_SUCCESS;
     }
@@ -178,6 +433,31 @@ static int deliver_message(mqtt_client_t* c, mqtt_string_t* topicName, mqtt_mess
 }
 
 
+// Pass the payload of a big PUBLISH to the handlers in readbuf sized chunks
+static int stream_publish(mqtt_client_t* c, mqtt_string_t* topicName, mqtt_message_t* msg, int stream_len)
+{
+    unsigned char* chunk = msg->payload;
+    int chunk_size = c->readbuf + c->readbuf_size - chunk;
+    size_t offset = 0, total_len = stream_len;
+    mqtt_timer_t timer;
+
+    mqtt_timer_init(&timer);
+    mqtt_timer_countdown_ms(&timer, c->command_timeout_ms);
+    while (offset < total_len)
+    {
+        int left = total_len - offset;
+        int n = left < chunk_size ? left : chunk_size;
+        if (c->ipstack->mqttread(c->ipstack, chunk, n, mqtt_timer_left_ms(&timer)) != n)
+            return MQTT_READ_ERROR;
+        msg->payload = chunk;
+        msg->payloadlen = n;
+        deliver_message(c, topicName, msg, offset, total_len);
+        offset += n;
+    }
+    return MQTT_SUCCESS;
+}
+
+
 static int keepalive(mqtt_client_t* c)
 {
     int rc = MQTT_SUCCESS;
@@ -222,15 +502,26 @@ exit:
 static int cycle(mqtt_client_t* c, mqtt_timer_t* timer)
 {
     // read the socket, see what work is due
-    int packet_type = read_packet(c, timer);
+    int stream_len;
+    int packet_type = read_packet(c, timer, &stream_len);
 
     int len = 0,
         rc = MQTT_SUCCESS;
 
     switch (packet_type)
     {
-        case MQTTPACKET_CONNACK:
         case MQTTPACKET_PUBACK:
+        case MQTTPACKET_PUBCOMP:
+        {
+            unsigned short mypacketid;
+            unsigned char dup, type;
+            struct mqtt_inflight* f;
+            if (c->inflight_count && mqtt_deserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) == 1 &&
+                (f = find_inflight(c, mypacketid)) != NULL && f->wait == packet_type)
+                complete_inflight(c, f);
+            break;
+        }
+        case MQTTPACKET_CONNACK:
         case MQTTPACKET_SUBACK:
             break;
         case MQTTPACKET_PUBLISH:
@@ -240,7 +531,17 @@ static int cycle(mqtt_client_t* c, mqtt_timer_t* timer)
             if (mqtt_deserialize_publish((unsigned char*)&msg.dup, (int*)&msg.qos, (unsigned char*)&msg.retained, (unsigned short*)&msg.id, &topicName,
                (unsigned char**)&msg.payload, (int*)&msg.payloadlen, c->readbuf, c->readbuf_size) != 1)
                 goto exit;
-            deliver_message(c, &topicName, &msg);
+            if (stream_len)
+            {
+                if (stream_publish(c, &topicName, &msg, stream_len) != MQTT_SUCCESS)
+                {
+                    c->isconnected = 0;
+                    rc = MQTT_DISCONNECTED;
+                    goto exit;
+                }
+            }
+            else
+                deliver_message(c, &topicName, &msg, 0, msg.payloadlen);
             if (msg.qos != MQTT_QOS0)
             {
                 if (msg.qos == MQTT_QOS1)
@@ -260,18 +561,19 @@ static int cycle(mqtt_client_t* c, mqtt_timer_t* timer)
         {
             unsigned short mypacketid;
             unsigned char dup, type;
+            struct mqtt_inflight* f;
             if (mqtt_deserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1)
                 rc = MQTT_FAILURE;
             else if ((len = mqtt_serialize_ack(c->buf, c->buf_size, MQTTPACKET_PUBREL, 0, mypacketid)) <= 0)
                 rc = MQTT_FAILURE;
             else if ((rc = send_packet(c, len, timer)) != MQTT_SUCCESS) // send the PUBREL packet
                 rc = MQTT_FAILURE; // there was a problem
+            else if (c->inflight_count && (f = find_inflight(c, mypacketid)) != NULL && f->wait == MQTTPACKET_PUBREC)
+                f->wait = MQTTPACKET_PUBCOMP; // pipelined publish, released now
             if (rc == MQTT_FAILURE)
                 goto exit; // there was a problem
             break;
         }
-        case MQTTPACKET_PUBCOMP:
-            break;
         case MQTTPACKET_PINGRESP:
         {
             c->ping_outstanding = 0;
@@ -296,11 +598,12 @@ exit:
 
 void  mqtt_client_new(mqtt_client_t* c, mqtt_network_t* network, unsigned int command_timeout_ms, unsigned char* buf, size_t buf_size, unsigned char* readbuf, size_t readbuf_size)
 {
-    int i;
     c->ipstack = network;
 
-    for (i = 0; i < MQTT_MAX_MESSAGE_HANDLERS; ++i)
-        c->messageHandlers[i].topicFilter = 0;
+    memset(&c->topics, 0, sizeof(c->topics));
+    memset(c->topic_buckets, 0, sizeof(c->topic_buckets));
+    c->free_nodes = NULL;
+    mqtt_client_add_topic_nodes(c, c->topic_pool, MQTT_TOPIC_POOL_SIZE);
     c->command_timeout_ms = command_timeout_ms;
     c->buf = buf;
     c->buf_size = buf_size;
@@ -310,10 +613,34 @@ void  mqtt_client_new(mqtt_client_t* c, mqtt_network_t* network, unsigned int co
     c->ping_outstanding = 0;
     c->fail_count = 0;
     c->defaultMessageHandler = NULL;
+    c->outbox = NULL;
+    c->outbox_slot = 0;
+    c->window = 0;
+    c->inflight_count = 0;
+    c->publishHandler = NULL;
     mqtt_timer_init(&(c->ping_timer));
 }
 
 
+void  mqtt_client_set_window(mqtt_client_t* c, int window, unsigned char* outbox, size_t outbox_size,
+                             mqtt_publish_handler_t handler)
+{
+    int i;
+
+    if (window > MQTT_MAX_INFLIGHT)
+        window = MQTT_MAX_INFLIGHT;
+    if (!outbox || window <= 0)
+        window = 0;
+    c->outbox = outbox;
+    c->outbox_slot = window ? outbox_size / window : 0;
+    c->window = window;
+    c->inflight_count = 0;
+    c->publishHandler = handler;
+    for (i = 0; i < MQTT_MAX_INFLIGHT; ++i)
+        c->inflight[i].id = 0;
+}
+
+
 int  mqtt_yield(mqtt_client_t* c, int timeout_ms)
 {
     int rc = MQTT_SUCCESS;
@@ -387,6 +714,9 @@ int  mqtt_connect(mqtt_client_t* c, mqtt_packet_connect_data_t* options)
     else
         rc = MQTT_FAILURE;
 
+    if (rc == MQTT_SUCCESS && c->inflight_count)
+        rc = resend_inflight(c, &connect_timer);
+
 exit:
     if (rc == MQTT_SUCCESS)
         c->isconnected = 1;
@@ -423,18 +753,13 @@ int  mqtt_subscribe(mqtt_client_t* c, const char* topic, enum mqtt_qos qos, mqtt
             rc = grantedQoS; // 0, 1, 2 or 0x80
         if (rc != 0x80)
         {
-            int i;
-            
-            rc = MQTT_FAILURE;
-            for (i = 0; i < MQTT_MAX_MESSAGE_HANDLERS; ++i)
+            struct mqtt_topic_node* n = find_filter(c, topic, 1);
+
+            rc = MQTT_FAILURE; // out of topic nodes
+            if (n)
             {
-                if (c->messageHandlers[i].topicFilter == 0)
-                {
-                    c->messageHandlers[i].topicFilter = topic;
-                    c->messageHandlers[i].fp = handler;
-                    rc = 0;
-                    break;
-                }
+                n->handler = handler;
+                rc = 0;
             }
         }
     }
@@ -469,7 +794,15 @@ int  mqtt_unsubscribe(mqtt_client_t* c, const char* topicFilter)
     {
         unsigned short mypacketid;  // should be the same as the packetid above
         if (mqtt_deserialize_unsuback(&mypacketid, c->readbuf, c->readbuf_size) == 1)
+        {
+            struct mqtt_topic_node* n = find_filter(c, topicFilter, 0);
+            if (n)
+            {
+                n->handler = NULL;
+                prune_nodes(c, n);
+            }
             rc = 0;
+        }
     }
     else
         rc = MQTT_FAILURE;
@@ -505,49 +838,82 @@ int  mqtt_publish(mqtt_client_t* c, const char* topic, mqtt_message_t* message)
         goto exit; // there was a problem
     }
 
-    if (message->qos == MQTT_QOS1)
+    if (message->qos == MQTT_QOS1 || message->qos == MQTT_QOS2)
     {
-        if (waitfor(c, MQTTPACKET_PUBACK, &timer) == MQTTPACKET_PUBACK)
+        int ack = message->qos == MQTT_QOS1 ? MQTTPACKET_PUBACK : MQTTPACKET_PUBCOMP;
+        unsigned short mypacketid = 0;
+        // acks of pipelined publishes may come first
+        while (rc == MQTT_SUCCESS && mypacketid != message->id)
         {
-            // We still can receive from broker, treat as recoverable
-            c->fail_count = 0;
-            unsigned short mypacketid;
             unsigned char dup, type;
-            if (mqtt_deserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1)
+            if (waitfor(c, ack, &timer) != ack ||
+                mqtt_deserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1)
                 rc = MQTT_FAILURE;
-            else
-                rc = MQTT_SUCCESS;
-        }
-        else
-        {
-            rc = MQTT_FAILURE;
         }
+        if (rc == MQTT_SUCCESS)
+            c->fail_count = 0; // We still can receive from broker, treat as recoverable
+    }
+
+exit:
+    return rc;
+}
+
+
+int  mqtt_publish_async(mqtt_client_t* c, const char* topic, mqtt_message_t* message)
+{
+    int rc = MQTT_FAILURE;
+    mqtt_timer_t timer;
+    mqtt_string_t topicStr = mqtt_string_initializer;
+    topicStr.cstring = (char *)topic;
+    struct mqtt_inflight* f;
+    int len = 0;
+
+    if (message->qos == MQTT_QOS0 || !c->window)
+        return mqtt_publish(c, topic, message);
+
+    mqtt_timer_init(&timer);
+    mqtt_timer_countdown_ms(&timer, c->command_timeout_ms);
 
+    if (!c->isconnected)
+        goto exit;
+
+    // Window full: handle incoming packets until an acknowledgement frees a slot
+    while (c->inflight_count == c->window)
+    {
+        if (mqtt_timer_expired(&timer) || cycle(c, &timer) == MQTT_DISCONNECTED)
+            goto exit;
     }
-    else if (message->qos == MQTT_QOS2)
+
+    f = find_inflight(c, 0);
+    message->id = get_next_packet_id(c);
+    len = mqtt_serialize_publish(inflight_packet(c, f), c->outbox_slot, 0, message->qos, message->retained,
+              message->id, topicStr, (unsigned char*)message->payload, message->payloadlen);
+    if (len <= 0)
     {
-        if (waitfor(c, MQTTPACKET_PUBCOMP, &timer) == MQTTPACKET_PUBCOMP)
-        {
-            // We still can receive from broker, treat as recoverable
-            c->fail_count = 0;
-            unsigned short mypacketid;
-            unsigned char dup, type;
-            if (mqtt_deserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1)
-                rc = MQTT_FAILURE;
-            else
-                rc = MQTT_SUCCESS;
-        }
-        else
-        {
-            rc = MQTT_FAILURE;
-        }
+        rc = MQTT_BUFFER_OVERFLOW;
+        goto exit;
     }
+    f->id = message->id;
+    f->wait = message->qos == MQTT_QOS1 ? MQTTPACKET_PUBACK : MQTTPACKET_PUBREC;
+    f->len = len;
+    c->inflight_count++;
+
+    // Once in the window the message is sent again on reconnect, even if
+    // sending fails now
+    if ((rc = send_buf(c, inflight_packet(c, f), len, &timer)) == MQTT_SUCCESS)
+        rc = message->id;
 
 exit:
     return rc;
 }
 
 
+int  mqtt_inflight(mqtt_client_t* c)
+{
+    return c->inflight_count;
+}
+
+
 int  mqtt_disconnect(mqtt_client_t* c)
 {
     int rc = MQTT_FAILURE;
@@ -21,9 +21,25 @@
 #include "MQTTESP8266.h"
 
 #define MQTT_MAX_PACKET_ID 65535
-#define MQTT_MAX_MESSAGE_HANDLERS 5
+// Topic levels the client can hold without mqtt_client_add_topic_nodes, a
+// subscription takes one node per level not shared with another one. This
+// replaces MAX_MESSAGE_HANDLERS, the default keeps room for its 5
+// subscriptions of 4 levels each.
+#ifndef MQTT_TOPIC_POOL_SIZE
+#define MQTT_TOPIC_POOL_SIZE (5 * 4)
+#endif
+// Hash buckets for looking up topic levels, a power of 2
+#ifndef MQTT_TOPIC_BUCKETS
+#define MQTT_TOPIC_BUCKETS 16
+#endif
 #define MQTT_MAX_FAIL_ALLOWED  2
 
+// Largest number of QoS1/QoS2 publishes mqtt_publish_async can have waiting
+// for acknowledgement
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT 8
+#endif
+
 enum mqtt_qos {
 	MQTT_QOS0,
 	MQTT_QOS1,
@@ -49,14 +65,42 @@ typedef struct mqtt_message
     size_t payloadlen;
 } mqtt_message_t;
 
+// A message bigger than the client readbuf is passed to the handler in
+// several calls, each with a part of the payload starting at 'offset'.
 typedef struct mqtt_message_data
 {
     mqtt_string_t* topic;
     mqtt_message_t* message;
+    size_t offset;      // position of message->payload in the whole payload
+    size_t total_len;   // length of the whole payload
 } mqtt_message_data_t;
 
 typedef void (*mqtt_message_handler_t)(mqtt_message_data_t*);
 
+// One level of a subscribed topic filter
+struct mqtt_topic_node
+{
+    struct mqtt_topic_node* parent;
+    struct mqtt_topic_node* next;   // next node in the hash bucket or free list
+    struct mqtt_topic_node* plus;   // '+' child
+    struct mqtt_topic_node* multi;  // '#' child
+    mqtt_message_handler_t handler; // subscription ending at this level
+    const char* level;              // points into the subscribed filter
+    uint32_t key;                   // hash of the level
+    unsigned short len;
+    unsigned short children;
+};
+
+// Called when a pipelined publish has been acknowledged
+typedef void (*mqtt_publish_handler_t)(unsigned short id, int rc);
+
+struct mqtt_inflight
+{
+    unsigned short id;      // packet id, 0 if the slot is free
+    unsigned char wait;     // acknowledgement waited for: PUBACK, PUBREC or PUBCOMP
+    unsigned short len;     // length of the PUBLISH kept in the outbox
+};
+
 struct mqtt_client
 {
     unsigned int next_packetid;
@@ -69,28 +113,52 @@ struct mqtt_client
     int fail_count;
     int isconnected;
 
-    struct MessageHandlers
-    {
-        const char* topicFilter;
-        void (*fp) (mqtt_message_data_t*);
-    } messageHandlers[MQTT_MAX_MESSAGE_HANDLERS];      // Message handlers are indexed by subscription topic
-
     void (*defaultMessageHandler) (mqtt_message_data_t*);
 
     mqtt_network_t* ipstack;
     mqtt_timer_t ping_timer;
+
+    unsigned char *outbox;  // one slot of outbox_slot bytes per window entry
+    size_t outbox_slot;
+    int window;
+    int inflight_count;
+    struct mqtt_inflight inflight[MQTT_MAX_INFLIGHT];
+    mqtt_publish_handler_t publishHandler;
+
+    struct mqtt_topic_node topics;  // root of the subscriptions
+    struct mqtt_topic_node* topic_buckets[MQTT_TOPIC_BUCKETS];
+    struct mqtt_topic_node* free_nodes;
+    struct mqtt_topic_node topic_pool[MQTT_TOPIC_POOL_SIZE];
 };
 
 typedef struct mqtt_client mqtt_client_t;
 
 int mqtt_connect(mqtt_client_t* c, mqtt_packet_connect_data_t* options);
 int mqtt_publish(mqtt_client_t* c, const char* topic, mqtt_message_t* message);
+// Send a QoS1/QoS2 message without waiting for its acknowledgement, which is
+// handled by later calls to mqtt_yield. Waits only while the window is full.
+// Returns the packet id, or a negative error. The message stays in the
+// window until acknowledged and is sent again with DUP set by mqtt_connect
+// on the same client. QoS0 messages, or publishes without a window, go
+// through mqtt_publish.
+int mqtt_publish_async(mqtt_client_t* c, const char* topic, mqtt_message_t* message);
+// Number of pipelined publishes not acknowledged yet
+int mqtt_inflight(mqtt_client_t* c);
+// The topic string is not copied and has to stay valid while subscribed
 int mqtt_subscribe(mqtt_client_t* c, const char* topic, enum mqtt_qos qos, mqtt_message_handler_t handler);
 int mqtt_unsubscribe(mqtt_client_t* c, const char* topic);
 int mqtt_disconnect(mqtt_client_t* c);
 int mqtt_yield(mqtt_client_t* c, int timeout_ms);
 
 void mqtt_client_new(mqtt_client_t*, mqtt_network_t*, unsigned int, unsigned char*, size_t, unsigned char*, size_t);
+// Give the client more topic nodes for subscriptions, after mqtt_client_new.
+// The nodes are used until the client is created again.
+void mqtt_client_add_topic_nodes(mqtt_client_t* c, struct mqtt_topic_node* nodes, int count);
+// Allow up to 'window' (at most MQTT_MAX_INFLIGHT) publishes in flight. The
+// outbox is split in one slot per window entry, so a message serialized
+// must fit in outbox_size / window bytes. handler may be NULL.
+void mqtt_client_set_window(mqtt_client_t* c, int window, unsigned char* outbox, size_t outbox_size,
+                            mqtt_publish_handler_t handler);
 
 #define mqtt_client_default {0, 0, 0, 0, NULL, NULL, 0, 0, 0}
 
@@ -64,27 +64,59 @@ void  mqtt_timer_init(mqtt_timer_t* timer)
 
 
 
-int  mqtt_esp_read(mqtt_network_t* n, unsigned char* buffer, int len, int timeout_ms)
+static int  wait_readable(mqtt_network_t* n, int timeout_ms)
 {
     struct timeval tv;
     fd_set fdset;
     int rc = 0;
-    int rcvd = 0;
     FD_ZERO(&fdset);
     FD_SET(n->my_socket, &fdset);
     tv.tv_sec = timeout_ms / 1000;
     tv.tv_usec = (timeout_ms % 1000) * 1000;
     rc = select(n->my_socket + 1, &fdset, 0, 0, &tv);
-    if ((rc > 0) && (FD_ISSET(n->my_socket, &fdset)))
-    {
-        rcvd = recv(n->my_socket, buffer, len, 0);
-    }
-    else
+    return (rc > 0) && (FD_ISSET(n->my_socket, &fdset));
+}
+
+
+// Read exactly 'len' bytes unless the timeout expires or the connection
+// fails, from the read-ahead buffer first. Returns the number of bytes read
+// or -1 if none.
+int  mqtt_esp_read(mqtt_network_t* n, unsigned char* buffer, int len, int timeout_ms)
+{
+    mqtt_timer_t timer;
+    int rcvd = 0;
+    int rc;
+
+    mqtt_timer_init(&timer);
+    mqtt_timer_countdown_ms(&timer, timeout_ms);
+    while (rcvd < len)
     {
-        // select fail
-        return -1;
+        if (n->rx_len == 0)
+        {
+            if (!wait_readable(n, mqtt_timer_left_ms(&timer)))
+                break;
+            if (len - rcvd >= MQTT_NETWORK_RXBUF_SIZE)
+            {
+                // Big read, no point in going through the buffer
+                rc = recv(n->my_socket, buffer + rcvd, len - rcvd, 0);
+                if (rc <= 0)
+                    break;
+                rcvd += rc;
+                continue;
+            }
+            rc = recv(n->my_socket, n->rxbuf, MQTT_NETWORK_RXBUF_SIZE, 0);
+            if (rc <= 0)
+                break;
+            n->rx_pos = 0;
+            n->rx_len = rc;
+        }
+        rc = len - rcvd < n->rx_len ? len - rcvd : n->rx_len;
+        memcpy(buffer + rcvd, n->rxbuf + n->rx_pos, rc);
+        n->rx_pos += rc;
+        n->rx_len -= rc;
+        rcvd += rc;
     }
-    return rcvd;
+    return rcvd ? rcvd : -1;
 }
 
 
@@ -116,6 +148,7 @@ int  mqtt_esp_write(mqtt_network_t* n, unsigned char* buffer, int len, int timeo
 void  mqtt_network_new(mqtt_network_t* n)
 {
     n->my_socket = -1;
+    n->rx_len = 0;
     n->mqttread = mqtt_esp_read;
     n->mqttwrite = mqtt_esp_write;
 }
@@ -159,6 +192,7 @@ int  mqtt_network_connect(mqtt_network_t* n, const char* host, int port)
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
 
+    n->rx_len = 0;
     n->my_socket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
     if( n->my_socket < 0 )
     {
@@ -181,5 +215,6 @@ int  mqtt_network_disconnect(mqtt_network_t* n)
 {
     close(n->my_socket);
     n->my_socket = -1;
+    n->rx_len = 0;
     return 0;
 }
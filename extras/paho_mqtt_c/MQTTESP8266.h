@@ -31,6 +31,13 @@ struct mqtt_timer
     TickType_t end_time;
 };
 
+// Size of the read-ahead buffer. mqtt_esp_read receives whatever the socket
+// has into it, so that reading a packet piecewise doesn't take a
+// select/recv per piece.
+#ifndef MQTT_NETWORK_RXBUF_SIZE
+#define MQTT_NETWORK_RXBUF_SIZE 128
+#endif
+
 typedef struct mqtt_network mqtt_network_t;
 
 struct mqtt_network
@@ -38,6 +45,9 @@ struct mqtt_network
 	int my_socket;
 	int (*mqttread) (mqtt_network_t*, unsigned char*, int, int);
 	int (*mqttwrite) (mqtt_network_t*, unsigned char*, int, int);
+	unsigned char rxbuf[MQTT_NETWORK_RXBUF_SIZE];
+	unsigned short rx_pos;  // next byte to read in rxbuf
+	unsigned short rx_len;  // bytes left to read in rxbuf
 };
 
 char mqtt_timer_expired(mqtt_timer_t*);
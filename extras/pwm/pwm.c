@@ -10,60 +10,240 @@
 #include <espressif/esp_common.h>
 #include <espressif/sdk_private.h>
 #include <FreeRTOS.h>
+#include <task.h>
 #include <esp8266.h>
 
-typedef struct PWMPinDefinition
+/* Each period starts with all pins with a nonzero duty set high. The falling
+ * edges follow sorted by time, pins switching off at the same time share one
+ * edge. Every event is a single write to GPIO.OUT_SET/OUT_CLEAR and one FRC1
+ * interrupt, so a period takes (distinct duties + 1) interrupts whatever the
+ * number of pins.
+ */
+typedef struct PWMEdgeDefinition
 {
-    uint8_t pin;
-    uint8_t divider;
-} PWMPin;
-
-typedef enum {
-    PERIOD_ON   = 0,
-    PERIOD_OFF  = 1
-} pwm_step_t;
+    uint32_t load;          /* timer ticks to the next event */
+    uint16_t clearMask;     /* pins switched off at this edge */
+} PWMEdge;
 
+typedef struct PWMScheduleDefinition
+{
+    uint16_t setMask;       /* pins switched on at period start */
+    uint16_t clearMask;     /* pins with 0% duty, kept off */
+    uint32_t startLoad;     /* timer ticks from period start to the first edge */
+    uint8_t edges;
+    PWMEdge edge[MAX_PWM_PINS];
+} PWMSchedule;
 
 typedef struct pwmInfoDefinition
 {
     uint8_t running;
 
     uint16_t freq;
-    uint16_t dutyCycle;
+    uint16_t dutyCycle[MAX_PWM_PINS];
 
     /* private */
     uint32_t _maxLoad;
-    uint32_t _onLoad;
-    uint32_t _offLoad;
-    pwm_step_t _step;
+    bool _timerActive;
+
+    /* Duty updates are written to the inactive schedule and switched to by
+       the ISR at the next period start */
+    PWMSchedule _schedule[2];
+    volatile uint8_t _active;
+    volatile bool _pending;
+    uint8_t _step;          /* 0 = period start, n = edge n - 1 */
 
     uint16_t usedPins;
-    PWMPin pins[8];
+    uint8_t pins[MAX_PWM_PINS];
 } PWMInfo;
 
 static PWMInfo pwmInfo;
 
 static void frc1_interrupt_handler(void)
 {
-    uint8_t i = 0;
-    bool out = true;
-    uint32_t load = pwmInfo._onLoad;
-    pwm_step_t step = PERIOD_ON;
+    const PWMSchedule *schedule;
+    uint32_t load;
 
-    if (pwmInfo._step == PERIOD_ON)
+    if (pwmInfo._step == 0)
     {
-        out = false;
-        load = pwmInfo._offLoad;
-        step = PERIOD_OFF;
+        if (pwmInfo._pending)
+        {
+            pwmInfo._active ^= 1;
+            pwmInfo._pending = false;
+        }
+        schedule = &pwmInfo._schedule[pwmInfo._active];
+        GPIO.OUT_SET = schedule->setMask;
+        GPIO.OUT_CLEAR = schedule->clearMask;
+        load = schedule->startLoad;
     }
-
-    for (; i < pwmInfo.usedPins; ++i)
+    else
     {
-        gpio_write(pwmInfo.pins[i].pin, out);
+        schedule = &pwmInfo._schedule[pwmInfo._active];
+        const PWMEdge *edge = &schedule->edge[pwmInfo._step - 1];
+        GPIO.OUT_CLEAR = edge->clearMask;
+        load = edge->load;
     }
 
     timer_set_load(FRC1, load);
-    pwmInfo._step = step;
+    pwmInfo._step = (pwmInfo._step < schedule->edges) ? pwmInfo._step + 1 : 0;
+}
+
+/* Compute the edge schedule for the current duties and frequency */
+static void build_schedule(PWMSchedule *schedule)
+{
+    uint32_t maxLoad = pwmInfo._maxLoad;
+    uint32_t times[MAX_PWM_PINS];
+    /* Without room for an edge inside the period (frequency not set or too
+       high) only constant output is possible, duties are rounded */
+    bool constant = maxLoad < 2 * PWM_MIN_LOAD;
+
+    schedule->setMask = 0;
+    schedule->clearMask = 0;
+    schedule->edges = 0;
+
+    for (uint8_t i = 0; i < pwmInfo.usedPins; ++i)
+    {
+        uint16_t duty = pwmInfo.dutyCycle[i];
+        uint16_t mask = BIT(pwmInfo.pins[i]);
+
+        if (duty == 0 || (constant && duty <= UINT16_MAX / 2))
+        {
+            schedule->clearMask |= mask;
+            continue;
+        }
+        schedule->setMask |= mask;
+        if (duty == UINT16_MAX || constant)
+        {
+            continue;
+        }
+
+        /* Keep edges far enough from the period boundaries for the
+           ISR to keep up */
+        uint32_t time = (uint64_t)duty * maxLoad / UINT16_MAX;
+        if (time < PWM_MIN_LOAD)
+        {
+            time = PWM_MIN_LOAD;
+        }
+        if (time > maxLoad - PWM_MIN_LOAD)
+        {
+            time = maxLoad - PWM_MIN_LOAD;
+        }
+
+        /* Insertion sort, merging edges closer than PWM_MIN_LOAD */
+        uint8_t n = schedule->edges;
+        uint8_t j = 0;
+        while (j < n && times[j] + PWM_MIN_LOAD <= time)
+        {
+            ++j;
+        }
+        if (j < n && times[j] < time + PWM_MIN_LOAD)
+        {
+            schedule->edge[j].clearMask |= mask;
+            continue;
+        }
+        for (uint8_t k = n; k > j; --k)
+        {
+            times[k] = times[k - 1];
+            schedule->edge[k] = schedule->edge[k - 1];
+        }
+        times[j] = time;
+        schedule->edge[j].clearMask = mask;
+        schedule->edges = n + 1;
+    }
+
+    /* Convert edge times into timer loads */
+    uint8_t n = schedule->edges;
+    schedule->startLoad = n ? times[0] : maxLoad;
+    for (uint8_t j = 0; j < n; ++j)
+    {
+        uint32_t next = (j + 1 < n) ? times[j + 1] : maxLoad;
+        schedule->edge[j].load = next - times[j];
+    }
+}
+
+/* True if all duties are 0% or 100% */
+static bool duties_constant(void)
+{
+    for (uint8_t i = 0; i < pwmInfo.usedPins; ++i)
+    {
+        if (pwmInfo.dutyCycle[i] != 0 && pwmInfo.dutyCycle[i] != UINT16_MAX)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void stop_timer(void)
+{
+    timer_set_interrupts(FRC1, false);
+    timer_set_run(FRC1, false);
+    pwmInfo._timerActive = false;
+}
+
+/* Drive pins with constant 0% or 100% duty directly, the timer must be
+   stopped */
+static void apply_constant(const PWMSchedule *schedule)
+{
+    GPIO.OUT_SET = schedule->setMask;
+    GPIO.OUT_CLEAR = schedule->clearMask;
+}
+
+static void start_timer(void)
+{
+    pwmInfo._step = 0;
+    pwmInfo._pending = false;
+    pwmInfo._timerActive = true;
+
+    /* First interrupt starts the period right away */
+    timer_set_load(FRC1, PWM_MIN_LOAD);
+    timer_set_reload(FRC1, false);
+    timer_set_interrupts(FRC1, true);
+    timer_set_run(FRC1, true);
+}
+
+/* Rebuild the schedule after a duty or frequency change. While the timer is
+   running the new schedule takes effect at the next period start. */
+static void update_schedule(void)
+{
+    /* Cancel a pending switch so the ISR leaves the inactive schedule alone */
+    taskENTER_CRITICAL();
+    pwmInfo._pending = false;
+    taskEXIT_CRITICAL();
+
+    uint8_t next = pwmInfo._active ^ 1;
+    PWMSchedule *schedule = &pwmInfo._schedule[next];
+    build_schedule(schedule);
+
+    if (duties_constant())
+    {
+        /* 0% and 100% duties apply even before pwm_start */
+        pwmInfo.running = 1;
+    }
+    if (!pwmInfo.running)
+    {
+        pwmInfo._active = next;
+        return;
+    }
+
+    if (schedule->edges == 0)
+    {
+        // 0% and 100% duty cycle are special cases: constant output.
+        // Stop the ISR before it can pick up the new schedule.
+        stop_timer();
+        pwmInfo._active = next;
+        apply_constant(schedule);
+    }
+    else if (pwmInfo._timerActive)
+    {
+        taskENTER_CRITICAL();
+        pwmInfo._pending = true;
+        taskEXIT_CRITICAL();
+    }
+    else
+    {
+        pwmInfo._active = next;
+        start_timer();
+    }
 }
 
 void pwm_init(uint8_t npins, const uint8_t* pins)
@@ -75,11 +255,24 @@ void pwm_init(uint8_t npins, const uint8_t* pins)
         return;
     }
 
+    for (uint8_t i = 0; i < npins; ++i)
+    {
+        /* GPIO16 can't be driven through the GPIO.OUT registers */
+        if (pins[i] > 15)
+        {
+            printf("Incorrect PWM pin (%d)\n", pins[i]);
+            return;
+        }
+    }
+
+    /* Stop timers and mask interrupts */
+    pwm_stop();
+
     /* Initialize */
     pwmInfo._maxLoad = 0;
-    pwmInfo._onLoad = 0;
-    pwmInfo._offLoad = 0;
-    pwmInfo._step = PERIOD_ON;
+    pwmInfo._active = 0;
+    pwmInfo._pending = false;
+    pwmInfo._step = 0;
 
     /* Save pins information */
     pwmInfo.usedPins = npins;
@@ -87,15 +280,13 @@ void pwm_init(uint8_t npins, const uint8_t* pins)
     uint8_t i = 0;
     for (; i < npins; ++i)
     {
-        pwmInfo.pins[i].pin = pins[i];
+        pwmInfo.pins[i] = pins[i];
+        pwmInfo.dutyCycle[i] = 0;
 
         /* configure GPIOs */
         gpio_enable(pins[i], GPIO_OUTPUT);
     }
 
-    /* Stop timers and mask interrupts */
-    pwm_stop();
-
     /* set up ISRs */
     _xt_isr_attach(INUM_TIMER_FRC1, frc1_interrupt_handler);
 
@@ -105,17 +296,17 @@ void pwm_init(uint8_t npins, const uint8_t* pins)
 
 void pwm_set_freq(uint16_t freq)
 {
-    pwmInfo.freq = freq;
-
     /* Stop now to avoid load being used */
     if (pwmInfo.running)
     {
-        pwm_stop();
-        pwmInfo.running = 1;
+        stop_timer();
     }
 
-    timer_set_frequency(FRC1, freq);
-    pwmInfo._maxLoad = timer_get_load(FRC1);
+    if (timer_set_frequency(FRC1, freq) == 0)
+    {
+        pwmInfo.freq = freq;
+        pwmInfo._maxLoad = timer_get_load(FRC1);
+    }
 
     if (pwmInfo.running)
     {
@@ -125,22 +316,30 @@ void pwm_set_freq(uint16_t freq)
 
 void pwm_set_duty(uint16_t duty)
 {
-    bool output;
+    for (uint8_t i = 0; i < pwmInfo.usedPins; ++i)
+    {
+        pwmInfo.dutyCycle[i] = duty;
+    }
+    update_schedule();
+}
 
-    pwmInfo.dutyCycle = duty;
-    if (duty > 0 && duty < UINT16_MAX) {
-        pwm_restart();
+void pwm_set_channel_duty(uint8_t channel, uint16_t duty)
+{
+    if (channel >= pwmInfo.usedPins)
+    {
         return;
     }
+    pwmInfo.dutyCycle[channel] = duty;
+    update_schedule();
+}
 
-    // 0% and 100% duty cycle are special cases: constant output.
-    pwm_stop();
-    pwmInfo.running = 1;
-    output = (duty == UINT16_MAX);
+void pwm_set_duties(const uint16_t *duties)
+{
     for (uint8_t i = 0; i < pwmInfo.usedPins; ++i)
     {
-        gpio_write(pwmInfo.pins[i].pin, output);
+        pwmInfo.dutyCycle[i] = duties[i];
     }
+    update_schedule();
 }
 
 void pwm_restart()
@@ -154,28 +353,23 @@ void pwm_restart()
 
 void pwm_start()
 {
-    pwmInfo._onLoad = pwmInfo.dutyCycle * pwmInfo._maxLoad / UINT16_MAX;
-    pwmInfo._offLoad = pwmInfo._maxLoad - pwmInfo._onLoad;
-    pwmInfo._step = PERIOD_ON;
+    /* Make sure the ISR isn't using the schedule while it's rebuilt */
+    stop_timer();
 
-    // Trigger ON
-    uint8_t i = 0;
-    for (; i < pwmInfo.usedPins; ++i)
+    build_schedule(&pwmInfo._schedule[pwmInfo._active]);
+    const PWMSchedule *schedule = &pwmInfo._schedule[pwmInfo._active];
+    pwmInfo.running = 1;
+
+    if (schedule->edges == 0)
     {
-        gpio_write(pwmInfo.pins[i].pin, true);
+        apply_constant(schedule);
+        return;
     }
-
-    timer_set_load(FRC1, pwmInfo._onLoad);
-    timer_set_reload(FRC1, false);
-    timer_set_interrupts(FRC1, true);
-    timer_set_run(FRC1, true);
-
-    pwmInfo.running = 1;
+    start_timer();
 }
 
 void pwm_stop()
 {
-    timer_set_interrupts(FRC1, false);
-    timer_set_run(FRC1, false);
+    stop_timer();
     pwmInfo.running = 0;
 }
@@ -12,14 +12,33 @@
 
 #define MAX_PWM_PINS    8
 
+/* Minimum FRC1 ticks between two PWM edges. Duties closer than this are
+ * switched at the same edge, and duties closer than this to 0% or 100% are
+ * clamped, so the ISR can keep up. */
+#ifndef PWM_MIN_LOAD
+#define PWM_MIN_LOAD    50
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void pwm_init(uint8_t npins, const uint8_t* pins);
+/* Set the PWM frequency. An unsupported frequency is ignored. Until a
+ * frequency with room for PWM_MIN_LOAD ticks on both sides of an edge is
+ * set, duties are rounded to 0% or 100%. */
 void pwm_set_freq(uint16_t freq);
+/* Set the same duty cycle (0 to UINT16_MAX) for all pins */
 void pwm_set_duty(uint16_t duty);
 
+/* Set the duty cycle of one pin, channel being its index in the pins
+ * passed to pwm_init. Takes effect at the next period start. */
+void pwm_set_channel_duty(uint8_t channel, uint16_t duty);
+
+/* Set the duty cycles of all pins at once, so they change in the same
+ * period. duties has one entry per pin passed to pwm_init. */
+void pwm_set_duties(const uint16_t *duties);
+
 void pwm_restart();
 void pwm_start();
 void pwm_stop();
@@ -143,6 +143,32 @@ static uint16_t crc_ccitt(const uint8_t *data, size_t n)
 
 #define timeout_expired(start, len) ((uint32_t)(sdk_system_get_time() - (start)) >= (len))
 
+static void spi_device(const sdio_card_t *card, spi_device_t *spi)
+{
+    spi->bus = BUS;
+    spi->cs_pin = card->cs_pin;
+    spi->settings.mode = SPI_MODE0;
+    spi->settings.freq_divider = card->freq_divider;
+    spi->settings.msb = true;
+    spi->settings.endianness = SPI_LITTLE_ENDIAN;
+    spi->settings.minimal_pins = true;
+}
+
+// Card operations run with the shared bus locked and set up for the card
+static void bus_acquire(const sdio_card_t *card)
+{
+    spi_device_t spi;
+    spi_device(card, &spi);
+    spi_device_acquire(&spi);
+}
+
+static void bus_release(const sdio_card_t *card)
+{
+    spi_device_t spi;
+    spi_device(card, &spi);
+    spi_device_release(&spi);
+}
+
 inline static uint16_t spi_write_word(uint16_t word)
 {
     return (spi_transfer_8(BUS, word >> 8) << 8) | spi_transfer_8(BUS, word);
@@ -256,22 +282,8 @@ static sdio_error_t write_data_block(sdio_card_t *card, uint8_t token, uint8_t *
     return SDIO_ERR_NONE;
 }
 
-sdio_error_t sdio_init(sdio_card_t *card, uint8_t cs_pin, uint32_t high_freq_divider)
+static sdio_error_t init_card(sdio_card_t *card, uint32_t high_freq_divider)
 {
-    card->cs_pin = cs_pin;
-    card->type = SDIO_TYPE_UNKNOWN;
-
-    // setup SPI at 125kHz
-    spi_settings_t s = {
-        .mode = SPI_MODE0,
-        .freq_divider = SPI_FREQ_DIV_125K,
-        .msb = true,
-        .endianness = SPI_LITTLE_ENDIAN,
-        .minimal_pins = true
-    };
-    spi_set_settings(BUS, &s);
-    gpio_enable(card->cs_pin, GPIO_OUTPUT);
-
     uint32_t start = sdk_system_get_time();
 
     spi_cs_low(card);
@@ -342,6 +354,7 @@ sdio_error_t sdio_init(sdio_card_t *card, uint8_t cs_pin, uint32_t high_freq_div
     if (card->type == SDIO_TYPE_SD2 && (card->ocr.data & OCR_SDHC) == OCR_SDHC)
         card->type = SDIO_TYPE_SDHC;
 
+    card->freq_divider = high_freq_divider;
     spi_set_frequency_div(BUS, high_freq_divider);
 
     if (read_register(card, CMD10, &card->cid.data) != SDIO_ERR_NONE)
@@ -361,7 +374,7 @@ sdio_error_t sdio_init(sdio_card_t *card, uint8_t cs_pin, uint32_t high_freq_div
     return set_error(card, SDIO_ERR_NONE);
 }
 
-sdio_error_t sdio_read_sectors(sdio_card_t *card, uint32_t sector, uint8_t *dst, uint32_t count)
+static sdio_error_t read_sectors(sdio_card_t *card, uint32_t sector, uint8_t *dst, uint32_t count)
 {
     if (!count)
         return set_error(card, SDIO_ERR_IO);
@@ -386,7 +399,7 @@ sdio_error_t sdio_read_sectors(sdio_card_t *card, uint32_t sector, uint8_t *dst,
     return set_error(card, SDIO_ERR_NONE);
 }
 
-sdio_error_t sdio_write_sectors(sdio_card_t *card, uint32_t sector, uint8_t *src, uint32_t count)
+static sdio_error_t write_sectors(sdio_card_t *card, uint32_t sector, uint8_t *src, uint32_t count)
 {
     if (!count)
         return set_error(card, SDIO_ERR_IO);
@@ -425,7 +438,7 @@ sdio_error_t sdio_write_sectors(sdio_card_t *card, uint32_t sector, uint8_t *src
     return set_error(card, SDIO_ERR_NONE);
 }
 
-sdio_error_t sdio_erase_sectors(sdio_card_t *card, uint32_t first, uint32_t last)
+static sdio_error_t erase_sectors(sdio_card_t *card, uint32_t first, uint32_t last)
 {
     if (!card->csd.v1.erase_blk_en)
     {
@@ -450,3 +463,45 @@ sdio_error_t sdio_erase_sectors(sdio_card_t *card, uint32_t first, uint32_t last
     return set_error(card, wait() ? SDIO_ERR_NONE : SDIO_ERR_TIMEOUT);
 }
 
+
+sdio_error_t sdio_init(sdio_card_t *card, uint8_t cs_pin, uint32_t high_freq_divider)
+{
+    card->cs_pin = cs_pin;
+    card->type = SDIO_TYPE_UNKNOWN;
+    // setup SPI at 125kHz
+    card->freq_divider = SPI_FREQ_DIV_125K;
+
+    spi_device_t spi;
+    spi_device(card, &spi);
+    if (!spi_device_init(&spi))
+        return set_error(card, SDIO_ERR_IO);
+
+    bus_acquire(card);
+    sdio_error_t res = init_card(card, high_freq_divider);
+    bus_release(card);
+    return res;
+}
+
+sdio_error_t sdio_read_sectors(sdio_card_t *card, uint32_t sector, uint8_t *dst, uint32_t count)
+{
+    bus_acquire(card);
+    sdio_error_t res = read_sectors(card, sector, dst, count);
+    bus_release(card);
+    return res;
+}
+
+sdio_error_t sdio_write_sectors(sdio_card_t *card, uint32_t sector, uint8_t *src, uint32_t count)
+{
+    bus_acquire(card);
+    sdio_error_t res = write_sectors(card, sector, src, count);
+    bus_release(card);
+    return res;
+}
+
+sdio_error_t sdio_erase_sectors(sdio_card_t *card, uint32_t first, uint32_t last)
+{
+    bus_acquire(card);
+    sdio_error_t res = erase_sectors(card, first, last);
+    bus_release(card);
+    return res;
+}
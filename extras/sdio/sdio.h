@@ -42,6 +42,7 @@ typedef struct
 {
     sdio_error_t     error;        //!< Last operation result
     uint8_t          cs_pin;       //!< Chip Select GPIO pin
+    uint32_t         freq_divider; //!< SPI bus frequency divider
     sdio_card_type_t type;         //!< Card type
     bool             crc_enabled;  //!< True if CRC enabled for IO
     sdio_ocr_t       ocr;          //!< OCR register
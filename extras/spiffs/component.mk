@@ -8,6 +8,9 @@ SPIFFS_SIZE ?= 0x100000
 SPIFFS_LOG_PAGE_SIZE ?= 256
 SPIFFS_LOG_BLOCK_SIZE ?= 8192
 
+# Queue writes and erases to the extras/spiflash_async writer task.
+# extras/spiflash_async must be added to EXTRA_COMPONENTS.
+SPIFFS_ASYNC_WRITE ?= 0
 
 spiffs_CFLAGS += -DSPIFFS_SINGLETON=$(SPIFFS_SINGLETON)
 ifeq ($(SPIFFS_SINGLETON),1)
@@ -18,6 +21,7 @@ endif
 
 spiffs_CFLAGS += -DSPIFFS_LOG_PAGE_SIZE=$(SPIFFS_LOG_PAGE_SIZE)
 spiffs_CFLAGS += -DSPIFFS_LOG_BLOCK_SIZE=$(SPIFFS_LOG_BLOCK_SIZE)
+spiffs_CFLAGS += -DSPIFFS_ASYNC_WRITE=$(SPIFFS_ASYNC_WRITE)
 
 # Main program needs SPIFFS definitions because it includes spiffs_config.h
 PROGRAM_CFLAGS += $(spiffs_CFLAGS)
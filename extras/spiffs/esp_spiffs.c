@@ -11,6 +11,9 @@
 #include <stdbool.h>
 #include <esp/uart.h>
 #include <fcntl.h>
+#if SPIFFS_ASYNC_WRITE
+#include <spiflash_async.h>
+#endif
 
 spiffs fs;
 
@@ -31,9 +34,40 @@ static fs_buf_t cache_buf = {0};
 
 #define ESP_SPIFFS_CACHE_PAGES     5
 
+#if SPIFFS_ASYNC_WRITE
+/**
+ * Writes and erases are queued to the flash writer task. Reads go through
+ * spiflash_async_read so they see the queued data. If the writer task can't
+ * be started, flash is accessed synchronously.
+ */
+static bool async_writes = false;
+
+static bool flash_read(uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    return async_writes ? spiflash_async_read(addr, buf, size)
+                        : spiflash_read(addr, buf, size);
+}
+
+static bool flash_write(uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    return async_writes ? spiflash_async_write(addr, buf, size, NULL, NULL)
+                        : spiflash_write(addr, buf, size);
+}
+
+static bool flash_erase_sector(uint32_t addr)
+{
+    return async_writes ? spiflash_async_erase_sector(addr, NULL, NULL)
+                        : spiflash_erase_sector(addr);
+}
+#else
+#define flash_read(addr, buf, size)     spiflash_read(addr, buf, size)
+#define flash_write(addr, buf, size)    spiflash_write(addr, buf, size)
+#define flash_erase_sector(addr)        spiflash_erase_sector(addr)
+#endif
+
 static s32_t esp_spiffs_read(u32_t addr, u32_t size, u8_t *dst)
 {
-    if (!spiflash_read(addr, dst, size)) {
+    if (!flash_read(addr, dst, size)) {
         return SPIFFS_ERR_INTERNAL;
     }
 
@@ -42,7 +76,7 @@ static s32_t esp_spiffs_read(u32_t addr, u32_t size, u8_t *dst)
 
 static s32_t esp_spiffs_write(u32_t addr, u32_t size, u8_t *src)
 {
-    if (!spiflash_write(addr, src, size)) {
+    if (!flash_write(addr, src, size)) {
         return SPIFFS_ERR_INTERNAL;
     }
 
@@ -54,7 +88,7 @@ static s32_t esp_spiffs_erase(u32_t addr, u32_t size)
     uint32_t sectors = size / SPI_FLASH_SECTOR_SIZE;
 
     for (uint32_t i = 0; i < sectors; i++) {
-        if (!spiflash_erase_sector(addr + (SPI_FLASH_SECTOR_SIZE * i))) {
+        if (!flash_erase_sector(addr + (SPI_FLASH_SECTOR_SIZE * i))) {
             return SPIFFS_ERR_INTERNAL;
         }
     }
@@ -92,6 +126,12 @@ void esp_spiffs_init(uint32_t addr, uint32_t size)
 
     config.fh_ix_offset = 3;
 
+#if SPIFFS_ASYNC_WRITE
+    async_writes = spiflash_async_init();
+    if (!async_writes) {
+        printf("SPIFFS: flash writer task not started, writing synchronously\n");
+    }
+#endif
 }
 
 void esp_spiffs_deinit()
@@ -0,0 +1,284 @@
+/**
+ * Asynchronous SPI flash writer.
+ *
+ * Part of esp-open-rtos
+ * BSD Licensed as described in the file LICENSE
+ */
+#include "spiflash_async.h"
+
+#include <spiflash.h>
+#include <flashchip.h>
+#include <task.h>
+#include <semphr.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    REQ_WRITE,
+    REQ_ERASE,
+} req_type_t;
+
+typedef struct request {
+    struct request *next;
+    req_type_t type;
+    bool busy;  // being executed by the writer task, must not be merged
+    uint32_t addr;
+    uint32_t size;
+    spiflash_async_cb_t cb;
+    void *arg;
+    uint8_t *data;
+} request_t;
+
+static request_t *head = NULL;
+static request_t *tail = NULL;
+
+static SemaphoreHandle_t lock = NULL;       // protects the request list
+static SemaphoreHandle_t slots = NULL;      // free places in the queue
+static SemaphoreHandle_t idle = NULL;       // given when the queue is empty
+static TaskHandle_t writer_task = NULL;
+static volatile bool failed = false;        // a request without callback failed
+
+static void writer(void *pvParameters)
+{
+    while (true) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        request_t *req = head;
+        if (req) {
+            req->busy = true;
+        }
+        xSemaphoreGive(lock);
+
+        if (!req) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        bool result;
+        if (req->type == REQ_WRITE) {
+            result = spiflash_write(req->addr, req->data, req->size);
+        } else {
+            result = spiflash_erase_sector(req->addr);
+        }
+
+        // Request stays in the list until it is done so readers see its data
+        xSemaphoreTake(lock, portMAX_DELAY);
+        head = req->next;
+        if (!head) {
+            tail = NULL;
+            xSemaphoreGive(idle);
+        }
+        xSemaphoreGive(lock);
+        xSemaphoreGive(slots);
+
+        if (req->cb) {
+            req->cb(result, req->arg);
+        } else if (!result) {
+            failed = true;
+        }
+        free(req->data);
+        free(req);
+    }
+}
+
+static void enqueue(request_t *req)
+{
+    xSemaphoreTake(slots, portMAX_DELAY);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (tail) {
+        tail->next = req;
+    } else {
+        head = req;
+    }
+    tail = req;
+    xSemaphoreGive(lock);
+
+    xTaskNotifyGive(writer_task);
+}
+
+/**
+ * Append data to the last queued write if it is adjacent.
+ */
+static bool try_merge(uint32_t addr, const uint8_t *buf, uint32_t size)
+{
+    bool merged = false;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    request_t *req = tail;
+    if (req && !req->busy && req->type == REQ_WRITE && !req->cb
+            && req->addr + req->size == addr
+            && req->size + size <= SPIFLASH_ASYNC_MERGE_MAX) {
+        uint8_t *data = realloc(req->data, req->size + size);
+        if (data) {
+            memcpy(data + req->size, buf, size);
+            req->data = data;
+            req->size += size;
+            merged = true;
+        }
+    }
+    xSemaphoreGive(lock);
+
+    return merged;
+}
+
+/**
+ * Report the failure of a request nobody waited for, once.
+ */
+static bool take_error(void)
+{
+    bool error = failed;
+    failed = false;
+    return error;
+}
+
+void spiflash_async_notify_cb(bool result, void *task)
+{
+    xTaskNotifyGive((TaskHandle_t)task);
+}
+
+bool spiflash_async_init(void)
+{
+    if (writer_task) {
+        return true;
+    }
+
+    lock = xSemaphoreCreateMutex();
+    slots = xSemaphoreCreateCounting(SPIFLASH_ASYNC_QUEUE_LEN,
+            SPIFLASH_ASYNC_QUEUE_LEN);
+    idle = xSemaphoreCreateBinary();
+    if (lock && slots && idle &&
+            xTaskCreate(writer, "spiflash_async", SPIFLASH_ASYNC_TASK_STACK,
+                NULL, SPIFLASH_ASYNC_TASK_PRIORITY, &writer_task) == pdPASS) {
+        return true;
+    }
+
+    if (lock) vSemaphoreDelete(lock);
+    if (slots) vSemaphoreDelete(slots);
+    if (idle) vSemaphoreDelete(idle);
+    lock = slots = idle = NULL;
+    writer_task = NULL;
+    return false;
+}
+
+bool spiflash_async_write(uint32_t addr, const uint8_t *buf, uint32_t size,
+        spiflash_async_cb_t cb, void *arg)
+{
+    if (!buf || (addr + size) > sdk_flashchip.chip_size || take_error()) {
+        return false;
+    }
+    if (!size) {
+        return true;
+    }
+
+    if (!cb && try_merge(addr, buf, size)) {
+        return true;
+    }
+
+    request_t *req = malloc(sizeof(request_t));
+    if (!req) {
+        return false;
+    }
+    req->data = malloc(size);
+    if (!req->data) {
+        free(req);
+        return false;
+    }
+    memcpy(req->data, buf, size);
+
+    req->next = NULL;
+    req->type = REQ_WRITE;
+    req->busy = false;
+    req->addr = addr;
+    req->size = size;
+    req->cb = cb;
+    req->arg = arg;
+
+    enqueue(req);
+    return true;
+}
+
+bool spiflash_async_erase_sector(uint32_t addr, spiflash_async_cb_t cb,
+        void *arg)
+{
+    if ((addr & (SPI_FLASH_SECTOR_SIZE - 1))
+            || (addr + SPI_FLASH_SECTOR_SIZE) > sdk_flashchip.chip_size
+            || take_error()) {
+        return false;
+    }
+
+    request_t *req = malloc(sizeof(request_t));
+    if (!req) {
+        return false;
+    }
+
+    req->next = NULL;
+    req->type = REQ_ERASE;
+    req->busy = false;
+    req->addr = addr;
+    req->size = SPI_FLASH_SECTOR_SIZE;
+    req->cb = cb;
+    req->arg = arg;
+    req->data = NULL;
+
+    enqueue(req);
+    return true;
+}
+
+bool spiflash_async_read(uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    if (take_error()) {
+        return false;
+    }
+    if (!size) {
+        return true;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    bool result = spiflash_read(addr, buf, size);
+
+    // Apply pending requests in order. Programming flash can only clear
+    // bits so a write is AND-ed with whatever is there before it.
+    for (request_t *req = head; result && req; req = req->next) {
+        uint32_t start = req->addr > addr ? req->addr : addr;
+        uint32_t end = req->addr + req->size < addr + size ?
+            req->addr + req->size : addr + size;
+        if (start >= end) {
+            continue;
+        }
+
+        if (req->type == REQ_ERASE) {
+            memset(buf + (start - addr), 0xFF, end - start);
+        } else {
+            uint8_t *dst = buf + (start - addr);
+            const uint8_t *src = req->data + (start - req->addr);
+            for (uint32_t i = 0; i < end - start; i++) {
+                dst[i] &= src[i];
+            }
+        }
+    }
+
+    xSemaphoreGive(lock);
+
+    return result;
+}
+
+bool spiflash_async_flush(TickType_t timeout)
+{
+    while (true) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        bool empty = (head == NULL);
+        if (!empty) {
+            // drop a stale signal from an earlier time the queue was empty
+            xSemaphoreTake(idle, 0);
+        }
+        xSemaphoreGive(lock);
+
+        if (empty) {
+            return !take_error();
+        }
+        if (xSemaphoreTake(idle, timeout) != pdTRUE) {
+            return false;
+        }
+    }
+}
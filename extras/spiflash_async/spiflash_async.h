@@ -0,0 +1,128 @@
+/**
+ * Asynchronous SPI flash writer.
+ *
+ * Erase and program requests are queued and executed by a dedicated task so
+ * callers don't block for the flash program/erase cycles. Adjacent writes
+ * that are still waiting in the queue are merged. Reads done through
+ * spiflash_async_read() see the data of pending requests.
+ *
+ * The failure of a request queued without a callback is reported once, by
+ * the next spiflash_async_write(), spiflash_async_erase_sector(),
+ * spiflash_async_read() or spiflash_async_flush() call returning false.
+ *
+ * Part of esp-open-rtos
+ * BSD Licensed as described in the file LICENSE
+ */
+#ifndef __SPIFLASH_ASYNC_H__
+#define __SPIFLASH_ASYNC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <FreeRTOS.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of requests waiting in the queue. When the queue is full
+ * new requests block until there is space.
+ */
+#ifndef SPIFLASH_ASYNC_QUEUE_LEN
+#define SPIFLASH_ASYNC_QUEUE_LEN 8
+#endif
+
+/**
+ * Adjacent writes are merged into a single request up to this size.
+ */
+#ifndef SPIFLASH_ASYNC_MERGE_MAX
+#define SPIFLASH_ASYNC_MERGE_MAX 1024
+#endif
+
+#ifndef SPIFLASH_ASYNC_TASK_PRIORITY
+#define SPIFLASH_ASYNC_TASK_PRIORITY 2
+#endif
+
+#ifndef SPIFLASH_ASYNC_TASK_STACK
+#define SPIFLASH_ASYNC_TASK_STACK 256
+#endif
+
+/**
+ * Completion callback. Called from the flash writer task.
+ *
+ * @param result Result of the spiflash operation
+ * @param arg Argument passed with the request
+ */
+typedef void (*spiflash_async_cb_t)(bool result, void *arg);
+
+/**
+ * Completion callback that gives a task notification to the task passed
+ * as the callback argument, e.g. xTaskGetCurrentTaskHandle().
+ */
+void spiflash_async_notify_cb(bool result, void *task);
+
+/**
+ * Start the flash writer task. Must succeed before any other function of
+ * this module is used.
+ *
+ * @return true if success, otherwise false
+ */
+bool spiflash_async_init(void);
+
+/**
+ * Queue a write. Data is copied so the buffer can be reused right away.
+ *
+ * Requests without a callback may be merged with the previous request if
+ * they are adjacent.
+ *
+ * @param addr Address to write to. Can be not aligned.
+ * @param buf Data to write.
+ * @param size Size of data to write.
+ * @param cb Completion callback, can be NULL.
+ * @param arg Argument passed to the callback.
+ *
+ * @return true if the request is queued (or size is 0), false if not or an
+ *         earlier request failed
+ */
+bool spiflash_async_write(uint32_t addr, const uint8_t *buf, uint32_t size,
+        spiflash_async_cb_t cb, void *arg);
+
+/**
+ * Queue a sector erase.
+ *
+ * @param addr Address of sector to erase. Must be sector aligned.
+ * @param cb Completion callback, can be NULL.
+ * @param arg Argument passed to the callback.
+ *
+ * @return true if the request is queued, false if not or an earlier request
+ *         failed
+ */
+bool spiflash_async_erase_sector(uint32_t addr, spiflash_async_cb_t cb,
+        void *arg);
+
+/**
+ * Read data from SPI flash as it will be when all queued requests are done.
+ *
+ * @param addr Address to read from. Can be not aligned.
+ * @param buf Buffer to read to.
+ * @param size Size of data to read.
+ *
+ * @return true if success, false on error or if an earlier request failed
+ */
+bool spiflash_async_read(uint32_t addr, uint8_t *buf, uint32_t size);
+
+/**
+ * Wait until all queued requests are done.
+ *
+ * @param timeout Maximum time to wait in ticks
+ *
+ * @return true if the queue is empty, false on timeout or if a request
+ *         failed
+ */
+bool spiflash_async_flush(TickType_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __SPIFLASH_ASYNC_H__
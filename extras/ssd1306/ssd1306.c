@@ -11,6 +11,7 @@
  */
 #include "ssd1306.h"
 #include <stdio.h>
+#include <string.h>
 #if (SSD1306_I2C_SUPPORT)
     #include <i2c/i2c.h>
 #endif
@@ -79,6 +80,9 @@
 #define SH1106_SET_LOW_COL_ADDR      (0x00)
 #define SH1106_SET_HIGH_COL_ADDR     (0x10)
 
+/* Framebuffer bytes a window setup is worth: six command transactions */
+#define SSD1306_WINDOW_COST          (18)
+
 #ifdef SSD1306_DEBUG
 #define debug(fmt, ...) printf("%s: " fmt "\n", "SSD1306", ## __VA_ARGS__)
 #else
@@ -90,9 +94,41 @@
 
 
 #if (SSD1306_I2C_SUPPORT)
-static int inline i2c_send(const ssd1306_t *dev, uint8_t reg, uint8_t* data, uint8_t len)
+static int inline i2c_send(const ssd1306_t *dev, uint8_t reg, const uint8_t* data, uint8_t len)
 {
-    return i2c_slave_write(dev->addr, &reg, data, len);
+    return i2c_bus_slave_write(dev->bus, dev->addr, &reg, data, len);
+}
+#endif
+
+#if (SSD1306_SPI4_SUPPORT) || (SSD1306_SPI3_SUPPORT)
+static const spi_settings_t spi_settings = {
+    .mode         = SPI_MODE0,
+    .freq_divider = SPI_FREQ_DIV_8M,
+    .msb          = true,
+    .endianness   = SPI_LITTLE_ENDIAN,
+    .minimal_pins = true
+};
+
+static inline void spi_device(const ssd1306_t *dev, spi_device_t *spi)
+{
+    spi->bus = SPI_BUS;
+    spi->cs_pin = dev->cs_pin;
+    spi->settings = spi_settings;
+}
+
+/* Lock the shared bus and select the display */
+static void spi_select(const ssd1306_t *dev)
+{
+    spi_device_t spi;
+    spi_device(dev, &spi);
+    spi_device_select(&spi);
+}
+
+static void spi_deselect(const ssd1306_t *dev)
+{
+    spi_device_t spi;
+    spi_device(dev, &spi);
+    spi_device_deselect(&spi);
 }
 #endif
 
@@ -114,19 +150,19 @@ int ssd1306_command(const ssd1306_t *dev, uint8_t cmd)
 #endif
 #if (SSD1306_SPI4_SUPPORT)
         case SSD1306_PROTO_SPI4:
+            spi_select(dev);
             gpio_write(dev->dc_pin, false); // command mode
-            gpio_write(dev->cs_pin, false);
             spi_transfer_8(SPI_BUS, cmd);
-            gpio_write(dev->cs_pin, true);
+            spi_deselect(dev);
             break;
 #endif
 #if (SSD1306_SPI3_SUPPORT)
         case SSD1306_PROTO_SPI3:
-            gpio_write(dev->cs_pin, false);
+            spi_select(dev);
             spi_set_command(SPI_BUS,1,0); // command mode
             spi_transfer_8(SPI_BUS, cmd);
             spi_clear_command(SPI_BUS);
-            gpio_write(dev->cs_pin, true);
+            spi_deselect(dev);
             break;
 #endif
         default:
@@ -142,6 +178,9 @@ int ssd1306_command(const ssd1306_t *dev, uint8_t cmd)
 int ssd1306_init(const ssd1306_t *dev)
 {
     uint8_t pin_cfg;
+#if (SSD1306_SPI4_SUPPORT) || (SSD1306_SPI3_SUPPORT)
+    spi_device_t spi;
+#endif
     switch (dev->height) {
         case 16:
         case 32:
@@ -162,17 +201,17 @@ int ssd1306_init(const ssd1306_t *dev)
 #endif
 #if (SSD1306_SPI4_SUPPORT)
         case SSD1306_PROTO_SPI4:
-            gpio_enable(dev->cs_pin, GPIO_OUTPUT);
-            gpio_write(dev->cs_pin, true);
             gpio_enable(dev->dc_pin, GPIO_OUTPUT);
-            spi_init(SPI_BUS, SPI_MODE0, SPI_FREQ_DIV_8M, true, SPI_LITTLE_ENDIAN, true);
+            spi_device(dev, &spi);
+            if (!spi_device_init(&spi))
+                return -EIO;
             break;
 #endif
 #if (SSD1306_SPI3_SUPPORT)
         case SSD1306_PROTO_SPI3:
-            gpio_enable(dev->cs_pin, GPIO_OUTPUT);
-            gpio_write(dev->cs_pin, true);
-            spi_init(SPI_BUS, SPI_MODE0, SPI_FREQ_DIV_8M, true, SPI_LITTLE_ENDIAN, true);
+            spi_device(dev, &spi);
+            if (!spi_device_init(&spi))
+                return -EIO;
             break;
 #endif
         default:
@@ -262,7 +301,7 @@ int ssd1306_load_frame_buffer(const ssd1306_t *dev, uint8_t buf[])
 #endif
 #if (SSD1306_SPI4_SUPPORT)
         case SSD1306_PROTO_SPI4:
-            gpio_write(dev->cs_pin, false);
+            spi_select(dev);
             if(dev->screen == SSD1306_SCREEN)
             {
                 gpio_write(dev->dc_pin, true); // data mode
@@ -283,12 +322,12 @@ int ssd1306_load_frame_buffer(const ssd1306_t *dev, uint8_t buf[])
                         spi_repeat_send_8(SPI_BUS,0,dev->width);
                 }
             }
-            gpio_write(dev->cs_pin, true);
+            spi_deselect(dev);
             break;
 #endif
 #if (SSD1306_SPI3_SUPPORT)
         case SSD1306_PROTO_SPI3:
-            gpio_write(dev->cs_pin, false);
+            spi_select(dev);
             if(dev->screen == SSD1306_SCREEN)
             {
                 spi_set_command(SPI_BUS,1,1); // data mode
@@ -312,7 +351,7 @@ int ssd1306_load_frame_buffer(const ssd1306_t *dev, uint8_t buf[])
                 }
             }
             spi_clear_command(SPI_BUS);
-            gpio_write(dev->cs_pin, true);
+            spi_deselect(dev);
             break;
 #endif
         default:
@@ -320,9 +359,122 @@ int ssd1306_load_frame_buffer(const ssd1306_t *dev, uint8_t buf[])
             return -EPROTONOSUPPORT;
     }
 
+    // The display now matches buf. After a clear it no longer matches the
+    // framebuffer, the next flush sends it whole.
+    if (dev->dirty) {
+        memset(dev->dirty, 0, sizeof(ssd1306_dirty_t));
+        if (!buf)
+            ssd1306_mark_dirty(dev, 0, 0, dev->width, dev->height);
+    }
     return 0;
 }
 
+/* Send framebuffer bytes to the display RAM at the current address */
+static int send_data(const ssd1306_t *dev, const uint8_t *data, uint8_t len)
+{
+    switch (dev->protocol) {
+#if (SSD1306_I2C_SUPPORT)
+        case SSD1306_PROTO_I2C:
+            return i2c_send(dev, 0x40, data, len);
+#endif
+#if (SSD1306_SPI4_SUPPORT)
+        case SSD1306_PROTO_SPI4:
+            spi_select(dev);
+            gpio_write(dev->dc_pin, true); // data mode
+            spi_transfer(SPI_BUS, data, NULL, len, SPI_8BIT);
+            spi_deselect(dev);
+            return 0;
+#endif
+#if (SSD1306_SPI3_SUPPORT)
+        case SSD1306_PROTO_SPI3:
+            spi_select(dev);
+            spi_set_command(SPI_BUS,1,1); // data mode
+            for (uint8_t i = 0; i < len; i++)
+                spi_transfer_8(SPI_BUS, data[i]);
+            spi_clear_command(SPI_BUS);
+            spi_deselect(dev);
+            return 0;
+#endif
+        default:
+            debug("Unsupported protocol");
+            return -EPROTONOSUPPORT;
+    }
+}
+
+/* Send pages first..last, columns start..end - 1, as one SSD1306 window */
+static int flush_window(const ssd1306_t *dev, const uint8_t *fb,
+                        uint8_t first, uint8_t last, uint8_t start, uint8_t end)
+{
+    int err;
+    if ((err = ssd1306_set_column_addr(dev, start, end - 1)))
+        return err;
+    if ((err = ssd1306_set_page_addr(dev, first, last)))
+        return err;
+    for (uint8_t page = first; page <= last; page++)
+        if ((err = send_data(dev, &fb[page * dev->width + start], end - start)))
+            return err;
+    return (last - first + 1) * (end - start);
+}
+
+int ssd1306_flush(const ssd1306_t *dev, uint8_t *fb)
+{
+    ssd1306_dirty_t *dirty = dev->dirty;
+    uint8_t pages = dev->height / 8;
+    int err, sent = 0;
+
+    if (!dirty) {
+        if ((err = ssd1306_load_frame_buffer(dev, fb)))
+            return err;
+        return dev->width * pages;
+    }
+
+    if (dev->screen == SH1106_SCREEN) {
+        // Page addressing only, one run per dirty page
+        for (uint8_t page = 0; page < pages; page++) {
+            uint8_t start = dirty->start[page], end = dirty->end[page];
+            if (!end)
+                continue;
+            if ((err = sh1106_go_coordinate(dev, start, page)))
+                return err;
+            if ((err = send_data(dev, &fb[page * dev->width + start], end - start)))
+                return err;
+            dirty->end[page] = 0;
+            sent += end - start;
+        }
+        return sent;
+    }
+
+    // Neighbouring dirty pages are merged into one window when the extra
+    // columns cost less than setting up another window
+    uint8_t page = 0;
+    while (page < pages) {
+        if (!dirty->end[page]) {
+            page++;
+            continue;
+        }
+        uint8_t first = page, last = page;
+        uint8_t start = dirty->start[page], end = dirty->end[page];
+        while (last + 1 < pages && dirty->end[last + 1]) {
+            uint8_t s = dirty->start[last + 1], e = dirty->end[last + 1];
+            uint8_t ms = s < start ? s : start, me = e > end ? e : end;
+            uint16_t merged = (last - first + 2) * (me - ms);
+            uint16_t separate = (last - first + 1) * (end - start) + (e - s)
+                + SSD1306_WINDOW_COST;
+            if (merged > separate)
+                break;
+            start = ms;
+            end = me;
+            last++;
+        }
+        if ((err = flush_window(dev, fb, first, last, start, end)) < 0)
+            return err;
+        sent += err;
+        for (; page <= last; page++)
+            dirty->end[page] = 0;
+    }
+    return sent;
+}
+
 int ssd1306_display_on(const ssd1306_t *dev, bool on)
 {
     return ssd1306_command(dev, on ? SSD1306_SET_DISPLAY_ON : SSD1306_SET_DISPLAY_OFF);
@@ -494,6 +646,45 @@ int ssd1306_set_whole_display_lighting(const ssd1306_t *dev, bool light)
     return ssd1306_command(dev, light ? SSD1306_SET_ENTIRE_DISP_ON :  SSD1306_SET_ENTIRE_DISP_OFF);
 }
 
+/* Grow the dirty window of a page to include column x */
+static inline void mark_dirty(ssd1306_dirty_t *dirty, uint8_t page, uint8_t x)
+{
+    if (!dirty->end[page]) {
+        dirty->start[page] = x;
+        dirty->end[page] = x + 1;
+        return;
+    }
+    if (x < dirty->start[page])
+        dirty->start[page] = x;
+    if (x >= dirty->end[page])
+        dirty->end[page] = x + 1;
+}
+
+/* Store a framebuffer byte, recording it in the dirty region if it changed */
+static inline void fb_set(const ssd1306_t *dev, uint8_t *fb, uint16_t index, uint8_t value)
+{
+    if (fb[index] == value)
+        return;
+    fb[index] = value;
+    if (dev->dirty)
+        mark_dirty(dev->dirty, index / dev->width, index % dev->width);
+}
+
+void ssd1306_mark_dirty(const ssd1306_t *dev, uint8_t x, uint8_t y, uint8_t w, uint8_t h)
+{
+    if (!dev->dirty || !w || !h || x >= dev->width || y >= dev->height)
+        return;
+    if (x + w > dev->width)
+        w = dev->width - x;
+    if (y + h > dev->height)
+        h = dev->height - y;
+
+    for (uint8_t page = y / 8; page <= (y + h - 1) / 8; page++) {
+        mark_dirty(dev->dirty, page, x);
+        mark_dirty(dev->dirty, page, x + w - 1);
+    }
+}
+
 /* one byte of xbm - 8 dots in line of picture source
  * one byte of fb - 8 rows for 1 column of screen
  */
@@ -528,13 +719,13 @@ int ssd1306_draw_pixel(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, ss
     switch (color)
     {
     case OLED_COLOR_WHITE:
-        fb[index] |= (1 << (y & 7));
+        fb_set(dev, fb, index, fb[index] | (1 << (y & 7)));
         break;
     case OLED_COLOR_BLACK:
-        fb[index] &= ~(1 << (y & 7));
+        fb_set(dev, fb, index, fb[index] & ~(1 << (y & 7)));
         break;
     case OLED_COLOR_INVERT:
-        fb[index] ^= (1 << (y & 7));
+        fb_set(dev, fb, index, fb[index] ^ (1 << (y & 7)));
         break;
     default:
         break;
@@ -563,7 +754,7 @@ int ssd1306_draw_hline(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, ui
     case OLED_COLOR_WHITE:
         while (t--)
         {
-            fb[index] |= mask;
+            fb_set(dev, fb, index, fb[index] | mask);
             ++index;
         }
         break;
@@ -571,14 +762,14 @@ int ssd1306_draw_hline(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, ui
         mask = ~mask;
         while (t--)
         {
-            fb[index] &= mask;
+            fb_set(dev, fb, index, fb[index] & mask);
             ++index;
         }
         break;
     case OLED_COLOR_INVERT:
         while (t--)
         {
-            fb[index] ^= mask;
+            fb_set(dev, fb, index, fb[index] ^ mask);
             ++index;
         }
         break;
@@ -615,13 +806,13 @@ int ssd1306_draw_vline(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, ui
         switch (color)
         {
         case OLED_COLOR_WHITE:
-            fb[index] |= mask;
+            fb_set(dev, fb, index, fb[index] | mask);
             break;
         case OLED_COLOR_BLACK:
-            fb[index] &= ~mask;
+            fb_set(dev, fb, index, fb[index] & ~mask);
             break;
         case OLED_COLOR_INVERT:
-            fb[index] ^= mask;
+            fb_set(dev, fb, index, fb[index] ^ mask);
             break;
         default:
             break;
@@ -639,7 +830,7 @@ int ssd1306_draw_vline(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, ui
         case OLED_COLOR_WHITE:
             do
             {
-               fb[index] = 0xff;
+               fb_set(dev, fb, index, 0xff);
                index += dev->width;
                t -= 8;
             } while (t >= 8);
@@ -647,7 +838,7 @@ int ssd1306_draw_vline(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, ui
         case OLED_COLOR_BLACK:
             do
             {
-               fb[index] = 0x00;
+               fb_set(dev, fb, index, 0x00);
                index += dev->width;
                t -= 8;
             } while (t >= 8);
@@ -655,7 +846,7 @@ int ssd1306_draw_vline(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, ui
         case OLED_COLOR_INVERT:
             do
             {
-                fb[index] = ~fb[index];
+                fb_set(dev, fb, index, ~fb[index]);
                 index += dev->width;
                 t -= 8;
             } while (t >= 8);
@@ -672,13 +863,13 @@ int ssd1306_draw_vline(const ssd1306_t *dev, uint8_t *fb, int8_t x, int8_t y, ui
         switch (color)
         {
         case OLED_COLOR_WHITE:
-            fb[index] |= mask;
+            fb_set(dev, fb, index, fb[index] | mask);
             break;
         case OLED_COLOR_BLACK:
-            fb[index] &= ~mask;
+            fb_set(dev, fb, index, fb[index] & ~mask);
             break;
         case OLED_COLOR_INVERT:
-            fb[index] ^= mask;
+            fb_set(dev, fb, index, fb[index] ^ mask);
             break;
         default:
             break;
@@ -58,6 +58,22 @@ typedef enum
     SH1106_SCREEN
 } ssd1306_screen_t;
 
+/**
+ * Maximum number of 8 pixel pages (64px height)
+ */
+#define SSD1306_MAX_PAGES 8
+
+/**
+ * Changed part of the framebuffer since the last flush: a column range
+ * start..end - 1 for every page, end = 0 if the page is clean.
+ * A zero initialized structure is clean.
+ */
+typedef struct
+{
+    uint8_t start[SSD1306_MAX_PAGES];
+    uint8_t end[SSD1306_MAX_PAGES];
+} ssd1306_dirty_t;
+
 /**
  * Device descriptor
  */
@@ -65,6 +81,9 @@ typedef struct
 {
     ssd1306_protocol_t protocol;
     ssd1306_screen_t screen ;
+#if (SSD1306_I2C_SUPPORT)
+    uint8_t bus ;                 //!< I2C bus number, used by SSD1306_PROTO_I2C
+#endif
     union {
 #if (SSD1306_I2C_SUPPORT)
         uint8_t addr ;          //!< I2C address, used by SSD1306_PROTO_I2C
@@ -76,6 +95,7 @@ typedef struct
 #endif
     uint8_t width;                //!< Screen width, currently supported 128px, 96px
     uint8_t height;               //!< Screen height, currently supported 16px, 32px, 64px
+    ssd1306_dirty_t *dirty;       //!< Dirty region tracking for ssd1306_flush(), NULL to disable
 } ssd1306_t;
 
 /**
@@ -147,6 +167,27 @@ int ssd1306_load_xbm(const ssd1306_t *dev, uint8_t *xbm, uint8_t *fb);
  */
 int ssd1306_load_frame_buffer(const ssd1306_t *dev, uint8_t buf[]);
 
+/**
+ * Send the parts of the framebuffer changed by the drawing functions since
+ * the last flush or load. Without dirty tracking in the descriptor the whole
+ * framebuffer is sent.
+ * @param dev Pointer to device descriptor
+ * @param fb Pointer to framebuffer. Framebuffer size = width * height / 8
+ * @return Number of framebuffer bytes sent, negative if error occured
+ */
+int ssd1306_flush(const ssd1306_t *dev, uint8_t *fb);
+
+/**
+ * Mark an area as changed, for framebuffer writes not done with the drawing
+ * functions.
+ * @param dev Pointer to device descriptor
+ * @param x X coordinate
+ * @param y Y coordinate
+ * @param w Width
+ * @param h Height
+ */
+void ssd1306_mark_dirty(const ssd1306_t *dev, uint8_t x, uint8_t y, uint8_t w, uint8_t h);
+
 /**
  * Clear SSD1306 RAM.
  * @param dev Pointer to device descriptor
@@ -38,6 +38,7 @@ typedef enum
 } tsl2561_gain_t;
 
 typedef struct {
+    uint8_t i2c_bus;
     tsl2561_i2c_addr_t i2c_addr;
     uint8_t integration_time;
     uint8_t gain;
@@ -38,6 +38,7 @@ typedef enum
 } tsl4531_part_id_t;
 
 typedef struct {
+    uint8_t i2c_bus;
     tsl4531_i2c_addr_t i2c_addr;
     uint8_t integration_time_id;
     bool skip_power_save;
@@ -25,6 +25,7 @@
 #include "i2s_dma/i2s_dma.h"
 
 #include <string.h>
+#include <stddef.h>
 #include <malloc.h>
 
 // #define WS2812_I2S_DEBUG
@@ -37,7 +38,7 @@
 #endif
 
 #define MAX_DMA_BLOCK_SIZE      4095
-#define DMA_PIXEL_SIZE          12    // each colour takes 4 bytes
+#define DMA_COLOUR_SIZE         4     // each colour takes 4 bytes
 
 /**
  * Amount of zero data to produce WS2812 reset condition.
@@ -48,25 +49,72 @@
 
 static uint8_t i2s_dma_zero_buf[WS2812_ZEROES_LENGTH] = {0};
 
-static dma_descriptor_t *dma_block_list;
-static uint32_t dma_block_list_size;
+/**
+ * Each frame buffer has its own descriptor chain, so a frame can be encoded
+ * while another one is being transmitted.
+ */
+typedef struct {
+    dma_descriptor_t *dma_block_list;
+    void *dma_buffer;
+} frame_buffer_t;
 
-static void *dma_buffer;
+static frame_buffer_t frame_buffers[WS2812_I2S_MAX_BUFFERS];
+static uint32_t frame_buffers_number;
+
+static uint32_t dma_block_list_size;
 static uint32_t dma_buffer_size;
+static uint32_t pixels_count;
+
+/**
+ * Encoder state.
+ *
+ * encode_table maps a colour byte to the 32 bits of I2S data encoding it,
+ * so a pixel is encoded with one table load and one word store per colour.
+ * The table is built in DRAM at init time, extras rodata lives in flash.
+ */
+static uint32_t encode_table[256];
+static uint8_t identity_lut[256];
+
+static uint8_t channels_number;                 // 3 for RGB, 4 for RGBW
+static uint8_t channel_offset[4];               // pixel field sent in each slot
+static const uint8_t *channel_lut[4];           // LUT by ws2812_channel_t
+static bool luts_enabled;
+
+/**
+ * Frame buffers are used as a ring. 'frame_head' is the buffer being
+ * transmitted (or to be transmitted next), 'frames_queued' the number of
+ * buffers submitted and not yet transmitted, including the one in
+ * transmission. The buffer to encode the next frame into is
+ * (frame_head + frames_queued) % frame_buffers_number, which is not
+ * changed by the ISR advancing the head.
+ */
+static volatile uint32_t frame_head;
+static volatile uint32_t frames_queued;
+
+static TaskHandle_t notify_task;
 
 #ifdef WS2812_I2S_DEBUG
 volatile uint32_t dma_isr_counter = 0;
 #endif
 
-static volatile bool i2s_dma_processing = false;
-
 static void dma_isr_handler(void)
 {
     if (i2s_dma_is_eof_interrupt()) {
 #ifdef WS2812_I2S_DEBUG
         dma_isr_counter++;
 #endif
-        i2s_dma_processing = false;
+        frame_head = (frame_head + 1) % frame_buffers_number;
+        frames_queued--;
+        if (frames_queued) {
+            // next frame is ready, swap to its descriptor chain
+            i2s_dma_start(frame_buffers[frame_head].dma_block_list);
+        }
+
+        if (notify_task) {
+            BaseType_t task_woken = pdFALSE;
+            vTaskNotifyGiveFromISR(notify_task, &task_woken);
+            portEND_SWITCHING_ISR(task_woken);
+        }
     }
     i2s_dma_clear_interrupt();
 }
@@ -76,7 +124,8 @@ static void dma_isr_handler(void)
  * The last two blocks are zero block and stop block.
  * The last block is a stop terminal block. It has no data and no next block.
  */
-static inline void init_descriptors_list(uint8_t *buf, uint32_t total_dma_data_size)
+static inline void init_descriptors_list(dma_descriptor_t *dma_block_list,
+        uint8_t *buf, uint32_t total_dma_data_size)
 {
     for (int i = 0; i < dma_block_list_size; i++) {
         dma_block_list[i].owner = 1;
@@ -117,9 +166,88 @@ static inline void init_descriptors_list(uint8_t *buf, uint32_t total_dma_data_s
     }
 }
 
+/**
+ * Each colour bit is sent as 4 I2S bits, 1110 for one and 1000 for zero.
+ */
+static uint32_t nibble_pattern(uint32_t nibble)
+{
+    uint32_t pattern = 0;
+    for (int i = 3; i >= 0; i--) {
+        pattern = (pattern << 4) | (nibble & (1 << i) ? 0xE : 0x8);
+    }
+    return pattern;
+}
+
+static void init_encoder(const ws2812_i2s_config_t *config)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        // low nibble pattern goes first in memory
+        encode_table[i] = nibble_pattern(i & 0x0F) | (nibble_pattern(i >> 4) << 16);
+        identity_lut[i] = i;
+    }
+
+    const uint8_t R = offsetof(ws2812_pixel_rgbw_t, red);
+    const uint8_t G = offsetof(ws2812_pixel_rgbw_t, green);
+    const uint8_t B = offsetof(ws2812_pixel_rgbw_t, blue);
+    uint8_t *o = channel_offset;
+
+    switch (config->colour_order) {
+        case WS2812_ORDER_RGB: o[0] = R; o[1] = G; o[2] = B; break;
+        case WS2812_ORDER_RBG: o[0] = R; o[1] = B; o[2] = G; break;
+        case WS2812_ORDER_GBR: o[0] = G; o[1] = B; o[2] = R; break;
+        case WS2812_ORDER_BRG: o[0] = B; o[1] = R; o[2] = G; break;
+        case WS2812_ORDER_BGR: o[0] = B; o[1] = G; o[2] = R; break;
+        case WS2812_ORDER_GRB:
+        default:               o[0] = G; o[1] = R; o[2] = B; break;
+    }
+    o[3] = offsetof(ws2812_pixel_rgbw_t, white);
+
+    channels_number = config->rgbw ? 4 : 3;
+    for (int i = 0; i < 4; i++) {
+        channel_lut[i] = NULL;
+    }
+    luts_enabled = false;
+}
+
 void ws2812_i2s_init(uint32_t pixels_number)
 {
-    dma_buffer_size = pixels_number * DMA_PIXEL_SIZE;
+    ws2812_i2s_init_buffered(pixels_number, 1);
+}
+
+bool ws2812_i2s_init_buffered(uint32_t pixels_number, uint32_t buffers_number)
+{
+    ws2812_i2s_config_t config = {
+        .buffers_number = buffers_number,
+        .colour_order = WS2812_ORDER_GRB,
+        .rgbw = false,
+    };
+    return ws2812_i2s_init_config(pixels_number, &config);
+}
+
+bool ws2812_i2s_init_config(uint32_t pixels_number,
+        const ws2812_i2s_config_t *config)
+{
+    uint32_t buffers_number = config->buffers_number;
+
+    if (buffers_number < 1 || buffers_number > WS2812_I2S_MAX_BUFFERS) {
+        return false;
+    }
+
+    // re-initialization, release the buffers of the previous configuration.
+    // No frame can be submitted until the new buffers are all allocated.
+    while (frames_queued) {};
+    frame_buffers_number = 0;
+    for (int i = 0; i < WS2812_I2S_MAX_BUFFERS; i++) {
+        free(frame_buffers[i].dma_block_list);
+        free(frame_buffers[i].dma_buffer);
+        frame_buffers[i].dma_block_list = NULL;
+        frame_buffers[i].dma_buffer = NULL;
+    }
+
+    init_encoder(config);
+
+    pixels_count = pixels_number;
+    dma_buffer_size = pixels_number * channels_number * DMA_COLOUR_SIZE;
     dma_block_list_size = dma_buffer_size / MAX_DMA_BLOCK_SIZE;
 
     if (dma_buffer_size % MAX_DMA_BLOCK_SIZE) {
@@ -128,16 +256,34 @@ void ws2812_i2s_init(uint32_t pixels_number)
 
     dma_block_list_size += 2;  // zero block and stop block
 
-    debug("allocating %d dma blocks\n", dma_block_list_size);
+    for (int i = 0; i < buffers_number; i++) {
+        frame_buffer_t *fb = &frame_buffers[i];
+
+        debug("allocating %d dma blocks\n", dma_block_list_size);
+
+        fb->dma_block_list = (dma_descriptor_t*)malloc(
+                dma_block_list_size * sizeof(dma_descriptor_t));
 
-    dma_block_list = (dma_descriptor_t*)malloc(
-            dma_block_list_size * sizeof(dma_descriptor_t));
+        debug("allocating %d bytes for DMA buffer\n", dma_buffer_size);
+        fb->dma_buffer = malloc(dma_buffer_size);
 
-    debug("allocating %d bytes for DMA buffer\n", dma_buffer_size);
-    dma_buffer = malloc(dma_buffer_size);
-    memset(dma_buffer, 0xFA, dma_buffer_size);
+        if (!fb->dma_block_list || !fb->dma_buffer) {
+            for (int j = 0; j <= i; j++) {
+                free(frame_buffers[j].dma_block_list);
+                free(frame_buffers[j].dma_buffer);
+                frame_buffers[j].dma_block_list = NULL;
+                frame_buffers[j].dma_buffer = NULL;
+            }
+            return false;
+        }
+        memset(fb->dma_buffer, 0xFA, dma_buffer_size);
 
-    init_descriptors_list(dma_buffer, dma_buffer_size);
+        init_descriptors_list(fb->dma_block_list, fb->dma_buffer,
+                dma_buffer_size);
+    }
+    frame_buffers_number = buffers_number;
+    frame_head = 0;
+    frames_queued = 0;
 
     i2s_clock_div_t clock_div = i2s_get_clock_div(3333333);
     i2s_pins_t i2s_pins = {.data = true, .clock = false, .ws = false};
@@ -146,36 +292,154 @@ void ws2812_i2s_init(uint32_t pixels_number)
             clock_div.bclk_div, clock_div.clkm_div);
 
     i2s_dma_init(dma_isr_handler, clock_div, i2s_pins);
+
+    return true;
+}
+
+void ws2812_i2s_set_notify_task(TaskHandle_t task)
+{
+    notify_task = task;
+}
+
+void ws2812_i2s_set_lut(ws2812_channel_t channel, const uint8_t *lut)
+{
+    channel_lut[channel] = lut;
+    luts_enabled = false;
+    for (int i = 0; i < 4; i++) {
+        if (channel_lut[i]) {
+            luts_enabled = true;
+        }
+    }
+}
+
+static void encode_frame(uint32_t *dst, const uint8_t *src)
+{
+    const uint32_t *table = encode_table;
+    const uint32_t n = pixels_count;
+    const uint32_t o0 = channel_offset[0];
+    const uint32_t o1 = channel_offset[1];
+    const uint32_t o2 = channel_offset[2];
+    const uint32_t o3 = channel_offset[3];
+
+    if (!luts_enabled) {
+        if (channels_number == 3) {
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t c0 = table[src[o0]];
+                uint32_t c1 = table[src[o1]];
+                uint32_t c2 = table[src[o2]];
+                dst[0] = c0;
+                dst[1] = c1;
+                dst[2] = c2;
+                dst += 3;
+                src += sizeof(ws2812_pixel_t);
+            }
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t c0 = table[src[o0]];
+                uint32_t c1 = table[src[o1]];
+                uint32_t c2 = table[src[o2]];
+                uint32_t c3 = table[src[o3]];
+                dst[0] = c0;
+                dst[1] = c1;
+                dst[2] = c2;
+                dst[3] = c3;
+                dst += 4;
+                src += sizeof(ws2812_pixel_rgbw_t);
+            }
+        }
+        return;
+    }
+
+    // channel LUTs, indexed by the pixel field offset which equals the
+    // ws2812_channel_t value
+    const uint8_t *l0 = channel_lut[o0] ? channel_lut[o0] : identity_lut;
+    const uint8_t *l1 = channel_lut[o1] ? channel_lut[o1] : identity_lut;
+    const uint8_t *l2 = channel_lut[o2] ? channel_lut[o2] : identity_lut;
+    const uint8_t *l3 = channel_lut[o3] ? channel_lut[o3] : identity_lut;
+
+    if (channels_number == 3) {
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t c0 = table[l0[src[o0]]];
+            uint32_t c1 = table[l1[src[o1]]];
+            uint32_t c2 = table[l2[src[o2]]];
+            dst[0] = c0;
+            dst[1] = c1;
+            dst[2] = c2;
+            dst += 3;
+            src += sizeof(ws2812_pixel_t);
+        }
+    } else {
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t c0 = table[l0[src[o0]]];
+            uint32_t c1 = table[l1[src[o1]]];
+            uint32_t c2 = table[l2[src[o2]]];
+            uint32_t c3 = table[l3[src[o3]]];
+            dst[0] = c0;
+            dst[1] = c1;
+            dst[2] = c2;
+            dst[3] = c3;
+            dst += 4;
+            src += sizeof(ws2812_pixel_rgbw_t);
+        }
+    }
 }
 
-const IRAM_DATA int16_t bitpatterns[16] =
+static bool submit_frame(const uint8_t *pixels)
 {
-    0b1000100010001000, 0b1000100010001110, 0b1000100011101000, 0b1000100011101110,
-    0b1000111010001000, 0b1000111010001110, 0b1000111011101000, 0b1000111011101110,
-    0b1110100010001000, 0b1110100010001110, 0b1110100011101000, 0b1110100011101110,
-    0b1110111010001000, 0b1110111010001110, 0b1110111011101000, 0b1110111011101110,
-};
+    if (!frame_buffers_number || frames_queued == frame_buffers_number) {
+        return false;
+    }
+
+    uint32_t index = (frame_head + frames_queued) % frame_buffers_number;
+    encode_frame(frame_buffers[index].dma_buffer, pixels);
 
-void ws2812_i2s_update(ws2812_pixel_t *pixels)
+    taskENTER_CRITICAL();
+    if (frames_queued++ == 0) {
+        // DMA is idle, start it. Otherwise the ISR picks the frame up.
+        i2s_dma_start(frame_buffers[index].dma_block_list);
+    }
+    taskEXIT_CRITICAL();
+
+    return true;
+}
+
+bool ws2812_i2s_submit(const ws2812_pixel_t *pixels)
 {
-    while (i2s_dma_processing) {};
+    if (channels_number != 3) {
+        return false;
+    }
+    return submit_frame((const uint8_t *)pixels);
+}
 
-    uint16_t *p_dma_buf = dma_buffer;
+bool ws2812_i2s_submit_rgbw(const ws2812_pixel_rgbw_t *pixels)
+{
+    if (channels_number != 4) {
+        return false;
+    }
+    return submit_frame((const uint8_t *)pixels);
+}
 
-    for (uint32_t i = 0; i < (dma_buffer_size / DMA_PIXEL_SIZE); i++) {
-        // green
-        *p_dma_buf++ =  bitpatterns[pixels[i].green & 0x0F];
-        *p_dma_buf++ =  bitpatterns[pixels[i].green >> 4];
+bool ws2812_i2s_update(ws2812_pixel_t *pixels)
+{
+    if (!frame_buffers_number) {
+        return false;
+    }
+    while (frames_queued == frame_buffers_number) {};
 
-        // red
-        *p_dma_buf++ =  bitpatterns[pixels[i].red & 0x0F];
-        *p_dma_buf++ =  bitpatterns[pixels[i].red >> 4];
+    return ws2812_i2s_submit(pixels);
+}
 
-        // blue
-        *p_dma_buf++ =  bitpatterns[pixels[i].blue & 0x0F];
-        *p_dma_buf++ =  bitpatterns[pixels[i].blue >> 4];
+bool ws2812_i2s_update_rgbw(ws2812_pixel_rgbw_t *pixels)
+{
+    if (!frame_buffers_number) {
+        return false;
     }
+    while (frames_queued == frame_buffers_number) {};
 
-    i2s_dma_processing = true;
-    i2s_dma_start(dma_block_list);
+    return ws2812_i2s_submit_rgbw(pixels);
+}
+
+bool ws2812_i2s_busy()
+{
+    return frames_queued != 0;
 }
@@ -26,17 +26,64 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "FreeRTOS.h"
+#include "task.h"
 
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
+/**
+ * Maximum number of frame buffers for ws2812_i2s_init_buffered.
+ */
+#ifndef WS2812_I2S_MAX_BUFFERS
+#define WS2812_I2S_MAX_BUFFERS 3
+#endif
+
 typedef struct {
     uint8_t red;
     uint8_t green;
     uint8_t blue;
 } ws2812_pixel_t;
 
+/**
+ * Pixel of a 4 channel (SK6812 RGBW) strip.
+ */
+typedef struct {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t white;
+} ws2812_pixel_rgbw_t;
+
+/**
+ * Order the colours are sent in. White, if any, is always sent last.
+ */
+typedef enum {
+    WS2812_ORDER_GRB = 0,   // WS2812(B), SK6812
+    WS2812_ORDER_RGB,
+    WS2812_ORDER_RBG,
+    WS2812_ORDER_GBR,
+    WS2812_ORDER_BRG,
+    WS2812_ORDER_BGR,
+} ws2812_colour_order_t;
+
+/**
+ * Channels for ws2812_i2s_set_lut.
+ */
+typedef enum {
+    WS2812_CHANNEL_RED = 0,
+    WS2812_CHANNEL_GREEN,
+    WS2812_CHANNEL_BLUE,
+    WS2812_CHANNEL_WHITE,
+} ws2812_channel_t;
+
+typedef struct {
+    uint32_t buffers_number;            // 1 to WS2812_I2S_MAX_BUFFERS
+    ws2812_colour_order_t colour_order;
+    bool rgbw;                          // pixels are ws2812_pixel_rgbw_t
+} ws2812_i2s_config_t;
+
 /**
  * Initialize i2s and dma subsystems to work with ws2812 led strip.
  *
@@ -46,13 +93,88 @@ typedef struct {
  */
 void ws2812_i2s_init(uint32_t pixels_number);
 
+/**
+ * Initialize i2s and dma subsystems with several frame buffers.
+ *
+ * With more than one buffer the next frame can be encoded while the previous
+ * one is being transmitted. Each buffer takes 12 bytes of RAM per pixel.
+ *
+ * @param pixels_number Number of pixels in the strip.
+ * @param buffers_number Number of frame buffers, 1 to WS2812_I2S_MAX_BUFFERS.
+ * @return false if the arguments are invalid or memory allocation failed.
+ */
+bool ws2812_i2s_init_buffered(uint32_t pixels_number, uint32_t buffers_number);
+
+/**
+ * Initialize i2s and dma subsystems for a strip with a different colour
+ * order or RGBW pixels.
+ *
+ * Each buffer takes 12 bytes of RAM per pixel, 16 bytes for RGBW.
+ *
+ * @param pixels_number Number of pixels in the strip.
+ * @param config Buffer count and pixel format.
+ * @return false if the arguments are invalid or memory allocation failed.
+ */
+bool ws2812_i2s_init_config(uint32_t pixels_number,
+        const ws2812_i2s_config_t *config);
+
+/**
+ * Set a lookup table applied to a colour channel while encoding, e.g. for
+ * gamma correction and brightness.
+ *
+ * The table is not copied and must stay valid. NULL disables the lookup.
+ * Must be called after init.
+ *
+ * @param channel Colour channel.
+ * @param lut 256 entries table mapping pixel values to output values.
+ */
+void ws2812_i2s_set_lut(ws2812_channel_t channel, const uint8_t *lut);
+
 /**
  * Update ws2812 pixels.
  *
+ * Waits until a frame buffer is free, then encodes and queues the frame.
+ *
  * @param pixels Array of 'pixels_number' pixels. The array must contain all
  * the pixels.
+ * @return false if the driver has no frame buffers (init failed) or the strip
+ * is configured for RGBW pixels.
+ */
+bool ws2812_i2s_update(ws2812_pixel_t *pixels);
+
+/**
+ * Queue a frame for transmission without waiting.
+ *
+ * Frames are transmitted in the order they are submitted. The pixels are
+ * encoded before the function returns, so the array can be reused right away.
+ * Must only be called from one task.
+ *
+ * @param pixels Array of 'pixels_number' pixels.
+ * @return false if all frame buffers are in use, there are none (init failed)
+ * or the strip is configured for RGBW pixels, the frame is not queued.
+ */
+bool ws2812_i2s_submit(const ws2812_pixel_t *pixels);
+
+/**
+ * Same as ws2812_i2s_update for RGBW strips.
+ */
+bool ws2812_i2s_update_rgbw(ws2812_pixel_rgbw_t *pixels);
+
+/**
+ * Same as ws2812_i2s_submit for RGBW strips.
+ */
+bool ws2812_i2s_submit_rgbw(const ws2812_pixel_rgbw_t *pixels);
+
+/**
+ * Check if any frame is queued or being transmitted.
+ */
+bool ws2812_i2s_busy();
+
+/**
+ * Set a task to be notified (xTaskNotifyGive) each time a frame transmission
+ * completes. NULL disables notification.
  */
-void ws2812_i2s_update(ws2812_pixel_t *pixels);
+void ws2812_i2s_set_notify_task(TaskHandle_t task);
 
 #ifdef	__cplusplus
 }
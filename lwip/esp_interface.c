@@ -42,22 +42,123 @@
 #include "lwip/def.h"
 #include "lwip/mem.h"
 #include "lwip/pbuf.h"
+#include "lwip/sys.h"
 #include <lwip/stats.h>
 #include <lwip/snmp.h>
 #include "netif/etharp.h"
+#include "esp_interface.h"
+
+#include <string.h>
 
 /* declared in libnet80211.a */
 int8_t sdk_ieee80211_output_pbuf(struct netif *ifp, struct pbuf* pb);
 
+/* Counters are kept in a small table keyed by netif, slots are assigned in
+   ethernetif_init. */
+static struct {
+  const struct netif *netif;
+  esp_interface_stats_t stats;
+} netif_stats[ESP_INTERFACE_MAX_NETIFS];
+
+/* Counters for frames on netifs that didn't get a slot */
+static esp_interface_stats_t overflow_stats;
+
+static esp_interface_stats_t *stats_for(const struct netif *netif)
+{
+  for (int i = 0; i < ESP_INTERFACE_MAX_NETIFS; i++) {
+    if (netif_stats[i].netif == netif) {
+      return &netif_stats[i].stats;
+    }
+  }
+  return &overflow_stats;
+}
+
+static void stats_register(const struct netif *netif)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+  int free_slot = -1;
+
+  SYS_ARCH_PROTECT(lev);
+  for (int i = 0; i < ESP_INTERFACE_MAX_NETIFS; i++) {
+    if (netif_stats[i].netif == netif) {
+      free_slot = -1;
+      break;
+    }
+    if (netif_stats[i].netif == NULL && free_slot < 0) {
+      free_slot = i;
+    }
+  }
+  if (free_slot >= 0) {
+    netif_stats[free_slot].netif = netif;
+    memset(&netif_stats[free_slot].stats, 0, sizeof(esp_interface_stats_t));
+  }
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+bool esp_interface_get_stats(const struct netif *netif, esp_interface_stats_t *stats)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+  esp_interface_stats_t *src = stats_for(netif);
+
+  if (src == &overflow_stats) {
+    return false;
+  }
+  SYS_ARCH_PROTECT(lev);
+  memcpy(stats, src, sizeof(esp_interface_stats_t));
+  SYS_ARCH_UNPROTECT(lev);
+  return true;
+}
+
+void esp_interface_reset_stats(void)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  for (int i = 0; i < ESP_INTERFACE_MAX_NETIFS; i++) {
+    memset(&netif_stats[i].stats, 0, sizeof(esp_interface_stats_t));
+  }
+  memset(&overflow_stats, 0, sizeof(overflow_stats));
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+/* The MAC layer sends each pbuf it's given as a separate frame, so a chained
+   frame (e.g. TCP header pbuf + payload pbuf) has to be copied into a single
+   pbuf first. Single pbuf frames, the common case, are passed as-is. The MAC
+   layer takes its own reference to the pbuf it's given. */
 static err_t
 low_level_output(struct netif *netif, struct pbuf *p)
 {
-  struct pbuf *q;
+  esp_interface_stats_t *stats = stats_for(netif);
+  struct pbuf *q = p;
+
+  if (p->next) {
+    q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    if (q == NULL) {
+      stats->tx_drops++;
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+      return ERR_MEM;
+    }
+    pbuf_copy(q, p);
+    stats->tx_coalesced++;
+  } else {
+    stats->tx_passthrough++;
+  }
+
+  int8_t result = sdk_ieee80211_output_pbuf(netif, q);
 
-  for(q = p; q != NULL; q = q->next) {
-      sdk_ieee80211_output_pbuf(netif, q);
+  if (q != p) {
+    pbuf_free(q);
   }
 
+  if (result != 0) {
+    stats->tx_drops++;
+    LINK_STATS_INC(link.drop);
+    return ERR_MEM;
+  }
+
+  stats->tx_packets++;
+  stats->tx_bytes += p->tot_len;
   LINK_STATS_INC(link.xmit);
 
   return ERR_OK;
@@ -92,6 +193,8 @@ err_t ethernetif_init(struct netif *netif)
   netif->mtu = 1500;
   netif->flags = NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
 
+  stats_register(netif);
+
   return ERR_OK;
 }
 
@@ -99,6 +202,7 @@ err_t ethernetif_init(struct netif *netif)
 void ethernetif_input(struct netif *netif, struct pbuf *p)
 {
     struct eth_hdr *ethhdr = p->payload;
+    esp_interface_stats_t *stats = stats_for(netif);
   /* examine packet payloads ethernet header */
 
 
@@ -108,15 +212,19 @@ void ethernetif_input(struct netif *netif, struct pbuf *p)
     case ETHTYPE_ARP:
 //  case ETHTYPE_IPV6:
 	/* full packet send to tcpip_thread to process */
+	stats->rx_packets++;
+	stats->rx_bytes += p->tot_len;
 	if (netif->input(p, netif)!=ERR_OK)
 	{
 	    LWIP_DEBUGF(NETIF_DEBUG, ("ethernetif_input: IP input error\n"));
+	    stats->rx_drops++;
 	    pbuf_free(p);
 	    p = NULL;
 	}
 	break;
 
     default:
+	stats->rx_ignored++;
 	pbuf_free(p);
 	p = NULL;
 	break;
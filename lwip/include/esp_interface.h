@@ -0,0 +1,48 @@
+/* Statistics for the LWIP interface to the ESP WLAN MAC layer driver.
+ *
+ * Part of esp-open-rtos
+ * BSD Licensed as described in the file LICENSE
+ */
+#ifndef _ESP_INTERFACE_H
+#define _ESP_INTERFACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of netifs (station, softAP) counters are kept for */
+#ifndef ESP_INTERFACE_MAX_NETIFS
+#define ESP_INTERFACE_MAX_NETIFS 2
+#endif
+
+struct netif;
+
+typedef struct {
+    uint32_t rx_packets;      /* frames handed to the lwIP input function */
+    uint32_t rx_bytes;
+    uint32_t rx_drops;        /* frames lwIP input refused (tcpip_thread mbox full) */
+    uint32_t rx_ignored;      /* frames with an unsupported ethertype */
+    uint32_t tx_packets;      /* frames accepted by the MAC */
+    uint32_t tx_bytes;
+    uint32_t tx_passthrough;  /* single pbuf frames passed to the MAC as-is (copies avoided) */
+    uint32_t tx_coalesced;    /* chained frames copied into one contiguous pbuf */
+    uint32_t tx_drops;        /* frames dropped: no memory or MAC TX queue full */
+} esp_interface_stats_t;
+
+/* Get a snapshot of the counters for a netif.
+ *
+ * Returns false if no counters are kept for this netif.
+ */
+bool esp_interface_get_stats(const struct netif *netif, esp_interface_stats_t *stats);
+
+/* Reset the counters of all netifs to zero */
+void esp_interface_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
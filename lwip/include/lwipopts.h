@@ -39,6 +39,15 @@
 #define ESP_TIMEWAIT_THRESHOLD              10000
 #define LWIP_TIMEVAL_PRIVATE                0
 
+/**
+ * LWIP_ESP_PORT_STATS==1: Keep mailbox fill levels and tcpip_thread queueing
+ * delay statistics in sys_arch (see sys_arch_get_stats()). Adds a timestamp
+ * to every mailbox item.
+ */
+#ifndef LWIP_ESP_PORT_STATS
+#define LWIP_ESP_PORT_STATS                 0
+#endif
+
 /*
    -----------------------------------------------
    ---------- Platform specific locking ----------
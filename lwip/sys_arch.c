@@ -49,8 +49,114 @@
 #include "lwip/mem.h"
 #include "lwip/stats.h"
 
+#include <string.h>
+#include "xtensa_ops.h"
+#include "espressif/esp_system.h"
+
 extern bool esp_in_isr;
 
+/* Mailbox items carry the time they were posted so the time spent waiting
+   in the tcpip_thread mbox can be measured. */
+typedef struct {
+    void *msg;
+#if LWIP_ESP_PORT_STATS
+    uint32_t posted;  /* CCOUNT at post time */
+#endif
+} mbox_item_t;
+
+#if LWIP_ESP_PORT_STATS
+static sys_arch_stats_t stats;
+static TaskHandle_t tcpip_thread_handle;
+static sys_mbox_t tcpip_mbox;
+
+static inline uint32_t get_ccount(void)
+{
+    uint32_t ccount;
+    RSR(ccount, ccount);
+    return ccount;
+}
+
+static inline void mbox_item_init(mbox_item_t *item, void *msg)
+{
+    item->msg = msg;
+    item->posted = get_ccount();
+}
+
+/* Record the fill level of a mailbox after posting to it. The caller reads
+   the level, with the ISR-safe call where needed */
+static inline void mbox_record_level(sys_mbox_t *pxMailBox, uint32_t level)
+{
+    if( level > stats.mbox_high_water )
+    {
+        stats.mbox_high_water = level;
+    }
+    if( *pxMailBox == tcpip_mbox && level > stats.tcpip_mbox_high_water )
+    {
+        stats.tcpip_mbox_high_water = level;
+    }
+}
+
+/* The only blocking fetch of tcpip_thread is from its own mailbox, remember
+   that one. It also fetches from netconn mailboxes when draining them, so
+   this can't be done for every fetch */
+static inline void mbox_note_fetch(sys_mbox_t *pxMailBox)
+{
+    if( tcpip_mbox == NULL && tcpip_thread_handle != NULL &&
+        xTaskGetCurrentTaskHandle() == tcpip_thread_handle )
+    {
+        tcpip_mbox = *pxMailBox;
+    }
+}
+
+/* Record how long a message fetched from the tcpip_thread mailbox waited */
+static inline void mbox_record_delay(sys_mbox_t *pxMailBox, mbox_item_t *item)
+{
+    if( tcpip_mbox == NULL || *pxMailBox != tcpip_mbox )
+    {
+        return;
+    }
+
+    uint32_t us = ( get_ccount() - item->posted ) / sdk_system_get_cpu_freq();
+    int bucket = us ? 32 - __builtin_clz( us ) : 0;
+    if( bucket >= SYS_ARCH_DELAY_BUCKETS )
+    {
+        bucket = SYS_ARCH_DELAY_BUCKETS - 1;
+    }
+    stats.tcpip_delay_us[bucket]++;
+}
+
+void sys_arch_get_stats(sys_arch_stats_t *dest)
+{
+    taskENTER_CRITICAL();
+    memcpy( dest, &stats, sizeof( stats ) );
+    taskEXIT_CRITICAL();
+}
+
+void sys_arch_reset_stats(void)
+{
+    taskENTER_CRITICAL();
+    memset( &stats, 0, sizeof( stats ) );
+    taskEXIT_CRITICAL();
+}
+
+#else
+
+#define mbox_item_init(item, message) ( ( item )->msg = ( message ) )
+#define mbox_record_level(mbox, level)
+#define mbox_note_fetch(mbox)
+#define mbox_record_delay(mbox, item)
+
+void sys_arch_get_stats(sys_arch_stats_t *dest)
+{
+    memset( dest, 0, sizeof( *dest ) );
+}
+
+void sys_arch_reset_stats(void)
+{
+}
+
+#endif /* LWIP_ESP_PORT_STATS */
+
 /* Based on the default xInsideISR mechanism to determine
    if an ISR is running.
 
@@ -76,7 +182,7 @@ err_t sys_mbox_new( sys_mbox_t *pxMailBox, int iSize )
 {
     err_t xReturn = ERR_MEM;
 
-    *pxMailBox = xQueueCreate( iSize, sizeof( void * ) );
+    *pxMailBox = xQueueCreate( iSize, sizeof( mbox_item_t ) );
 
     if( *pxMailBox != NULL )
     {
@@ -132,7 +238,19 @@ unsigned long ulMessagesWaiting;
  *---------------------------------------------------------------------------*/
 void sys_mbox_post( sys_mbox_t *pxMailBox, void *pxMessageToPost )
 {
-    while( xQueueSendToBack( *pxMailBox, &pxMessageToPost, portMAX_DELAY ) != pdTRUE );
+mbox_item_t xItem;
+
+#if LWIP_ESP_PORT_STATS
+    if( uxQueueSpacesAvailable( *pxMailBox ) == 0 )
+    {
+        stats.mbox_post_blocked++;
+    }
+#endif
+
+    mbox_item_init( &xItem, pxMessageToPost );
+    while( xQueueSendToBack( *pxMailBox, &xItem, portMAX_DELAY ) != pdTRUE );
+
+    mbox_record_level( pxMailBox, uxQueueMessagesWaiting( *pxMailBox ) );
 }
 
 /*---------------------------------------------------------------------------*
@@ -152,25 +270,34 @@ err_t sys_mbox_trypost( sys_mbox_t *pxMailBox, void *pxMessageToPost )
 {
 err_t xReturn;
 portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+mbox_item_t xItem;
+bool xInsideISR = is_inside_isr();
 
-    if( is_inside_isr() != pdFALSE )
+    mbox_item_init( &xItem, pxMessageToPost );
+
+    if( xInsideISR != pdFALSE )
     {
-        xReturn = xQueueSendFromISR( *pxMailBox, &pxMessageToPost, &xHigherPriorityTaskWoken );
+        xReturn = xQueueSendFromISR( *pxMailBox, &xItem, &xHigherPriorityTaskWoken );
     }
     else
     {
-        xReturn = xQueueSend( *pxMailBox, &pxMessageToPost, ( TickType_t ) 0 );
+        xReturn = xQueueSend( *pxMailBox, &xItem, ( TickType_t ) 0 );
     }
 
     if( xReturn == pdPASS )
     {
         xReturn = ERR_OK;
+        mbox_record_level( pxMailBox, xInsideISR ? uxQueueMessagesWaitingFromISR( *pxMailBox )
+                                                 : uxQueueMessagesWaiting( *pxMailBox ) );
     }
     else
     {
         /* The queue was already full. */
         xReturn = ERR_MEM;
         SYS_STATS_INC( mbox.err );
+#if LWIP_ESP_PORT_STATS
+        stats.mbox_trypost_full++;
+#endif
     }
 
     return xReturn;
@@ -206,6 +333,7 @@ u32_t sys_arch_mbox_fetch( sys_mbox_t *pxMailBox, void **ppvBuffer, u32_t ulTime
 void *pvDummy;
 TickType_t xStartTime, xEndTime, xElapsed;
 unsigned long ulReturn;
+mbox_item_t xItem;
 
     xStartTime = xTaskGetTickCount();
 
@@ -214,12 +342,16 @@ unsigned long ulReturn;
         ppvBuffer = &pvDummy;
     }
 
+    mbox_note_fetch( pxMailBox );
+
     if( ulTimeOut != 0UL )
     {
         configASSERT( is_inside_isr() == ( portBASE_TYPE ) 0 );
 
-        if( pdTRUE == xQueueReceive( *pxMailBox, &( *ppvBuffer ), ulTimeOut/ portTICK_PERIOD_MS ) )
+        if( pdTRUE == xQueueReceive( *pxMailBox, &xItem, ulTimeOut/ portTICK_PERIOD_MS ) )
         {
+            *ppvBuffer = xItem.msg;
+            mbox_record_delay( pxMailBox, &xItem );
             xEndTime = xTaskGetTickCount();
             xElapsed = ( xEndTime - xStartTime ) * portTICK_PERIOD_MS;
 
@@ -234,7 +366,9 @@ unsigned long ulReturn;
     }
     else
     {
-        while( pdTRUE != xQueueReceive( *pxMailBox, &( *ppvBuffer ), portMAX_DELAY ) );
+        while( pdTRUE != xQueueReceive( *pxMailBox, &xItem, portMAX_DELAY ) );
+        *ppvBuffer = xItem.msg;
+        mbox_record_delay( pxMailBox, &xItem );
         xEndTime = xTaskGetTickCount();
         xElapsed = ( xEndTime - xStartTime ) * portTICK_PERIOD_MS;
 
@@ -269,6 +403,7 @@ void *pvDummy;
 unsigned long ulReturn;
 long lResult;
 portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+mbox_item_t xItem;
 
     if( ppvBuffer== NULL )
     {
@@ -277,15 +412,17 @@ portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 
     if( is_inside_isr() != pdFALSE )
     {
-        lResult = xQueueReceiveFromISR( *pxMailBox, &( *ppvBuffer ), &xHigherPriorityTaskWoken );
+        lResult = xQueueReceiveFromISR( *pxMailBox, &xItem, &xHigherPriorityTaskWoken );
     }
     else
     {
-        lResult = xQueueReceive( *pxMailBox, &( *ppvBuffer ), 0UL );
+        lResult = xQueueReceive( *pxMailBox, &xItem, 0UL );
     }
 
     if( lResult == pdPASS )
     {
+        *ppvBuffer = xItem.msg;
+        mbox_record_delay( pxMailBox, &xItem );
         ulReturn = ERR_OK;
     }
     else
@@ -518,6 +655,12 @@ sys_thread_t xReturn;
 
     if( xResult == pdPASS )
     {
+#if LWIP_ESP_PORT_STATS
+        if( strcmp( pcName, TCPIP_THREAD_NAME ) == 0 )
+        {
+            tcpip_thread_handle = xCreatedTask;
+        }
+#endif
         xReturn = xCreatedTask;
     }
     else
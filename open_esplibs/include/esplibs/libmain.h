@@ -20,6 +20,7 @@ extern struct sdk_info_st sdk_info;
 extern uint32_t sdk_debug_timer;
 extern void *sdk_debug_timerfn;
 void sdk_ets_timer_init(void);
+void sdk_ets_timer_handler_isr(void);
 
 // misc.c
 int sdk_os_get_cpu_frequency(void);
@@ -13,6 +13,7 @@
 #include "esp/rom.h"
 #include "sdk_internal.h"
 #include "espressif/spi_flash.h"
+#include "spiflash.h"
 
 sdk_flashchip_t sdk_flashchip = {
     0x001640ef,      // device_id
@@ -151,6 +152,11 @@ sdk_SpiFlashOpResult IRAM sdk_spi_flash_write_status(uint32_t status) {
 sdk_SpiFlashOpResult IRAM sdk_spi_flash_erase_sector(uint16_t sec) {
     sdk_SpiFlashOpResult result;
 
+    // The chip would ignore it during a preemptible erase of spiflash.c
+    if (spiflash_erase_suspended()) {
+        return SPI_FLASH_RESULT_ERR;
+    }
+
     portENTER_CRITICAL();
     Cache_Read_Disable();
     result = sdk_SPIEraseSector(sec);
@@ -162,7 +168,7 @@ sdk_SpiFlashOpResult IRAM sdk_spi_flash_erase_sector(uint16_t sec) {
 sdk_SpiFlashOpResult IRAM sdk_spi_flash_write(uint32_t des_addr, uint32_t *src_addr, uint32_t size) {
     sdk_SpiFlashOpResult result;
 
-    if (!src_addr) {
+    if (!src_addr || spiflash_erase_suspended()) {
         return SPI_FLASH_RESULT_ERR;
     }
     if (size & 3) {
@@ -21,6 +21,8 @@
 DEFINE_SOLO_TESTCASE(07_sysparam_basic_test);
 DEFINE_SOLO_TESTCASE(07_sysparam_load_test);
 DEFINE_SOLO_TESTCASE(07_sysparam_bool_test);
+DEFINE_SOLO_TESTCASE(07_sysparam_index_bench);
+DEFINE_SOLO_TESTCASE(07_sysparam_batch_test);
 
 #define TEST_ITERATIONS         10
 #define KEY_BUF_SIZE            32
@@ -401,3 +403,111 @@ static void a_07_sysparam_bool_test(void)
 
     TEST_PASS();
 }
+
+#define INDEX_BENCH_KEYS        100
+#define INDEX_BENCH_LOOKUPS     500
+
+/**
+ * Look up keys spread over the whole region, returns lookups per second.
+ */
+static uint32_t index_bench_lookups(void)
+{
+    char key_buf[KEY_BUF_SIZE];
+    int32_t value;
+    uint32_t start_time = get_current_time();
+
+    for (int i = 0; i < INDEX_BENCH_LOOKUPS; ++i) {
+        int key = (i * 37) % INDEX_BENCH_KEYS;
+        sprintf(key_buf, "bench_%d", key);
+        TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_get_int32(key_buf, &value));
+        TEST_ASSERT_EQUAL_INT(key * 3, value);
+    }
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_NOTFOUND,
+            sysparam_get_int32("bench_missing", &value));
+
+    uint32_t elapsed = get_current_time() - start_time;
+    return INDEX_BENCH_LOOKUPS * 1000 / (elapsed ? elapsed : 1);
+}
+
+static void a_07_sysparam_index_bench(void)
+{
+    char key_buf[KEY_BUF_SIZE];
+
+    init_sysparam();
+
+    for (int i = 0; i < INDEX_BENCH_KEYS; ++i) {
+        sprintf(key_buf, "bench_%d", i);
+        TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_int32(key_buf, i));
+    }
+    // Update values so the index has to follow rewritten entries
+    for (int i = 0; i < INDEX_BENCH_KEYS; ++i) {
+        sprintf(key_buf, "bench_%d", i);
+        TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_int32(key_buf, i * 3));
+    }
+
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_index_size(0));
+    printf("without index: %d lookups/s\n", index_bench_lookups());
+
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_index_size(INDEX_BENCH_KEYS));
+    printf("with index: %d lookups/s\n", index_bench_lookups());
+
+    // Index must stay in sync through compaction
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_compact());
+    index_bench_lookups();
+
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_index_size(SYSPARAM_INDEX_ENTRIES));
+
+    TEST_PASS();
+}
+
+#define BATCH_TEST_KEYS         40
+
+static void a_07_sysparam_batch_test(void)
+{
+    char key_buf[KEY_BUF_SIZE];
+    int32_t value;
+    char *str;
+
+    init_sysparam();
+
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_string("old", "value"));
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_int32("deleted", 1));
+
+    // Aborted batch must not change anything
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_batch_begin());
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_ERR_BADVALUE, sysparam_batch_begin());
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_string("old", "aborted"));
+    sysparam_batch_abort();
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_get_string("old", &str));
+    TEST_ASSERT_EQUAL_STRING("value", str);
+    free(str);
+
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_batch_begin());
+    for (int i = 0; i < BATCH_TEST_KEYS; ++i) {
+        sprintf(key_buf, "batch_%d", i);
+        TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_int32(key_buf, -i));
+        TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_int32(key_buf, i));
+    }
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_string("old", "new"));
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_set_data("deleted", NULL, 0, false));
+
+    // Staged values are visible to this task before commit
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_get_int32("batch_7", &value));
+    TEST_ASSERT_EQUAL_INT(7, value);
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_NOTFOUND, sysparam_get_int32("deleted", &value));
+
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_batch_commit());
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_ERR_BADVALUE, sysparam_batch_commit());
+
+    for (int i = 0; i < BATCH_TEST_KEYS; ++i) {
+        sprintf(key_buf, "batch_%d", i);
+        TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_get_int32(key_buf, &value));
+        TEST_ASSERT_EQUAL_INT(i, value);
+    }
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_OK, sysparam_get_string("old", &str));
+    TEST_ASSERT_EQUAL_STRING("new", str);
+    free(str);
+    TEST_ASSERT_EQUAL_INT(SYSPARAM_NOTFOUND, sysparam_get_int32("deleted", &value));
+
+    TEST_PASS();
+}
@@ -49,3 +49,81 @@ static void a_08_spiflash_unaligned(void)
 
     TEST_PASS();
 }
+
+DEFINE_SOLO_TESTCASE(08_spiflash_read_speed)
+
+/**
+ * Measure spiflash_read throughput and how long interrupts are disabled for
+ * each KB read, for both word aligned and unaligned destination buffers.
+ */
+static void a_08_spiflash_read_speed(void)
+{
+    const int test_addr = 0x100000 - (4096 * 8);
+    const int chunk_size = 1024;
+    const int iterations = 64;
+    static uint32_t buf[(1024 + 4) / 4];
+    uint8_t *dst[] = { (uint8_t*)buf, (uint8_t*)buf + 1 };
+
+    printf("flash read mode %d, %s reads\n", spiflash_get_read_mode(),
+            SPIFLASH_READ_WORKAROUND ? "60 byte" : "64 byte");
+
+    for (int i = 0; i < 2; i++) {
+        uint32_t max_us = 0;
+        uint32_t start = sdk_system_get_time();
+        for (int j = 0; j < iterations; j++) {
+            uint32_t t = sdk_system_get_time();
+            TEST_ASSERT_TRUE(spiflash_read(test_addr, dst[i], chunk_size));
+            t = sdk_system_get_time() - t;
+            if (t > max_us) {
+                max_us = t;
+            }
+        }
+        uint32_t total_us = sdk_system_get_time() - start;
+
+        printf("%s destination: %d.%03d MB/s, critical section %d us/KB\n",
+                i ? "unaligned" : "aligned",
+                (chunk_size * iterations) / total_us,
+                ((chunk_size * iterations) % total_us) * 1000 / total_us,
+                max_us);
+    }
+
+    TEST_PASS();
+}
+
+DEFINE_SOLO_TESTCASE(08_spiflash_preemptible)
+
+/**
+ * Write and erase a sector in normal and preemptible mode, verify the data
+ * and report the longest interrupt blackout time of each operation.
+ */
+static void a_08_spiflash_preemptible(void)
+{
+    const int test_addr = 0x100000 - (4096 * 8);
+    static uint8_t wbuf[4096];
+    static uint8_t rbuf[4096];
+    spiflash_blackout_stats_t stats;
+
+    for (int i = 0; i < sizeof(wbuf); i++) {
+        wbuf[i] = i * 7;
+    }
+
+    for (int preemptible = 0; preemptible < 2; preemptible++) {
+        spiflash_set_preemptible(preemptible);
+
+        TEST_ASSERT_TRUE(spiflash_erase_sector(test_addr));
+        spiflash_get_blackout_stats(&stats);
+        printf("%s erase: max blackout %d us\n",
+                preemptible ? "preemptible" : "normal", stats.last_op_us);
+
+        TEST_ASSERT_TRUE(spiflash_write(test_addr + 3, wbuf, sizeof(wbuf) - 3));
+        spiflash_get_blackout_stats(&stats);
+        printf("%s write: max blackout %d us\n",
+                preemptible ? "preemptible" : "normal", stats.last_op_us);
+
+        TEST_ASSERT_TRUE(spiflash_read(test_addr + 3, rbuf, sizeof(rbuf) - 3));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(wbuf, rbuf, sizeof(wbuf) - 3);
+    }
+    spiflash_set_preemptible(false);
+
+    TEST_PASS();
+}
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "esp/timer.h"
+#include "etstimer.h"
+#include "hrtimer/hrtimer.h"
+
+#include "testcase.h"
+
+DEFINE_SOLO_TESTCASE(09_hrtimer);
+
+static hrtimer_t oneshot, periodic, deferred;
+static ETSTimer sdk_timer;
+
+static uint32_t start;
+static volatile uint32_t oneshot_count, oneshot_delay;
+static volatile uint32_t periodic_count, periodic_last, periodic_max_error;
+static volatile uint32_t deferred_count, sdk_count;
+
+/* FRC2 ticks at 5MHz */
+static inline uint32_t us_since(uint32_t count)
+{
+    return (timer_get_count(FRC2) - count) / 5;
+}
+
+static void IRAM oneshot_cb(void *arg)
+{
+    oneshot_delay = us_since(start);
+    oneshot_count++;
+}
+
+static void IRAM periodic_cb(void *arg)
+{
+    if (periodic_count) {
+        uint32_t error = abs((int32_t)us_since(periodic_last) - 500);
+        if (error > periodic_max_error) {
+            periodic_max_error = error;
+        }
+    }
+    periodic_last = timer_get_count(FRC2);
+    if (++periodic_count == 20) {
+        hrtimer_disarm(&periodic);
+    }
+}
+
+static void deferred_cb(void *arg)
+{
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0xAA, (uint32_t)arg, "Argument invalid");
+    deferred_count++;
+}
+
+static void sdk_timer_cb(void *arg)
+{
+    sdk_count++;
+}
+
+static void test_task(void *pvParameters)
+{
+    TEST_ASSERT_TRUE_MESSAGE(hrtimer_init(3), "hrtimer_init failed");
+
+    hrtimer_setup(&oneshot, oneshot_cb, NULL, HRTIMER_ISR);
+    hrtimer_setup(&periodic, periodic_cb, NULL, HRTIMER_ISR);
+    hrtimer_setup(&deferred, deferred_cb, (void *)0xAA, HRTIMER_TASK);
+
+    /* SDK timers share FRC2 with hrtimer */
+    sdk_ets_timer_disarm(&sdk_timer);
+    sdk_ets_timer_setfn(&sdk_timer, sdk_timer_cb, NULL);
+    sdk_ets_timer_arm(&sdk_timer, 20, false);
+
+    start = timer_get_count(FRC2);
+    TEST_ASSERT_TRUE(hrtimer_arm(&oneshot, 300, 0));
+    TEST_ASSERT_TRUE(hrtimer_arm(&periodic, 500, 500));
+    TEST_ASSERT_TRUE(hrtimer_arm(&deferred, 1000, 2000));
+    TEST_ASSERT_FALSE(hrtimer_arm(&oneshot, 300, 1));
+
+    vTaskDelay(60 / portTICK_PERIOD_MS);
+    hrtimer_disarm(&deferred);
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, oneshot_count, "One-shot timer count wrong");
+    TEST_ASSERT_FALSE(hrtimer_is_armed(&oneshot));
+    printf("One-shot delay: %d us\n", oneshot_delay);
+    TEST_ASSERT_INT_WITHIN_MESSAGE(50, 300, oneshot_delay, "One-shot time wrong");
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(20, periodic_count, "Periodic timer count wrong");
+    printf("Periodic max error: %d us\n", periodic_max_error);
+    TEST_ASSERT_TRUE_MESSAGE(periodic_max_error < 50, "Periodic timer jitter too high");
+
+    printf("Deferred count: %d\n", deferred_count);
+    TEST_ASSERT_INT_WITHIN_MESSAGE(6, 25, deferred_count, "Deferred timer count wrong");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, sdk_count, "SDK timer hasn't fired");
+
+    TEST_PASS();
+}
+
+static void a_09_hrtimer(void)
+{
+    xTaskCreate(test_task, "test_task", 256, NULL, 2, NULL);
+}